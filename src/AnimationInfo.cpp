@@ -33,6 +33,8 @@
 #include "graphics_common.h"
 
 #include "graphics_accelerated.h"
+#include "Compositor.h"
+#include "SpanMap.h"
 
 #include <math.h>
 #ifndef M_PI
@@ -41,6 +43,10 @@
 
 //Mion: for special graphics routine handling
 AcceleratedGraphicsFunctions AnimationInfo::gfx;
+unsigned int AnimationInfo::generation = 0;
+Compositor* AnimationInfo::compositor = NULL;
+void (*AnimationInfo::pending_loader)(void*, AnimationInfo*) = NULL;
+void* AnimationInfo::pending_loader_data = NULL;
 
 
 AnimationInfo::AnimationInfo()
@@ -51,6 +57,8 @@ AnimationInfo::AnimationInfo()
 #ifdef BPP16
     alpha_buf     = NULL;
 #endif
+    spans         = NULL;
+    image_pending = false;
     trans_mode    = TRANS_TOPLEFT;
     affine_flag   = false;
     locked        = 0;
@@ -79,6 +87,7 @@ AnimationInfo& AnimationInfo::operator =(const AnimationInfo &anim)
     if (this != &anim){
         memcpy(this, &anim, sizeof(AnimationInfo));
         is_copy = true;
+        ++generation;
     }
     return *this;
 }
@@ -90,6 +99,7 @@ void AnimationInfo::deepcopy(const AnimationInfo &anim)
         reset();
         //copy the whole object
         memcpy(this, &anim, sizeof(AnimationInfo));
+        ++generation;
         if (anim.is_copy){
             return;
         }
@@ -98,6 +108,7 @@ void AnimationInfo::deepcopy(const AnimationInfo &anim)
 #ifdef BPP16
         alpha_buf = NULL;
 #endif
+        spans = NULL;
         //now set dynamic variables
         //duration_list = anim.duration_list;
         //color_list = anim.color_list;
@@ -112,6 +123,7 @@ void AnimationInfo::deepcopy(const AnimationInfo &anim)
 #ifdef BPP16
             memcpy(alpha_buf, anim.alpha_buf, w*h);
 #endif
+            if (anim.spans) spans = new SpanMap(*anim.spans);
         }
     }
     locked = 0;
@@ -150,6 +162,7 @@ void AnimationInfo::reset()
     pos.x = pos.y = 0;
     pos.w = pos.h = 0;
     abs_flag = true;
+    if (showing_) ++generation;
     showing_ = false;
     visible_ = false;
     enabled_ = true;
@@ -173,11 +186,36 @@ void AnimationInfo::reset()
 
 void AnimationInfo::deleteImage()
 {
+    if (image_surface) ++generation;
     if (!is_copy && image_surface) SDL_FreeSurface(image_surface);
     image_surface = NULL;
+    image_pending = false;
 #ifdef BPP16
     if (!is_copy && alpha_buf) delete[] alpha_buf;
     alpha_buf = NULL;
+#endif
+    dropSpans();
+}
+
+
+void AnimationInfo::dropSpans()
+{
+    if (!is_copy) delete spans;
+    spans = NULL;
+}
+
+
+// Call after writing to image_surface directly, so that blending and
+// hit-testing see the new alpha runs.
+void AnimationInfo::rebuildSpans()
+{
+    dropSpans();
+#ifndef BPP16
+    if (!is_copy && image_surface &&
+        image_surface->w > 0 && image_surface->h > 0) {
+        spans = new SpanMap;
+        spans->build(image_surface);
+    }
 #endif
 }
 
@@ -320,6 +358,15 @@ SDL_Rect AnimationInfo::findOpaquePoint(SDL_Rect *clip)
 
     for (int i=cliprect.y ; i<cliprect.h ; ++i){
         for (int j=cliprect.x ; j<cliprect.w ; ++j){
+#ifndef BPP16
+            if (spans) {
+                const SpanMap::Span* s = spans->find(i, j);
+                if (s->kind == SpanMap::SPAN_TRANSPARENT) {
+                    j = s->end - 1;
+                    continue;
+                }
+            }
+#endif
             int alpha = *(alphap + (image_surface->w * i + j) * psize);
             if (alpha > TRANSBTN_CUTOFF){
                 ret.x = j;
@@ -378,6 +425,42 @@ int AnimationInfo::getPixelAlpha(int x, int y)
 }
 
 
+#ifndef BPP16
+// imageFilterBlend for w pixels of row y of src from x, by span:
+// transparent runs are left alone and, at full alpha, opaque runs
+// copied, which is what BLEND_PIXEL does with them anyway.
+static void blendSpans(AcceleratedGraphicsFunctions& gfx, const SpanMap* spans,
+                       SDL_Surface* src, Uint32* dst_buffer,
+                       int x, int y, int w, int alpha)
+{
+    Uint32* src_buffer = (Uint32*) ((Uint8*) src->pixels + src->pitch * y) + x;
+    const SpanMap::Span* s = spans->find(y, x);
+    int i = 0, start = 0; // start: first pixel not yet blended
+    while (i < w) {
+        int run_end = s->end - x < w ? s->end - x : w;
+        bool skip = s->kind == SpanMap::SPAN_TRANSPARENT;
+        bool copy = s->kind == SpanMap::SPAN_OPAQUE && alpha == 256;
+        // Neighbouring runs that both need blending go in one call.
+        int blend_end = skip || copy ? i : run_end;
+        if ((skip || copy || run_end == w) && blend_end > start) {
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+            Uint8* alphap = (Uint8*) (src_buffer + start) + 3;
+#else
+            Uint8* alphap = (Uint8*) (src_buffer + start);
+#endif
+            gfx.imageFilterBlend(dst_buffer + start, src_buffer + start,
+                                 alphap, alpha, blend_end - start);
+        }
+        if (copy)
+            memcpy(dst_buffer + i, src_buffer + i, (run_end - i) * sizeof(Uint32));
+        if (skip || copy) start = run_end;
+        i = run_end;
+        ++s;
+    }
+}
+#endif
+
+
 void AnimationInfo::blendOnSurface(SDL_Surface* dst_surface, int dst_x,
                                    int dst_y, SDL_Rect &clip, int alpha)
 {
@@ -388,10 +471,12 @@ void AnimationInfo::blendOnSurface(SDL_Surface* dst_surface, int dst_x,
 
     /* ---------------------------------------- */
 
-    ++locked;
-
-    SDL_LockSurface(dst_surface);
-    SDL_LockSurface(image_surface);
+    {
+        Compositor::Guard guard;
+        ++locked;
+        SDL_LockSurface(dst_surface);
+        SDL_LockSurface(image_surface);
+    }
 
 #ifdef BPP16
     const int total_width = image_surface->pitch / 2;
@@ -404,6 +489,10 @@ void AnimationInfo::blendOnSurface(SDL_Surface* dst_surface, int dst_x,
                          src_rect.x;
     ONSBuf* dst_buffer = (ONSBuf*) dst_surface->pixels +
                          dst_surface->w * dst_rect.y + dst_rect.x;
+#ifndef BPP16
+    const int src_x = image_surface->w * current_cell / num_of_cells +
+                      src_rect.x;
+#endif
 #ifdef BPP16
     unsigned char* alphap = alpha_buf + image_surface->w * src_rect.y +
                             image_surface->w * current_cell / num_of_cells +
@@ -453,8 +542,13 @@ void AnimationInfo::blendOnSurface(SDL_Surface* dst_surface, int dst_x,
                 alphap += image_surface->w - dst_rect.w;
 #else
                 if (src_buffer >= srcmax) goto break2;
-                gfx.imageFilterBlend(dst_buffer, src_buffer, alphap, alpha,
-                                 dst_rect.w);
+                if (spans)
+                    blendSpans(gfx, spans, image_surface, dst_buffer,
+                               src_x, src_rect.y + dst_rect.h - i,
+                               dst_rect.w, alpha);
+                else
+                    gfx.imageFilterBlend(dst_buffer, src_buffer, alphap,
+                                         alpha, dst_rect.w);
                 src_buffer += total_width;
                 dst_buffer += dst_surface->w;
                 alphap += (image_surface->w)*4;
@@ -482,14 +576,12 @@ void AnimationInfo::blendOnSurface(SDL_Surface* dst_surface, int dst_x,
                 image_surface->w * image_surface->h;
 
             for (int i=dst_rect.h ; i ; --i){
-                for (int j=dst_rect.w ; j ; --j, src_buffer++, dst_buffer++){
-                    // If we've run out of source area, ignore the remainder.
-                    if (src_buffer >= srcmax) goto break2;
-                        ADDBLEND_PIXEL();
-                    }
-                src_buffer += total_width - dst_rect.w;
-                alphap += (image_surface->w - dst_rect.w)*4;
-                dst_buffer += dst_surface->w  - dst_rect.w;
+                if (src_buffer >= srcmax) goto break2;
+                gfx.imageFilterAddBlend(dst_buffer, src_buffer, alphap, alpha,
+                                       dst_rect.w);
+                src_buffer += total_width;
+                dst_buffer += dst_surface->w;
+                alphap += (image_surface->w)*4;
             }
         }
     } else if (blending_mode == BLEND_SUB) {
@@ -512,19 +604,18 @@ void AnimationInfo::blendOnSurface(SDL_Surface* dst_surface, int dst_x,
                 image_surface->w * image_surface->h;
 
             for (int i=dst_rect.h ; i ; --i){
-                for (int j=dst_rect.w ; j ; --j, src_buffer++, dst_buffer++){
-                    // If we've run out of source area, ignore the remainder.
-                    if (src_buffer >= srcmax) goto break2;
-                        SUBBLEND_PIXEL();
-                    }
-                src_buffer += total_width - dst_rect.w;
-                alphap += (image_surface->w - dst_rect.w)*4;
-                dst_buffer += dst_surface->w  - dst_rect.w;
+                if (src_buffer >= srcmax) goto break2;
+                gfx.imageFilterSubBlend(dst_buffer, src_buffer, alphap, alpha,
+                                       dst_rect.w);
+                src_buffer += total_width;
+                dst_buffer += dst_surface->w;
+                alphap += (image_surface->w)*4;
             }
         }
     }
 #endif
 break2:
+    Compositor::Guard guard;
     SDL_UnlockSurface( image_surface );
     SDL_UnlockSurface( dst_surface );
 
@@ -555,8 +646,11 @@ void AnimationInfo::blendOnSurface2(SDL_Surface* dst_surface, int dst_x,
     if (min_xy[1] >= clip.y + clip.h) return;
     if (min_xy[1] < clip.y) min_xy[1] = clip.y;
 
-    SDL_LockSurface(dst_surface);
-    SDL_LockSurface(image_surface);
+    {
+        Compositor::Guard guard;
+        SDL_LockSurface(dst_surface);
+        SDL_LockSurface(image_surface);
+    }
 
 #ifdef BPP16
     int total_width = image_surface->pitch / 2;
@@ -623,6 +717,7 @@ void AnimationInfo::blendOnSurface2(SDL_Surface* dst_surface, int dst_x,
     }
 
     // unlock surface
+    Compositor::Guard guard;
     SDL_UnlockSurface(image_surface);
     SDL_UnlockSurface(dst_surface);
 }
@@ -664,6 +759,7 @@ void AnimationInfo::blendText( SDL_Surface *surface, int dst_x, int dst_y,
 
     /* ---------------------------------------- */
 
+    dropSpans();
     SDL_LockSurface(surface);
     SDL_LockSurface(image_surface);
 
@@ -691,14 +787,19 @@ void AnimationInfo::blendText( SDL_Surface *surface, int dst_x, int dst_y,
         unsigned char *src_buffer = (unsigned char*)surface->pixels +
                                     surface->pitch*src_rect.y + src_rect.x;
         for (int i=dst_rect.h; i>0; i--){
+#ifdef BPP16
             for (int j=dst_rect.w; j>0; j--, dst_buffer++, src_buffer++){
                 BLEND_PIXEL8_ALPHA();
             }
             dst_buffer += total_width - dst_rect.w;
-#ifdef BPP16
             alphap += image_surface->w - dst_rect.w;
-#endif
             src_buffer += surface->pitch - dst_rect.w;
+#else
+            gfx.imageFilterBlendText(dst_buffer, src_buffer, src_color1,
+                                     src_color2, dst_rect.w);
+            dst_buffer += total_width;
+            src_buffer += surface->pitch;
+#endif
         }
     }
     else{
@@ -779,12 +880,14 @@ SDL_Surface* AnimationInfo::allocSurface(int w, int h)
 
 void AnimationInfo::allocImage(int w, int h)
 {
+    dropSpans();
     if (!image_surface
         || image_surface->w != w
         || image_surface->h != h) {
         deleteImage();
 
         image_surface = allocSurface(w, h);
+        ++generation;
 #ifdef BPP16
         if (image_surface)
         alpha_buf = new unsigned char[w * h];
@@ -801,6 +904,7 @@ void AnimationInfo::copySurface(SDL_Surface* surface, SDL_Rect* src_rect,
                                 SDL_Rect* dst_rect)
 {
     if (!image_surface || !surface) return;
+    dropSpans();
     
     SDL_Rect _dst_rect = {0, 0, image_surface->w, image_surface->h};
     if (dst_rect) _dst_rect = *dst_rect;
@@ -842,6 +946,7 @@ void AnimationInfo::copySurface(SDL_Surface* surface, SDL_Rect* src_rect,
 void AnimationInfo::fill(Uint8 r, Uint8 g, Uint8 b, Uint8 a)
 {
     if (!image_surface) return;
+    dropSpans();
 
     SDL_LockSurface(image_surface);
     ONSBuf* dst_buffer = (ONSBuf*) image_surface->pixels;
@@ -1052,6 +1157,8 @@ void AnimationInfo::setupImage( SDL_Surface *surface, SDL_Surface *surface_m,
         img_buffer += w % 2;
     }
     SDL_FreeSurface( tmp );
+#else
+    rebuildSpans();
 #endif
 }
 
@@ -1061,6 +1168,9 @@ bool AnimationInfo::update_showing()
     bool do_show = visible_ && enabled_;
     if (showing_ != do_show) {
         showing_ = do_show;
+        ++generation;
+        if (showing_ && image_pending && pending_loader)
+            pending_loader(pending_loader_data, this);
         return true;
     }
     return false;   
@@ -1069,18 +1179,6 @@ bool AnimationInfo::update_showing()
 
 #include "resize_image.h"
 
-static unsigned char *resize_buffer = NULL;
-static size_t resize_buffer_size = 0;
-
-void AnimationInfo::resetResizeBuffer() {
-    if (resize_buffer_size != 16){
-        if (resize_buffer) delete[] resize_buffer;
-        resize_buffer = new unsigned char[16];
-        resize_buffer_size = 16;
-    }
-}
-
-
 // resize 32bit surface to 32bit surface
 int AnimationInfo::resizeSurface( SDL_Surface *src, SDL_Surface *dst, int num_cells )
 {
@@ -1089,16 +1187,9 @@ int AnimationInfo::resizeSurface( SDL_Surface *src, SDL_Surface *dst, int num_ce
     Uint32 *src_buffer = (Uint32 *)src->pixels;
     Uint32 *dst_buffer = (Uint32 *)dst->pixels;
 
-    /* size of tmp_buffer must be larger than 16 bytes */
-    size_t len = src->w * (src->h+1) * 4 + 4;
-    if (resize_buffer_size < len){
-        if (resize_buffer) delete[] resize_buffer;
-        resize_buffer = new unsigned char[len];
-        resize_buffer_size = len;
-    }
-    resizeImage( (unsigned char*)dst_buffer, dst->w, dst->h, dst->w * 4,
-                 (unsigned char*)src_buffer, src->w, src->h, src->w * 4,
-                 4, resize_buffer, src->w * 4, num_cells );
+    resizeImage( (unsigned char*)dst_buffer, dst->w, dst->h, dst->pitch,
+                 (unsigned char*)src_buffer, src->w, src->h, src->pitch,
+                 num_cells, &gfx, compositor );
 
     SDL_UnlockSurface( src );
     SDL_UnlockSurface( dst );
@@ -37,6 +37,9 @@
 #include "BaseReader.h"
 #include "graphics_accelerated.h"
 
+class SpanMap;
+class Compositor;
+
 // To allow 2x mode designed for reproducing old Nscripter games at 2x resolution,
 // change the following line to:
 // In this mode, everything will be drawn at 2x its normal size and position, except for
@@ -122,6 +125,14 @@ public:
 #ifdef BPP16
     unsigned char* alpha_buf;
 #endif
+    // Opacity runs of image_surface as set up from an image file;
+    // NULL once anything else has drawn into it.
+    SpanMap* spans;
+    // Restored from a save without its image, which pending_loader is
+    // asked for when the sprite is first shown.
+    bool image_pending;
+    static void (*pending_loader)(void* data, AnimationInfo* anim);
+    static void* pending_loader_data;
 
     /* Automatic visibility toggles.
        HIDE_IF_* means to set visible to false when the state becomes true,
@@ -174,6 +185,14 @@ private:
     int locked;
 public:
     static AcceleratedGraphicsFunctions gfx;
+    // Threads for resizing images; resizing is only done from the
+    // main thread, so it's safe to share.
+    static Compositor* compositor;
+
+    // Bumped whenever any AnimationInfo gains or loses its image or
+    // changes visibility, so that lists of visible layers can tell
+    // when they need rebuilding.
+    static unsigned int generation;
 
     AnimationInfo();
     AnimationInfo(const AnimationInfo &anim);
@@ -187,6 +206,8 @@ public:
     void setImageName(const char* name);
     void setImageName(const pstring& name);
     void deleteImage();
+    void dropSpans();
+    void rebuildSpans();
     void remove();
     void removeTag();
 
@@ -215,7 +236,6 @@ public:
                     bool has_alpha, int ratio1=1, int ratio2=1);
 
     //Mion: for resizing (moved from ONScripterLabel)
-    static void resetResizeBuffer();
     static int resizeSurface(SDL_Surface *src, SDL_Surface *dst,
                              int num_cells=1);
 };
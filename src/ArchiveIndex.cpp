@@ -0,0 +1,112 @@
+/* -*- C++ -*-
+ *
+ *  ArchiveIndex.cpp - Hashed directory of the entries in a set of archives
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#include "ArchiveIndex.h"
+
+#define INITIAL_BUCKETS 1024
+
+ArchiveIndex::ArchiveIndex()
+{
+    rehash(INITIAL_BUCKETS);
+}
+
+
+void ArchiveIndex::clear()
+{
+    entries.clear();
+    rehash(INITIAL_BUCKETS);
+}
+
+
+pstring ArchiveIndex::normalize(const pstring& file_name)
+{
+    pstring key = file_name;
+    replace_ascii(key, '/', '\\');
+    // Same folding as CBString::caselessEqual, which this replaces.
+    key.tolower();
+    return key;
+}
+
+
+// FNV-1a; archive directories are small enough that anything cheap
+// with a reasonable spread will do.
+unsigned int ArchiveIndex::hash(const pstring& key)
+{
+    const unsigned char* c = key;
+    const unsigned char* e = c + key.length();
+    unsigned int h = 2166136261u;
+    while (c < e) {
+        h ^= *c++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+
+void ArchiveIndex::rehash(size_t num_buckets)
+{
+    buckets.assign(num_buckets, -1);
+    for (size_t i = 0; i < entries.size(); i++) {
+        int& head = buckets[entries[i].hash & (num_buckets - 1)];
+        entries[i].next = head;
+        head = i;
+    }
+}
+
+
+void ArchiveIndex::add(BaseReader::ArchiveInfo* ai)
+{
+    size_t wanted = entries.size() + ai->num_of_files;
+    size_t num_buckets = buckets.size();
+    while (num_buckets < wanted) num_buckets <<= 1;
+    if (num_buckets != buckets.size()) rehash(num_buckets);
+    entries.reserve(wanted);
+
+    for (unsigned int i = 0; i < ai->num_of_files; i++) {
+        Entry e;
+        e.key = normalize(ai->fi_list[i].name);
+        e.hash = hash(e.key);
+        e.loc.ai = ai;
+        e.loc.index = i;
+
+        Location dummy;
+        if (find(e.key, dummy)) continue;
+
+        int& head = buckets[e.hash & (buckets.size() - 1)];
+        e.next = head;
+        head = entries.size();
+        entries.push_back(e);
+    }
+}
+
+
+bool ArchiveIndex::find(const pstring& key, Location& loc) const
+{
+    unsigned int h = hash(key);
+    for (int i = buckets[h & (buckets.size() - 1)]; i >= 0;
+         i = entries[i].next) {
+        const Entry& e = entries[i];
+        if (e.hash == h && e.key == key) {
+            loc = e.loc;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,70 @@
+/* -*- C++ -*-
+ *
+ *  ArchiveIndex.h - Hashed directory of the entries in a set of archives
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __ARCHIVE_INDEX_H__
+#define __ARCHIVE_INDEX_H__
+
+#include "BaseReader.h"
+
+// Maps file names to the archive entry that provides them.  Names are
+// looked up case-insensitively and with '/' and '\' treated alike, as
+// SarReader has always done; when several archives contain the same
+// name, the archive that was added first wins.
+class ArchiveIndex {
+public:
+    struct Location {
+        BaseReader::ArchiveInfo* ai;
+        unsigned int index;
+    };
+
+    ArchiveIndex();
+
+    void clear();
+    size_t size() const { return entries.size(); }
+
+    // Index every entry of ai.  Names already present are left
+    // pointing at the earlier archive.
+    void add(BaseReader::ArchiveInfo* ai);
+
+    // Look up a key produced by normalize().
+    bool find(const pstring& key, Location& loc) const;
+
+    // Fold case and separators so that equivalent names compare equal.
+    static pstring normalize(const pstring& file_name);
+
+    // FNV-1a of a key.  PackedArchive stores these in its files, so
+    // this must not change.
+    static unsigned int hash(const pstring& key);
+
+private:
+    struct Entry {
+        pstring key;
+        unsigned int hash;
+        Location loc;
+        int next;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<int> buckets;
+
+    void rehash(size_t num_buckets);
+};
+
+#endif // __ARCHIVE_INDEX_H__
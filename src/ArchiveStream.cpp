@@ -0,0 +1,285 @@
+/* -*- C++ -*-
+ *
+ *  ArchiveStream.cpp - An SDL_RWops that reads a file from the archives
+ *                      a block at a time, ahead of its user
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#include "ArchiveStream.h"
+#include <string.h>
+
+SDL_RWops* ArchiveStream::open(BaseReader* reader, const pstring& file_name)
+{
+    if (!reader->canReadRange(file_name)) return NULL;
+    size_t length = reader->getFileLength(file_name);
+    if (!length) return NULL;
+
+    SDL_RWops* rw = SDL_AllocRW();
+    if (!rw) return NULL;
+    rw->type  = SDL_RWOPS_UNKNOWN;
+    rw->size  = rwSize;
+    rw->seek  = rwSeek;
+    rw->read  = rwRead;
+    rw->write = rwWrite;
+    rw->close = rwClose;
+    rw->hidden.unknown.data1 = new ArchiveStream(reader, file_name, length);
+    return rw;
+}
+
+
+ArchiveStream::ArchiveStream(BaseReader* reader, const pstring& file_name,
+                             size_t length)
+    : reader(reader), file_name(file_name), length(length),
+      thread(NULL), quit(false), failed(false), keep_whole(false),
+      whole(false), ring(RING_SIZE),
+      start(0), head(0), filled(0), pos(0), generation(0),
+      block(BLOCK_SIZE), loaded(0)
+{
+    mutex = SDL_CreateMutex();
+    cond  = SDL_CreateCond();
+    // Without a thread, read() fills the ring itself as it empties.
+    thread = SDL_CreateThread(threadMain, "stream", this);
+    if (!thread)
+        fprintf(stderr, "Couldn't start stream thread: %s\n", SDL_GetError());
+}
+
+
+ArchiveStream::~ArchiveStream()
+{
+    if (thread) {
+        SDL_LockMutex(mutex);
+        quit = true;
+        SDL_CondBroadcast(cond);
+        SDL_UnlockMutex(mutex);
+        SDL_WaitThread(thread, NULL);
+    }
+    SDL_DestroyCond(cond);
+    SDL_DestroyMutex(mutex);
+}
+
+
+size_t ArchiveStream::read(unsigned char* dst, size_t n)
+{
+    SDL_LockMutex(mutex);
+    size_t done = 0;
+    while (done < n && pos < length) {
+        if (pos < start || pos > start + filled) restart(pos);
+
+        size_t avail = start + filled - pos;
+        if (avail == 0) {
+            if (failed) break;
+            if (thread) SDL_CondWait(cond, mutex);
+            else if (!fillBlock()) break;
+            continue;
+        }
+
+        size_t c = avail < n - done ? avail : n - done;
+        size_t at = (head + (pos - start)) % ring.size();
+        size_t first = c < ring.size() - at ? c : ring.size() - at;
+        memcpy(dst + done, &ring[at], first);
+        memcpy(dst + done + first, &ring[0], c - first);
+        pos += c;
+        done += c;
+
+        // Make room for more, keeping a little behind us.
+        if (!whole && pos - start > HISTORY) {
+            size_t drop = pos - start - HISTORY;
+            start += drop;
+            head = (head + drop) % RING_SIZE;
+            filled -= drop;
+            SDL_CondBroadcast(cond);
+        }
+    }
+    SDL_UnlockMutex(mutex);
+    return done;
+}
+
+
+Sint64 ArchiveStream::seek(Sint64 offset, int whence)
+{
+    SDL_LockMutex(mutex);
+    Sint64 to;
+    if (whence == RW_SEEK_SET) to = offset;
+    else if (whence == RW_SEEK_CUR) to = (Sint64) pos + offset;
+    else to = (Sint64) length + offset;
+
+    if (to < 0) {
+        SDL_UnlockMutex(mutex);
+        return SDL_SetError("can't seek before the start of %s",
+                            (const char*) file_name);
+    }
+    pos = to;
+    // Get the reading under way now rather than at the next read.
+    if (pos < length && (pos < start || pos > start + filled)) restart(pos);
+    SDL_UnlockMutex(mutex);
+    return to;
+}
+
+
+// Empties the ring to fill it again from offset, with mutex held.
+void ArchiveStream::restart(size_t offset)
+{
+    start = offset;
+    head = 0;
+    filled = 0;
+    failed = false;
+    ++generation;
+    SDL_CondBroadcast(cond);
+}
+
+
+// Reads the next block into the ring, with mutex held; it is released
+// while the block is read.  Returns false if there is nothing to read
+// or no room for it.
+bool ArchiveStream::fillBlock()
+{
+    size_t end = start + filled;
+    if (failed || end >= length) return false;
+    size_t n = length - end;
+    if (n > BLOCK_SIZE) n = BLOCK_SIZE;
+    if (RING_SIZE - filled < n) return false;
+
+    int current = generation;
+    SDL_UnlockMutex(mutex);
+    size_t got = reader->getFileRange(file_name, end, n, &block[0]);
+    SDL_LockMutex(mutex);
+
+    // Reads only ever free room, so the block still fits unless a
+    // restart threw the ring away meanwhile.
+    if (current == generation) {
+        if (got == 0) {
+            fprintf(stderr, "can't read %s at %lu\n",
+                    (const char*) file_name, (unsigned long) end);
+            failed = true;
+        }
+        size_t at = (head + filled) % RING_SIZE;
+        size_t first = got < RING_SIZE - at ? got : RING_SIZE - at;
+        memcpy(&ring[at], &block[0], first);
+        memcpy(&ring[0], &block[first], got - first);
+        filled += got;
+        SDL_CondBroadcast(cond);
+    }
+    return true;
+}
+
+
+bool ArchiveStream::keepWhole(SDL_RWops* rw)
+{
+    if (rw->close != rwClose) return false;
+    ArchiveStream* s = (ArchiveStream*) rw->hidden.unknown.data1;
+    if (!s->thread) return false;
+
+    SDL_LockMutex(s->mutex);
+    s->keep_whole = true;
+    SDL_CondBroadcast(s->cond);
+    SDL_UnlockMutex(s->mutex);
+    return true;
+}
+
+
+// Reads the next block of the whole file into all, with mutex held;
+// it is released while the block is read.  The last block swaps all
+// in as the ring.  Returns false if there is nothing to read.
+bool ArchiveStream::loadBlock()
+{
+    if (!keep_whole || whole) return false;
+
+    SDL_UnlockMutex(mutex);
+    if (all.empty()) all.resize(length);
+    size_t n = length - loaded < (size_t) BLOCK_SIZE ? length - loaded
+                                                     : (size_t) BLOCK_SIZE;
+    size_t got = reader->getFileRange(file_name, loaded, n, &all[loaded]);
+    SDL_LockMutex(mutex);
+
+    if (got == 0) {
+        // Go on streaming.
+        fprintf(stderr, "can't read %s at %lu\n",
+                (const char*) file_name, (unsigned long) loaded);
+        keep_whole = false;
+        std::vector<unsigned char>().swap(all);
+        return false;
+    }
+
+    loaded += got;
+    if (loaded == length) {
+        ring.swap(all);
+        std::vector<unsigned char>().swap(all);
+        start = 0;
+        head = 0;
+        filled = length;
+        failed = false;
+        whole = true;
+        ++generation;
+        SDL_CondBroadcast(cond);
+    }
+    return true;
+}
+
+
+// Keeps the ring filled, and reads the whole file when asked to while
+// the ring is full.
+void ArchiveStream::work()
+{
+    SDL_LockMutex(mutex);
+    while (!quit)
+        if (!fillBlock() && !loadBlock()) SDL_CondWait(cond, mutex);
+    SDL_UnlockMutex(mutex);
+}
+
+
+int ArchiveStream::threadMain(void* data)
+{
+    ((ArchiveStream*) data)->work();
+    return 0;
+}
+
+
+Sint64 SDLCALL ArchiveStream::rwSize(SDL_RWops* rw)
+{
+    return ((ArchiveStream*) rw->hidden.unknown.data1)->length;
+}
+
+
+Sint64 SDLCALL ArchiveStream::rwSeek(SDL_RWops* rw, Sint64 offset, int whence)
+{
+    return ((ArchiveStream*) rw->hidden.unknown.data1)->seek(offset, whence);
+}
+
+
+size_t SDLCALL ArchiveStream::rwRead(SDL_RWops* rw, void* ptr, size_t size,
+                                     size_t num)
+{
+    if (size == 0) return 0;
+    ArchiveStream* s = (ArchiveStream*) rw->hidden.unknown.data1;
+    return s->read((unsigned char*) ptr, size * num) / size;
+}
+
+
+size_t SDLCALL ArchiveStream::rwWrite(SDL_RWops* rw, const void* ptr,
+                                      size_t size, size_t num)
+{
+    SDL_SetError("archive streams are read-only");
+    return 0;
+}
+
+
+int SDLCALL ArchiveStream::rwClose(SDL_RWops* rw)
+{
+    delete (ArchiveStream*) rw->hidden.unknown.data1;
+    SDL_FreeRW(rw);
+    return 0;
+}
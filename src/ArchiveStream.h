@@ -0,0 +1,117 @@
+/* -*- C++ -*-
+ *
+ *  ArchiveStream.h - An SDL_RWops that reads a file from the archives
+ *                    a block at a time, ahead of its user
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __ARCHIVE_STREAM_H__
+#define __ARCHIVE_STREAM_H__
+
+#include <SDL.h>
+#include <vector>
+#include "BaseReader.h"
+
+// Feeds a decoder that plays a file as it goes (music, long voices,
+// movies) without reading the file whole first.  A thread reads it
+// through BaseReader::getFileRange() a block at a time into a ring
+// buffer that the decoder reads from, so the memory used and the wait
+// for the first sample don't grow with the file.  The decoder only
+// waits when it catches up with the reading; a seek outside what is
+// buffered starts the reading again from there.
+//
+// The reader must stay open while the stream is; the sound and movie
+// code closes every stream before the archives can be replaced.
+class ArchiveStream {
+public:
+    enum {
+        BLOCK_SIZE = 64 * 1024,       // one getFileRange(), a chunk
+                                      // of a packed archive
+        RING_SIZE  = 4 * BLOCK_SIZE,
+        HISTORY    = BLOCK_SIZE       // kept behind the read position
+                                      // for short seeks back
+    };
+
+    // Files no longer than this are simpler and no slower read whole.
+    enum { MIN_LENGTH = RING_SIZE };
+
+    // An SDL_RWops reading file_name, or NULL if there is no such
+    // file.  Closing it stops the thread and frees the buffers.
+    static SDL_RWops* open(BaseReader* reader, const pstring& file_name);
+
+    // Has the thread read all of the file behind rw into memory, if
+    // rw is a stream, so that later reads and seeks never wait.  This
+    // doesn't wait itself: the thread keeps the ring filled first and
+    // reads the file in between, and reads stream as before until it
+    // is all in.  For users that seek from where they can't block,
+    // like a looping music callback.  Returns false if rw isn't a
+    // stream or has no thread, in which case rw still works but reads
+    // as it goes.
+    static bool keepWhole(SDL_RWops* rw);
+
+private:
+    BaseReader* reader;
+    pstring file_name;
+    size_t length;
+
+    // Guarded by mutex.  The ring holds bytes [start, start + filled)
+    // of the file, the first of them at ring[head].
+    SDL_mutex* mutex;
+    SDL_cond*  cond;
+    SDL_Thread* thread;
+    bool quit, failed;
+    bool keep_whole; // the thread is to read the whole file into all
+    bool whole;      // the ring holds the whole file and never drains
+    std::vector<unsigned char> ring;
+    size_t start, head, filled;
+    size_t pos;      // where the decoder reads next
+    int generation;  // bumped by restart(), to drop a block in flight
+
+    // Only touched by whoever fills the ring.
+    std::vector<unsigned char> block;
+
+    // Only touched by the thread, until all of it is read and it
+    // becomes the ring.
+    std::vector<unsigned char> all;
+    size_t loaded;
+
+    ArchiveStream(BaseReader* reader, const pstring& file_name,
+                  size_t length);
+    ~ArchiveStream();
+
+    size_t read(unsigned char* dst, size_t n);
+    Sint64 seek(Sint64 offset, int whence);
+    void restart(size_t offset);
+    bool fillBlock();
+    bool loadBlock();
+
+    void work();
+    static int threadMain(void* data);
+
+    static Sint64 SDLCALL rwSize(SDL_RWops* rw);
+    static Sint64 SDLCALL rwSeek(SDL_RWops* rw, Sint64 offset, int whence);
+    static size_t SDLCALL rwRead(SDL_RWops* rw, void* ptr, size_t size,
+                                 size_t num);
+    static size_t SDLCALL rwWrite(SDL_RWops* rw, const void* ptr,
+                                  size_t size, size_t num);
+    static int SDLCALL rwClose(SDL_RWops* rw);
+
+    ArchiveStream(const ArchiveStream&);
+    ArchiveStream& operator=(const ArchiveStream&);
+};
+
+#endif // __ARCHIVE_STREAM_H__
@@ -26,7 +26,10 @@
 #ifndef __BASE_READER_H__
 #define __BASE_READER_H__
 
+#include <SDL.h>
+#include <string.h>
 #include "defs.h"
+#include "MappedFile.h"
 
 #ifndef SEEK_END
 #define SEEK_END 2
@@ -70,6 +73,7 @@ struct BaseReader {
         FileInfo* fi_list;
         unsigned int num_of_files;
         unsigned long base_offset;
+        MappedFile map;
 
         ArchiveInfo() {
             next = NULL;
@@ -104,6 +108,35 @@ struct BaseReader {
 			   int* location = NULL) = 0;
 
     pstring getFile(const pstring& file_name, int* location = NULL);
+
+    // Points data at the bytes of a stored, unkeyed archive entry,
+    // valid until the reader is closed, so callers can use the file
+    // without copying it.  Returns false if no such view exists, in
+    // which case the caller should fall back to getFile().
+    virtual bool getFileView(const pstring& file_name,
+                             const unsigned char** data, size_t* length,
+                             int* location = NULL) { return false; }
+
+    // Decodes an image straight to a 32-bit surface without alpha,
+    // for formats that would otherwise be handed out as a BMP (SPB).
+    // Returns NULL for any other file, in which case the caller
+    // should fall back to getFile().
+    virtual SDL_Surface* getImage(const pstring& file_name,
+                                  int* location = NULL) { return NULL; }
+
+    // Copies up to length bytes of a file, starting at offset, into
+    // buf and returns the number copied.  Readers that can seek
+    // within an entry override this; the default reads the whole file.
+    virtual size_t getFileRange(const pstring& file_name, size_t offset,
+                                size_t length, unsigned char* buf);
+
+    // True if getFileRange() reads only the bytes asked for, so that
+    // reading a file in parts costs about what reading it whole does.
+    virtual bool canReadRange(const pstring& file_name) { return false; }
+
+    // Forgets anything remembered about file_name.  Call this after
+    // writing a file the reader might later be asked for.
+    virtual void invalidate(const pstring& file_name) { }
 };
 
 
@@ -121,4 +154,22 @@ BaseReader::getFile(const pstring& file_name, int* location)
     return data;
 }
 
+
+inline size_t
+BaseReader::getFileRange(const pstring& file_name, size_t offset,
+                         size_t length, unsigned char* buf)
+{
+    size_t total = getFileLength(file_name);
+    if (offset >= total) return 0;
+    if (length > total - offset) length = total - offset;
+
+    unsigned char* whole = new unsigned char[total];
+    total = getFile(file_name, whole);
+    if (offset >= total) length = 0;
+    else if (length > total - offset) length = total - offset;
+    memcpy(buf, whole + offset, length);
+    delete[] whole;
+    return length;
+}
+
 #endif // __BASE_READER_H__
@@ -0,0 +1,162 @@
+/* -*- C++ -*-
+ *
+ *  Compositor.cpp - Worker pool for drawing a rectangle in row bands
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#include "Compositor.h"
+#include <stdio.h>
+
+// Bands thinner than this aren't worth waking a thread for.
+#define MIN_BAND_ROWS 16
+// Several bands per thread, so that one thread landing on all the
+// sprites doesn't leave the others idle.
+#define BANDS_PER_THREAD 4
+
+SDL_mutex* Compositor::shared_mutex = NULL;
+
+Compositor::Compositor()
+    : mutex(NULL), surface_mutex(NULL), work_cond(NULL), done_cond(NULL),
+      quit(false), job_func(NULL), job_data(NULL),
+      job_bands(0), next_band(0), bands_done(0)
+{}
+
+
+Compositor::~Compositor()
+{
+    stop();
+}
+
+
+void Compositor::setThreads(int n)
+{
+    if (n <= 0) n = SDL_GetCPUCount();
+    if (n == threads()) return;
+
+    stop();
+    if (n <= 1) return;
+
+    mutex = SDL_CreateMutex();
+    surface_mutex = SDL_CreateMutex();
+    work_cond = SDL_CreateCond();
+    done_cond = SDL_CreateCond();
+    quit = false;
+
+    for (int i = 1; i < n; i++) {
+        SDL_Thread* t = SDL_CreateThread(workerMain, "compositor", this);
+        if (!t) {
+            fprintf(stderr, "Couldn't start compositor thread: %s\n",
+                    SDL_GetError());
+            break;
+        }
+        workers.push_back(t);
+    }
+}
+
+
+void Compositor::stop()
+{
+    if (!mutex) return;
+
+    SDL_LockMutex(mutex);
+    quit = true;
+    SDL_CondBroadcast(work_cond);
+    SDL_UnlockMutex(mutex);
+
+    for (size_t i = 0; i < workers.size(); i++)
+        SDL_WaitThread(workers[i], NULL);
+    workers.clear();
+
+    SDL_DestroyCond(done_cond);
+    SDL_DestroyCond(work_cond);
+    SDL_DestroyMutex(surface_mutex);
+    SDL_DestroyMutex(mutex);
+    mutex = surface_mutex = NULL;
+    work_cond = done_cond = NULL;
+}
+
+
+void Compositor::run(BandFunc func, void* data, const SDL_Rect& rect)
+{
+    int bands = threads() * BANDS_PER_THREAD;
+    if (bands > rect.h / MIN_BAND_ROWS) bands = rect.h / MIN_BAND_ROWS;
+
+    if (workers.empty() || bands < 2) {
+        SDL_Rect band = rect;
+        func(data, band);
+        return;
+    }
+
+    SDL_LockMutex(mutex);
+    job_func  = func;
+    job_data  = data;
+    job_rect  = rect;
+    job_bands = bands;
+    next_band = bands_done = 0;
+    shared_mutex = surface_mutex;
+    SDL_CondBroadcast(work_cond);
+    SDL_UnlockMutex(mutex);
+
+    work();
+
+    SDL_LockMutex(mutex);
+    while (bands_done < job_bands)
+        SDL_CondWait(done_cond, mutex);
+    job_func = NULL;
+    shared_mutex = NULL;
+    SDL_UnlockMutex(mutex);
+}
+
+
+// Draw bands of the current job until there are none left.
+void Compositor::work()
+{
+    SDL_LockMutex(mutex);
+    while (job_func && next_band < job_bands) {
+        int b = next_band++;
+        SDL_UnlockMutex(mutex);
+
+        SDL_Rect band = job_rect;
+        band.y = job_rect.y + job_rect.h * b / job_bands;
+        band.h = job_rect.y + job_rect.h * (b + 1) / job_bands - band.y;
+        job_func(job_data, band);
+
+        SDL_LockMutex(mutex);
+        if (++bands_done == job_bands)
+            SDL_CondSignal(done_cond);
+    }
+    SDL_UnlockMutex(mutex);
+}
+
+
+int Compositor::workerMain(void* data)
+{
+    Compositor* c = (Compositor*) data;
+
+    SDL_LockMutex(c->mutex);
+    while (!c->quit) {
+        if (c->job_func && c->next_band < c->job_bands) {
+            SDL_UnlockMutex(c->mutex);
+            c->work();
+            SDL_LockMutex(c->mutex);
+        }
+        else
+            SDL_CondWait(c->work_cond, c->mutex);
+    }
+    SDL_UnlockMutex(c->mutex);
+    return 0;
+}
@@ -0,0 +1,77 @@
+/* -*- C++ -*-
+ *
+ *  Compositor.h - Worker pool for drawing a rectangle in row bands
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __COMPOSITOR_H__
+#define __COMPOSITOR_H__
+
+#include <SDL.h>
+#include <vector>
+
+// Splits a rectangle into horizontal bands and draws them on a pool of
+// threads.  Bands always span the full width of the rectangle, so every
+// row is blended by exactly the same code as in a serial pass and the
+// result is identical whatever the number of threads.
+//
+// The band function must only write inside the band it is given.
+class Compositor {
+public:
+    typedef void (*BandFunc)(void* data, SDL_Rect& band);
+
+    Compositor();
+    ~Compositor();
+
+    // Number of threads to draw with, including the calling one; 1
+    // draws serially and 0 uses one thread per CPU.
+    void setThreads(int n);
+    int threads() const { return workers.size() + 1; }
+
+    void run(BandFunc func, void* data, const SDL_Rect& rect);
+
+    // SDL_LockSurface() and AnimationInfo::locked keep counts that are
+    // not safe to update from several threads at once.  Code that may
+    // run inside a band holds a Guard while touching them.
+    class Guard {
+    public:
+        Guard()  { if (shared_mutex) SDL_LockMutex(shared_mutex); }
+        ~Guard() { if (shared_mutex) SDL_UnlockMutex(shared_mutex); }
+    };
+    friend class Guard;
+
+private:
+    std::vector<SDL_Thread*> workers;
+    SDL_mutex* mutex;
+    SDL_mutex* surface_mutex;
+    SDL_cond*  work_cond;
+    SDL_cond*  done_cond;
+    bool quit;
+
+    BandFunc job_func;
+    void*    job_data;
+    SDL_Rect job_rect;
+    int job_bands, next_band, bands_done;
+
+    static SDL_mutex* shared_mutex;
+
+    void stop();
+    void work();
+    static int workerMain(void* data);
+};
+
+#endif // __COMPOSITOR_H__
@@ -24,7 +24,9 @@
  */
 
 #include "DirectReader.h"
+#include "Profiler.h"
 #include <stdio.h>
+#include <string.h>
 #include <bzlib.h>
 #if !defined (WIN32) && !defined (PSP) && !defined (__OS2__)
 #include <dirent.h>
@@ -71,9 +73,11 @@ DirectReader::DirectReader(DirPaths *path, const unsigned char* key_table)
         for (i = 0; i < 256; i++) this->key_table[i] = (unsigned char) i;
     }
 
-    read_buf = new unsigned char[READ_LENGTH];
-    decomp_buffer = new unsigned char[N * 2];
-    decomp_buffer_len = N * 2;
+    // Most keys just XOR every byte with a constant; note that, so
+    // decodeKeyTable can avoid the table lookups.
+    key_table_xor = this->key_table[0];
+    for (i = 0; i < 256; i++)
+        if (this->key_table[i] != (i ^ key_table_xor)) key_table_xor = -1;
 
     last_registered_compression_type = &root_registered_compression_type;
     registerCompressionType("SPB", SPB_COMPRESSION);
@@ -84,9 +88,6 @@ DirectReader::DirectReader(DirPaths *path, const unsigned char* key_table)
 
 DirectReader::~DirectReader()
 {
-    delete[] read_buf;
-    delete[] decomp_buffer;
-
     last_registered_compression_type = root_registered_compression_type.next;
     while (last_registered_compression_type) {
         RegisteredCompressionType* cur = last_registered_compression_type;
@@ -214,36 +215,43 @@ FILE* DirectReader::fileopen(pstring path, const char* mode)
 }
 
 
-unsigned char DirectReader::readChar(FILE* fp)
+bool DirectReader::Stream::fill()
 {
-    unsigned char ret;
+    if (map && pos < map->size()) {
+        next = map->data() + pos;
+        end = map->data() + map->size();
+        pos = map->size();
+        return true;
+    }
 
-    fread(&ret, 1, 1, fp);
-    return key_table[ret];
+    size_t len = MappedFile::readAt(fp, pos, buf, BUFFER_SIZE);
+    next = buf;
+    end = buf + len;
+    pos += len;
+    return len > 0;
 }
 
 
-unsigned short DirectReader::readShort(FILE* fp)
+// EOF at the end of the stream.
+int DirectReader::readChar(Stream& s)
 {
-    int ret;
-    unsigned char buf[2];
+    if (s.next == s.end && !s.fill()) return EOF;
 
-    fread(&buf, 1, 2, fp);
-    ret = key_table[buf[0]] << 8 | key_table[buf[1]];
-    return (unsigned short) ret;
+    return s.plain ? *s.next++ : key_table[*s.next++];
 }
 
 
-unsigned long DirectReader::readLong(FILE* fp)
+unsigned short DirectReader::readShort(Stream& s)
 {
-    unsigned long ret;
-    unsigned char buf[4];
-
-    fread(&buf, 1, 4, fp);
-    ret = key_table[buf[0]];
-    ret = ret << 8 | key_table[buf[1]];
-    ret = ret << 8 | key_table[buf[2]];
-    ret = ret << 8 | key_table[buf[3]];
+    int hi = readChar(s), lo = readChar(s);
+    return (unsigned short) ((hi & 0xff) << 8 | (lo & 0xff));
+}
+
+
+unsigned long DirectReader::readLong(Stream& s)
+{
+    unsigned long ret = readShort(s);
+    ret = ret << 16 | readShort(s);
     return ret;
 }
 
@@ -308,7 +316,7 @@ FILE* DirectReader::getFileHandle(pstring filename, int& compression_type,
         compression_type = getRegisteredCompressionType(filename);
         if (compression_type == NBZ_COMPRESSION ||
             compression_type == SPB_COMPRESSION) {
-            *length = getDecompressedFileLength(compression_type, fp, 0);
+            *length = getDecompressedFileLength(compression_type, fp, NULL, 0);
         }
         else {
             fseek(fp, 0, SEEK_END);
@@ -338,10 +346,17 @@ size_t DirectReader::getFile(const pstring& file_name, unsigned char* buffer,
     FILE*  fp = getFileHandle(file_name, compression_type, &len);
 
     if (fp) {
-        if (compression_type & NBZ_COMPRESSION)
-	    return decodeNBZ(fp, 0, buffer);
-        else if (compression_type & SPB_COMPRESSION)
-	    return decodeSPB(fp, 0, buffer);
+        Profiler::countBytes("(loose files)", len);
+        if (location) *location = ARCHIVE_TYPE_NONE;
+        if (compression_type & (NBZ_COMPRESSION | SPB_COMPRESSION)) {
+            Stream s(fp, NULL, 0);
+            if (compression_type & NBZ_COMPRESSION)
+                total = decodeNBZ(s, buffer);
+            else
+                total = decodeSPB(s, buffer);
+            fclose(fp);
+            return total;
+        }
 
         total = len;
         while (len > 0) {
@@ -353,13 +368,64 @@ size_t DirectReader::getFile(const pstring& file_name, unsigned char* buffer,
             buffer += c;
         }
         fclose(fp);
-        if (location) *location = ARCHIVE_TYPE_NONE;
     }
 
     return total;
 }
 
 
+size_t DirectReader::getFileRange(const pstring& file_name, size_t offset,
+                                  size_t length, unsigned char* buf)
+{
+    int compression_type;
+    size_t len;
+    FILE* fp = getFileHandle(file_name, compression_type, &len);
+    if (!fp) return 0;
+    if (compression_type != NO_COMPRESSION) {
+        fclose(fp);
+        return BaseReader::getFileRange(file_name, offset, length, buf);
+    }
+
+    if (offset >= len) length = 0;
+    else if (length > len - offset) length = len - offset;
+    length = MappedFile::readAt(fp, offset, buf, length);
+    fclose(fp);
+    Profiler::countBytes("(loose files)", length);
+    return length;
+}
+
+
+bool DirectReader::canReadRange(const pstring& file_name)
+{
+    int compression_type;
+    size_t len;
+    FILE* fp = getFileHandle(file_name, compression_type, &len);
+    if (!fp) return false;
+    fclose(fp);
+    return compression_type == NO_COMPRESSION;
+}
+
+
+SDL_Surface* DirectReader::getImage(const pstring& file_name, int* location)
+{
+    int compression_type;
+    size_t len;
+    FILE* fp = getFileHandle(file_name, compression_type, &len);
+    if (!fp) return NULL;
+
+    SDL_Surface* image = NULL;
+    if (compression_type & SPB_COMPRESSION) {
+        Profiler::countBytes("(loose files)", len);
+        if (location) *location = ARCHIVE_TYPE_NONE;
+        Stream s(fp, NULL, 0);
+        image = decodeSPBImage(s);
+    }
+    fclose(fp);
+
+    return image;
+}
+
+
 pstring DirectReader::convertFromSJISToUTF8(const pstring& src)
 {
     pstring dst = "";
@@ -391,80 +457,174 @@ pstring DirectReader::convertFromSJISToUTF8(const pstring& src)
 }
 
 
-size_t DirectReader::decodeNBZ(FILE* fp, size_t offset, unsigned char* buf)
+// dst and src may be the same buffer.
+void DirectReader::decodeKeyTable(unsigned char* dst, const unsigned char* src,
+                                  size_t len)
+{
+    if (key_table_xor == 0) {
+        if (dst != src) memcpy(dst, src, len);
+    }
+    else if (key_table_xor > 0) {
+        // Simple enough for the compiler to vectorise.
+        const unsigned char x = key_table_xor;
+        for (size_t j = 0; j < len; j++) dst[j] = src[j] ^ x;
+    }
+    else {
+        size_t j = 0;
+        for (; j + 4 <= len; j += 4) {
+            unsigned char a = key_table[src[j]],     b = key_table[src[j + 1]];
+            unsigned char c = key_table[src[j + 2]], d = key_table[src[j + 3]];
+            dst[j] = a; dst[j + 1] = b; dst[j + 2] = c; dst[j + 3] = d;
+        }
+        for (; j < len; j++) dst[j] = key_table[src[j]];
+    }
+}
+
+
+size_t DirectReader::decodeNBZ(Stream& s, unsigned char* buf)
 {
     if (key_table_flag)
         fprintf(stderr, "may not decode NBZ with key_table enabled.\n");
 
-    unsigned int original_length, count;
-    BZFILE* bfp;
-    void*   unused;
-    int err, len, nunused;
+    size_t original_length = readLong(s);
 
-    fseek(fp, offset, SEEK_SET);
-    original_length = count = readLong(fp);
+    bz_stream bz;
+    memset(&bz, 0, sizeof(bz));
+    if (BZ2_bzDecompressInit(&bz, 0, 0) != BZ_OK) return 0;
 
-    bfp = BZ2_bzReadOpen(&err, fp, 0, 0, NULL, 0);
-    if (bfp == NULL || err != BZ_OK) return 0;
+    bz.next_out  = (char*) buf;
+    bz.avail_out = original_length;
 
-    while (err == BZ_OK && count > 0) {
-        if (count >= READ_LENGTH)
-            len = BZ2_bzRead(&err, bfp, buf, READ_LENGTH);
-        else
-            len = BZ2_bzRead(&err, bfp, buf, count);
+    int err = BZ_OK;
+    while (err == BZ_OK && bz.avail_out > 0) {
+        if (s.next == s.end && !s.fill()) break;
 
-        count -= len;
-        buf += len;
+        // The compressed data isn't keyed, so it can go in as it is.
+        bz.next_in  = (char*) s.next;
+        bz.avail_in = s.end - s.next;
+        err = BZ2_bzDecompress(&bz);
+        s.next = s.end - bz.avail_in;
     }
 
-    BZ2_bzReadGetUnused(&err, bfp, &unused, &nunused);
-    BZ2_bzReadClose(&err, bfp);
+    BZ2_bzDecompressEnd(&bz);
 
-    return original_length - count;
+    return original_length - bz.avail_out;
 }
 
 
-int DirectReader::getbit(FILE* fp, int n)
+// Tops the bit buffer up to at least 57 bits where the data allows,
+// a whole word at a time when the key is a plain xor and eight bytes
+// are at hand.  False if fewer than n bits remain.
+bool DirectReader::refillBits(Stream& s, int n)
 {
-    int i, x = 0;
-    static int getbit_buf;
+    int key_xor = s.plain ? 0 : key_table_xor;
+    if (key_xor >= 0 && s.end - s.next >= 8) {
+        Uint64 word;
+        memcpy(&word, s.next, 8);
+        Uint32 key = key_xor * 0x01010101u;
+        word = SDL_SwapBE64(word) ^ ((Uint64) key << 32 | key);
+        // Bits of the last byte that don't fit are or'd in again, in
+        // the same place, by the next refill.
+        s.bits |= word >> s.bit_count;
+        s.next += (63 - s.bit_count) >> 3;
+        s.bit_count |= 56;
+        return true;
+    }
 
-    for (i = 0; i < n; i++) {
-        if (getbit_mask == 0) {
-            if (getbit_len == getbit_count) {
-                getbit_len = fread(read_buf, 1, READ_LENGTH, fp);
-                if (getbit_len == 0) return EOF;
+    while (s.bit_count <= 56) {
+        if (s.next == s.end && !s.fill()) break;
 
-                getbit_count = 0;
-            }
+        int c = s.plain ? *s.next++ : key_table[*s.next++];
+        s.bits |= (Uint64) c << (56 - s.bit_count);
+        s.bit_count += 8;
+    }
 
-            getbit_buf  = key_table[read_buf[getbit_count++]];
-            getbit_mask = 128;
-        }
+    if (s.bit_count >= n) return true;
+
+    // Like reading byte by byte, a short read uses up what was left.
+    s.bits = 0;
+    s.bit_count = 0;
+    return false;
+}
 
-        x <<= 1;
-        if (getbit_buf & getbit_mask) x++;
 
-        getbit_mask >>= 1;
-    }
+// The next n bits (1 to 32), EOF if the data runs out.
+inline int DirectReader::getbit(Stream& s, int n)
+{
+    if (s.bit_count < n && !refillBits(s, n)) return EOF;
+
+    int x = (int) (s.bits >> (64 - n));
+    s.bits <<= n;
+    s.bit_count -= n;
 
     return x;
 }
 
 
-size_t DirectReader::decodeSPB(FILE* fp, size_t offset, unsigned char* buf)
+// One colour plane of an SPB image, in the order it is stored.
+// Writes up to three bytes past length.
+void DirectReader::decodeSPBPlane(Stream& s, unsigned char* plane,
+                                  size_t length)
 {
-    unsigned int   count;
-    unsigned char* pbuf, * psbuf;
-    size_t i, j, k;
-    int c, n, m;
+    size_t count = 0;
+    int c, n, m, k, j;
+
+    plane[count++] = c = getbit(s, 8);
+    while (count < length) {
+        n = getbit(s, 3);
+        if (n == 0) {
+            plane[count++] = c;
+            plane[count++] = c;
+            plane[count++] = c;
+            plane[count++] = c;
+            continue;
+        }
+        else if (n == 7) {
+            m = getbit(s, 1) + 1;
+        }
+        else {
+            m = n + 2;
+        }
 
-    getbit_mask = 0;
-    getbit_len  = getbit_count = 0;
+        for (j = 0; j < 4; j++) {
+            if (m == 8) {
+                c = getbit(s, 8);
+            }
+            else {
+                k = getbit(s, m);
+                if (k & 1) c += (k >> 1) + 1;
+                else c -= (k >> 1);
+            }
 
-    fseek(fp, offset, SEEK_SET);
-    size_t width  = readShort(fp);
-    size_t height = readShort(fp);
+            plane[count++] = c;
+        }
+    }
+}
+
+
+// Lays a decoded plane out in an image whose top row starts at dst:
+// the rows run alternately left to right and right to left.
+static void scatterPlane(const unsigned char* plane, size_t width,
+                         size_t height, unsigned char* dst,
+                         long row_step, int pixel_step)
+{
+    for (size_t j = 0; j < height; j++) {
+        unsigned char* p = dst + (long) j * row_step;
+        int step = pixel_step;
+        if (j & 1) {
+            p += (width - 1) * pixel_step;
+            step = -pixel_step;
+        }
+
+        for (size_t k = 0; k < width; k++, p += step) *p = *plane++;
+    }
+}
+
+
+size_t DirectReader::decodeSPB(Stream& s, unsigned char* buf)
+{
+    size_t width  = readShort(s);
+    size_t height = readShort(s);
 
     size_t width_pad = (4 - width * 3 % 4) % 4;
 
@@ -490,95 +650,89 @@ size_t DirectReader::decodeSPB(FILE* fp, size_t offset, unsigned char* buf)
 
     buf += 54;
 
-    if (decomp_buffer_len < width * height + 4) {
-        if (decomp_buffer) delete[] decomp_buffer;
-
-        decomp_buffer_len = width * height + 4;
-        decomp_buffer = new unsigned char[decomp_buffer_len];
+    // BMP rows are stored bottom up, blue first.
+    long row_size = width * 3 + width_pad;
+    unsigned char* plane = new unsigned char[width * height + 4];
+    for (int i = 0; i < 3; i++) {
+        decodeSPBPlane(s, plane, width * height);
+        scatterPlane(plane, width, height, buf + row_size * (height - 1) + i,
+                     -row_size, 3);
     }
+    delete[] plane;
 
-    for (i = 0; i < 3; i++) {
-        count = 0;
-        decomp_buffer[count++] = c = getbit(fp, 8);
-        while (count < (unsigned) (width * height)) {
-            n = getbit(fp, 3);
-            if (n == 0) {
-                decomp_buffer[count++] = c;
-                decomp_buffer[count++] = c;
-                decomp_buffer[count++] = c;
-                decomp_buffer[count++] = c;
-                continue;
-            }
-            else if (n == 7) {
-                m = getbit(fp, 1) + 1;
-            }
-            else {
-                m = n + 2;
-            }
-
-            for (j = 0; j < 4; j++) {
-                if (m == 8) {
-                    c = getbit(fp, 8);
-                }
-                else {
-                    k = getbit(fp, m);
-                    if (k & 1) c += (k >> 1) + 1;
-                    else c -= (k >> 1);
-                }
-
-                decomp_buffer[count++] = c;
-            }
-        }
-
-        pbuf  = buf + (width * 3 + width_pad) * (height - 1) + i;
-        psbuf = decomp_buffer;
-
-        for (j = 0; j < height; j++) {
-            if (j & 1) {
-                for (k = 0; k < width; k++, pbuf -= 3) *pbuf = *psbuf++;
+    return total_size;
+}
 
-                pbuf -= width * 3 + width_pad - 3;
-            }
-            else {
-                for (k = 0; k < width; k++, pbuf += 3) *pbuf = *psbuf++;
 
-                pbuf -= width * 3 + width_pad + 3;
-            }
-        }
+SDL_Surface* DirectReader::decodeSPBImage(Stream& s)
+{
+    int width  = readShort(s);
+    int height = readShort(s);
+    if (width == 0 || height == 0) return NULL;
+
+    SDL_Surface* surface =
+        SDL_CreateRGBSurface(SDL_SWSURFACE, width, height, 32,
+                             0x00ff0000, 0x0000ff00, 0x000000ff, 0);
+    if (!surface) return NULL;
+
+    SDL_LockSurface(surface);
+    unsigned char* plane = new unsigned char[width * height + 4];
+    for (int i = 0; i < 3; i++) {
+        decodeSPBPlane(s, plane, width * height);
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+        int offset = i;
+#else
+        int offset = 3 - i;
+#endif
+        scatterPlane(plane, width, height,
+                     (unsigned char*) surface->pixels + offset,
+                     surface->pitch, 4);
     }
+    delete[] plane;
+    SDL_UnlockSurface(surface);
 
-    return total_size;
+    return surface;
 }
 
 
-size_t DirectReader::decodeLZSS(ArchiveInfo* ai, int no, unsigned char* buf)
+// Output is clipped to original_length.  The ring the data refers to
+// is the last N bytes of output, so matches are copied from buf;
+// places the ring had not yet been written to hold zeros.
+size_t DirectReader::decodeLZSS(Stream& s, size_t original_length,
+                                unsigned char* buf)
 {
-    unsigned int count = 0;
-    int i, j, k, r, c;
-
-    getbit_mask = 0;
-    getbit_len  = getbit_count = 0;
+    size_t count = 0, len, dist, k;
+    int i, j, c;
 
-    fseek(ai->file_handle, ai->fi_list[no].offset, SEEK_SET);
-    memset(decomp_buffer, 0, N - F);
-    r = N - F;
-
-    while (count < ai->fi_list[no].original_length) {
-        if (getbit(ai->file_handle, 1)) {
-            if ((c = getbit(ai->file_handle, 8)) == EOF) break;
+    while (count < original_length) {
+        if (getbit(s, 1)) {
+            if ((c = getbit(s, 8)) == EOF) break;
 
             buf[count++] = c;
-            decomp_buffer[r++] = c;  r &= (N - 1);
         }
         else {
-            if ((i = getbit(ai->file_handle, EI)) == EOF) break;
-
-            if ((j = getbit(ai->file_handle, EJ)) == EOF) break;
-
-            for (k = 0; k <= j + 1; k++) {
-                c = decomp_buffer[(i + k) & (N - 1)];
-                buf[count++] = c;
-                decomp_buffer[r++] = c;  r &= (N - 1);
+            if ((i = getbit(s, EI)) == EOF) break;
+
+            if ((j = getbit(s, EJ)) == EOF) break;
+
+            dist = (N - F + count - i) & (N - 1);
+            if (dist == 0) dist = N;
+            len = j + 2;
+
+            unsigned char* p = buf + count;
+            if (dist >= 8 && dist <= count && original_length - count > 16) {
+                // At least eight bytes back, so eight at a time can't
+                // overlap; overshooting len is harmless as it is.
+                memcpy(p, p - dist, 8);
+                memcpy(p + 8, p + 8 - dist, 8);
+                if (len > 16) p[16] = p[16 - dist];
+                count += len;
+            }
+            else {
+                if (len > original_length - count)
+                    len = original_length - count;
+                for (k = 0; k < len; k++, count++)
+                    buf[count] = count >= dist ? buf[count - dist] : 0;
             }
         }
     }
@@ -587,25 +741,23 @@ size_t DirectReader::decodeLZSS(ArchiveInfo* ai, int no, unsigned char* buf)
 }
 
 
-size_t DirectReader::getDecompressedFileLength(int type, FILE* fp, size_t offset)
+size_t DirectReader::getDecompressedFileLength(int type, FILE* fp,
+                                               const MappedFile* map,
+                                               size_t offset)
 {
-    fpos_t pos;
+    Stream s(fp, map, offset);
     size_t length = 0;
-    fgetpos(fp, &pos);
-    fseek(fp, offset, SEEK_SET);
 
     if (type == NBZ_COMPRESSION) {
-        length = readLong(fp);
+        length = readLong(s);
     }
     else if (type == SPB_COMPRESSION) {
-        size_t width     = readShort(fp);
-        size_t height    = readShort(fp);
+        size_t width     = readShort(s);
+        size_t height    = readShort(s);
         size_t width_pad = (4 - width * 3 % 4) % 4;
 
         length = (width * 3 + width_pad) * height + 54;
     }
 
-    fsetpos(fp, &pos);
-
     return length;
 }
@@ -31,6 +31,10 @@
 
 #define MAX_FILE_NAME_LENGTH 256
 
+// Once opened, a reader keeps no state between reads: each read
+// decodes through its own Stream, and archives are read by position,
+// so any number of threads may read at once.  open(), close() and
+// registerCompressionType() must not run alongside reads.
 class DirectReader : public BaseReader {
 public:
     DirectReader(DirPaths *path = NULL, const unsigned char* key_table = 0);
@@ -47,6 +51,10 @@ public:
     size_t getFileLength(const pstring& file_name);
     size_t getFile(const pstring& file_name, unsigned char* buffer,
                    int* location = NULL);
+    SDL_Surface* getImage(const pstring& file_name, int* location = NULL);
+    size_t getFileRange(const pstring& file_name, size_t offset,
+                        size_t length, unsigned char* buf);
+    bool canReadRange(const pstring& file_name);
 
 //    static string convertFromSJISToEUC(string buf);
     static pstring convertFromSJISToUTF8(const pstring& src);
@@ -55,11 +63,29 @@ protected:
     DirPaths *archive_path;
     unsigned char key_table[256];
     bool   key_table_flag;
-    int    getbit_mask;
-    size_t getbit_len, getbit_count;
-    unsigned char* read_buf;
-    unsigned char* decomp_buffer;
-    size_t decomp_buffer_len;
+    int    key_table_xor;
+
+    // The input of one read: bytes from offset on, straight from the
+    // archive mapping where there is one, else read in by position.
+    struct Stream {
+        enum { BUFFER_SIZE = 4096 };
+
+        FILE* fp;
+        const MappedFile* map;
+        size_t pos;                        // file offset after end
+        const unsigned char* next, * end;  // bytes not yet used
+        Uint64 bits;    // for getbit(): bit_count bits, topmost first
+        int bit_count;
+        bool plain;     // not under key_table, as in packed archives
+        unsigned char buf[BUFFER_SIZE];
+
+        Stream(FILE* fp, const MappedFile* map, size_t offset)
+            : fp(fp), map(map), pos(offset), next(buf), end(buf),
+              bits(0), bit_count(0), plain(false) {}
+
+        // Gets more bytes into next..end; false at the end of the file.
+        bool fill();
+    };
 
     // TODO: replace with map
     struct RegisteredCompressionType {
@@ -79,15 +105,21 @@ protected:
     } root_registered_compression_type, *last_registered_compression_type;
 
     FILE* fileopen(pstring path, const char* mode);
-    unsigned char readChar(FILE* fp);
-    unsigned short readShort(FILE* fp);
-    unsigned long readLong(FILE* fp);
-    size_t decodeNBZ(FILE* fp, size_t offset, unsigned char* buf);
-    int getbit(FILE* fp, int n);
-    size_t decodeSPB(FILE* fp, size_t offset, unsigned char* buf);
-    size_t decodeLZSS(ArchiveInfo* ai, int no, unsigned char* buf);
+    int readChar(Stream& s);
+    unsigned short readShort(Stream& s);
+    unsigned long readLong(Stream& s);
+    size_t decodeNBZ(Stream& s, unsigned char* buf);
+    bool refillBits(Stream& s, int n);
+    int getbit(Stream& s, int n);
+    void decodeSPBPlane(Stream& s, unsigned char* plane, size_t length);
+    size_t decodeSPB(Stream& s, unsigned char* buf);
+    SDL_Surface* decodeSPBImage(Stream& s);
+    size_t decodeLZSS(Stream& s, size_t original_length, unsigned char* buf);
     int getRegisteredCompressionType(pstring filename);
-    size_t getDecompressedFileLength(int type, FILE* fp, size_t offset);
+    size_t getDecompressedFileLength(int type, FILE* fp,
+                                     const MappedFile* map, size_t offset);
+    void decodeKeyTable(unsigned char* dst, const unsigned char* src,
+                        size_t len);
 
 private:
     FILE* getFileHandle(pstring filename, int& compression_type, size_t* length);
@@ -0,0 +1,146 @@
+/* -*- C++ -*-
+ *
+ *  ImageCache.cpp - Cache of decoded images
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#include "ImageCache.h"
+
+ImageCache::ImageCache(size_t budget)
+    : hits(0), misses(0), evictions(0),
+      max_size(budget), cur_size(0)
+{}
+
+
+ImageCache::~ImageCache()
+{
+    clear();
+}
+
+
+void ImageCache::setBudget(size_t bytes)
+{
+    max_size = bytes;
+    evict(0);
+}
+
+
+pstring ImageCache::makeKey(const pstring& filename, bool twox,
+                            bool isflipped, bool want_alpha)
+{
+    pstring key;
+    key.format("%d%d%d:", twox, isflipped, want_alpha);
+    key += filename;
+    return key;
+}
+
+
+SDL_Surface* ImageCache::get(const pstring& key, bool* has_alpha)
+{
+    dictionary<pstring, lru_t::iterator>::t::iterator e = entries.find(key);
+    if (e == entries.end()) {
+        ++misses;
+        return NULL;
+    }
+    ++hits;
+
+    lru_t::iterator it = e->second;
+    lru.splice(lru.begin(), lru, it);
+
+    if (has_alpha) *has_alpha = it->has_alpha;
+    it->surface->refcount++;
+    return it->surface;
+}
+
+
+void ImageCache::add(const pstring& key, SDL_Surface* surface,
+                     bool has_alpha)
+{
+    if (!surface) return;
+
+    size_t size = surface->pitch * surface->h;
+    if (size > max_size) return;
+
+    dictionary<pstring, lru_t::iterator>::t::iterator e = entries.find(key);
+    if (e != entries.end()) erase(e->second);
+
+    evict(size);
+
+    Entry entry;
+    entry.key = key;
+    entry.surface = surface;
+    entry.has_alpha = has_alpha;
+    entry.size = size;
+    surface->refcount++;
+
+    lru.push_front(entry);
+    entries[key] = lru.begin();
+    cur_size += size;
+}
+
+
+void ImageCache::invalidate(const pstring& filename)
+{
+    pstring name = filename;
+    replace_ascii(name, '/', '\\');
+
+    lru_t::iterator it = lru.begin();
+    while (it != lru.end()) {
+        pstring key = it->key;
+        replace_ascii(key, '/', '\\');
+        if (key.caselessfind(name) >= 0)
+            erase(it++);
+        else
+            ++it;
+    }
+}
+
+
+void ImageCache::clear()
+{
+    while (!lru.empty()) erase(lru.begin());
+}
+
+
+void ImageCache::printStats(FILE* fp) const
+{
+    unsigned long total = hits + misses;
+    fprintf(fp, "image cache: %lu hits, %lu misses (%.1f%%), "
+            "%lu evictions, %lu entries, %lu/%lu KB\n",
+            hits, misses, total ? hits * 100.0 / total : 0.0, evictions,
+            (unsigned long) entries.size(), (unsigned long) cur_size / 1024,
+            (unsigned long) max_size / 1024);
+}
+
+
+// Make room for `wanted` more bytes.
+void ImageCache::evict(size_t wanted)
+{
+    while (!lru.empty() && cur_size + wanted > max_size) {
+        erase(--lru.end());
+        ++evictions;
+    }
+}
+
+
+void ImageCache::erase(lru_t::iterator it)
+{
+    cur_size -= it->size;
+    SDL_FreeSurface(it->surface);
+    entries.erase(it->key);
+    lru.erase(it);
+}
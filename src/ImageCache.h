@@ -0,0 +1,81 @@
+/* -*- C++ -*-
+ *
+ *  ImageCache.h - Cache of decoded images
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __IMAGE_CACHE_H__
+#define __IMAGE_CACHE_H__
+
+#include <SDL.h>
+#include <list>
+#include "defs.h"
+
+#define DEFAULT_IMAGE_CACHE_SIZE (64 * 1024 * 1024)
+
+// Least-recently-used cache of the surfaces produced by
+// PonscripterLabel::loadImage(), so that showing the same background,
+// standing character or cursor again costs no file access or decoding.
+//
+// Surfaces are shared through SDL's own reference count: get() returns
+// a new reference, which the caller releases with SDL_FreeSurface() as
+// it would any other surface.  Cached surfaces must not be modified.
+class ImageCache {
+public:
+    ImageCache(size_t budget = DEFAULT_IMAGE_CACHE_SIZE);
+    ~ImageCache();
+
+    // Maximum number of bytes of pixel data to keep; 0 disables caching.
+    void setBudget(size_t bytes);
+    size_t budget() const { return max_size; }
+
+    static pstring makeKey(const pstring& filename, bool twox,
+                           bool isflipped, bool want_alpha);
+
+    SDL_Surface* get(const pstring& key, bool* has_alpha);
+    bool contains(const pstring& key) const {
+        return entries.find(key) != entries.end();
+    }
+    void add(const pstring& key, SDL_Surface* surface, bool has_alpha);
+
+    // Drop every entry built from the named file (e.g. a screenshot
+    // that has just been overwritten).
+    void invalidate(const pstring& filename);
+    void clear();
+
+    void printStats(FILE* fp) const;
+
+    unsigned long hits, misses, evictions;
+
+private:
+    struct Entry {
+        pstring key;
+        SDL_Surface* surface;
+        bool has_alpha;
+        size_t size;
+    };
+    typedef std::list<Entry> lru_t;
+
+    lru_t lru; // most recently used first
+    dictionary<pstring, lru_t::iterator>::t entries;
+    size_t max_size, cur_size;
+
+    void evict(size_t wanted);
+    void erase(lru_t::iterator it);
+};
+
+#endif // __IMAGE_CACHE_H__
@@ -0,0 +1,105 @@
+/* -*- C++ -*-
+ *
+ *  LineIndex.cpp - Positions of the line breaks in the script
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#include "LineIndex.h"
+#include <string.h>
+
+void LineIndex::clear()
+{
+    blocks.clear();
+    gaps.clear();
+    total = 0;
+}
+
+
+void LineIndex::build(const char* buf, int length)
+{
+    clear();
+
+    const char* end = buf + length;
+    const char* p = buf;
+    int prev = 0;
+    while ((p = (const char*) memchr(p, 0x0a, end - p)) != NULL) {
+        int offset = p++ - buf;
+        if (total % BLOCK_SIZE == 0) {
+            Block b = { offset, (unsigned int) gaps.size() };
+            blocks.push_back(b);
+        }
+        else {
+            // LEB128: seven bits per byte, high bit set on all but
+            // the last.
+            unsigned int gap = offset - prev;
+            while (gap >= 0x80) {
+                gaps.push_back((gap & 0x7f) | 0x80);
+                gap >>= 7;
+            }
+            gaps.push_back(gap);
+        }
+        prev = offset;
+        ++total;
+    }
+    // Keeps &gaps[b.pos] valid for a trailing one-break block.
+    gaps.push_back(0);
+}
+
+
+int LineIndex::readGap(const unsigned char*& p)
+{
+    int gap = 0, shift = 0;
+    while (*p & 0x80) {
+        gap |= (*p++ & 0x7f) << shift;
+        shift += 7;
+    }
+    return gap | (*p++ << shift);
+}
+
+
+int LineIndex::countBefore(int offset) const
+{
+    // Find the last block starting before offset.
+    int lo = 0, hi = blocks.size();
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (blocks[mid].first < offset) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == 0) return 0;
+
+    const Block& b = blocks[lo - 1];
+    int n = (lo - 1) * BLOCK_SIZE + 1;
+    int last = lo * BLOCK_SIZE < total ? lo * BLOCK_SIZE : total;
+    const unsigned char* p = &gaps[b.pos];
+    for (int cur = b.first; n < last; n++) {
+        cur += readGap(p);
+        if (cur >= offset) break;
+    }
+    return n;
+}
+
+
+int LineIndex::offsetOf(int n) const
+{
+    const Block& b = blocks[n / BLOCK_SIZE];
+    const unsigned char* p = &gaps[b.pos];
+    int cur = b.first;
+    for (int i = n % BLOCK_SIZE; i > 0; i--)
+        cur += readGap(p);
+    return cur;
+}
@@ -0,0 +1,62 @@
+/* -*- C++ -*-
+ *
+ *  LineIndex.h - Positions of the line breaks in the script
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __LINE_INDEX_H__
+#define __LINE_INDEX_H__
+
+#include <vector>
+
+// Offsets of every 0x0a in a buffer, for converting between addresses
+// and line numbers without rescanning the text.  Offsets are stored as
+// variable-length gaps in blocks of BLOCK_SIZE, with the absolute
+// offset of the first break of each block kept for binary search; a
+// large script costs a little over one byte per line.
+class LineIndex {
+public:
+    LineIndex() : total(0) {}
+
+    void build(const char* buf, int length);
+    void clear();
+
+    // Number of line breaks.
+    int size() const { return total; }
+
+    // Number of line breaks before offset.
+    int countBefore(int offset) const;
+
+    // Offset of line break n, counting from 0; n must be < size().
+    int offsetOf(int n) const;
+
+private:
+    enum { BLOCK_SIZE = 32 };
+    struct Block {
+        int first;        // offset of the block's first break
+        unsigned int pos; // start of the rest of the block in gaps
+    };
+    std::vector<Block> blocks;
+    std::vector<unsigned char> gaps;
+    int total;
+
+    static int readGap(const unsigned char*& p);
+
+    friend class ScriptCache;
+};
+
+#endif // __LINE_INDEX_H__
@@ -0,0 +1,122 @@
+/* -*- C++ -*-
+ *
+ *  MappedFile.cpp - Read-only memory mapping of an open file
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#include "MappedFile.h"
+#include <string.h>
+
+#ifdef WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+bool MappedFile::map(FILE* fp)
+{
+    unmap();
+    if (!fp) return false;
+
+#ifdef WIN32
+    HANDLE file = (HANDLE) _get_osfhandle(_fileno(fp));
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) return false;
+    size_t len = (size_t) size.QuadPart;
+    if (len == 0 || (LONGLONG) len != size.QuadPart) return false;
+
+    HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) return false;
+
+    void* p = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!p) {
+        CloseHandle(mapping);
+        return false;
+    }
+    handle = mapping;
+    base = (const unsigned char*) p;
+    length = len;
+#else
+    struct stat st;
+    if (fstat(fileno(fp), &st)) return false;
+    size_t len = st.st_size;
+    if (len == 0 || (off_t) len != st.st_size) return false;
+
+    void* p = mmap(NULL, len, PROT_READ, MAP_SHARED, fileno(fp), 0);
+    if (p == MAP_FAILED) return false;
+
+    base = (const unsigned char*) p;
+    length = len;
+#endif
+    return true;
+}
+
+
+size_t MappedFile::readAt(FILE* fp, size_t offset, void* buf, size_t len)
+{
+    size_t done = 0;
+#ifdef WIN32
+    HANDLE file = (HANDLE) _get_osfhandle(_fileno(fp));
+    if (file == INVALID_HANDLE_VALUE) return 0;
+
+    while (done < len) {
+        // An OVERLAPPED offset on a synchronous handle reads there
+        // without regard to (though it does move) the file pointer.
+        OVERLAPPED ov;
+        memset(&ov, 0, sizeof(ov));
+        unsigned long long pos = (unsigned long long) offset + done;
+        ov.Offset = (DWORD) pos;
+        ov.OffsetHigh = (DWORD) (pos >> 32);
+        DWORD n = 0;
+        DWORD want = len - done > 0x40000000 ? 0x40000000 : (DWORD) (len - done);
+        if (!ReadFile(file, (char*) buf + done, want, &n, &ov) || n == 0)
+            break;
+        done += n;
+    }
+#else
+    int fd = fileno(fp);
+    while (done < len) {
+        ssize_t n = pread(fd, (char*) buf + done, len - done, offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += n;
+    }
+#endif
+    return done;
+}
+
+
+void MappedFile::unmap()
+{
+    if (!base) return;
+
+#ifdef WIN32
+    UnmapViewOfFile(base);
+    CloseHandle((HANDLE) handle);
+    handle = NULL;
+#else
+    munmap((void*) base, length);
+#endif
+    base = NULL;
+    length = 0;
+}
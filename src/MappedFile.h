@@ -0,0 +1,61 @@
+/* -*- C++ -*-
+ *
+ *  MappedFile.h - Read-only memory mapping of an open file
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __MAPPED_FILE_H__
+#define __MAPPED_FILE_H__
+
+#include <stdio.h>
+#include <stddef.h>
+
+// Maps the whole of a file that is already open for reading.  Mapping
+// can fail (no support on the platform, or not enough address space
+// for a large archive on a 32-bit system), so callers must keep a
+// stdio path for when data() is NULL.
+class MappedFile {
+public:
+    MappedFile() : base(NULL), length(0), handle(NULL) {}
+    ~MappedFile() { unmap(); }
+
+    bool map(FILE* fp);
+    void unmap();
+
+    const unsigned char* data() const { return base; }
+    size_t size() const { return length; }
+
+    // True if [offset, offset + len) lies inside the mapping.
+    bool contains(size_t offset, size_t len) const {
+        return base && offset <= length && len <= length - offset;
+    }
+
+    // Reads len bytes at offset without moving the file position
+    // (pread), so several threads can read one file at once; returns
+    // the number of bytes read.
+    static size_t readAt(FILE* fp, size_t offset, void* buf, size_t len);
+
+private:
+    const unsigned char* base;
+    size_t length;
+    void* handle; // Windows file mapping object
+
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
+
+#endif // __MAPPED_FILE_H__
@@ -49,6 +49,21 @@ int NsaReader::open(const pstring& nsa_path, int archive_type)
     else
         sar_flag = false;
 
+    // ponspack archives come first: arc.psa, then arc1.psa and on.
+    for (n = 0; n < archive_path->get_num_paths(); n++) {
+        for (j = 0; j <= MAX_EXTRA_ARCHIVE; j++) {
+            if (j == 0) {
+                archive_name = nsa_path + "arc.psa";
+            } else {
+                archive_name2.format("arc%d.psa", j);
+                archive_name = nsa_path + archive_name2;
+            }
+            archive_name2 = archive_path->get_path(n) + archive_name;
+            fp = fopen(archive_name2, "rb");
+            if (fp == NULL || !addPacked(fp, archive_name2)) break;
+        }
+    }
+
     i = j = -1;
     n = 0;
     while ((i<MAX_EXTRA_ARCHIVE) && (n<archive_path->get_num_paths())) {
@@ -66,10 +81,14 @@ int NsaReader::open(const pstring& nsa_path, int archive_type)
                 archive_info.file_handle = fp;
                 archive_info.file_name = archive_name2;
                 readArchive(&archive_info, archive_type);
+                archive_info.map.map(fp);
+                if (!sar_flag) file_index.add(&archive_info);
             } else {
                 archive_info2[i].file_handle = fp;
                 archive_info2[i].file_name = archive_name2;
                 readArchive(&archive_info2[i], archive_type);
+                archive_info2[i].map.map(fp);
+                if (!sar_flag) file_index.add(&archive_info2[i]);
             }
             i++;
             j++;
@@ -79,7 +98,7 @@ int NsaReader::open(const pstring& nsa_path, int archive_type)
         }
     }
 
-    if (i < 0) {
+    if (i < 0 && packed_archives.empty()) {
         // didn't find any (main) archive files
         fprintf(stderr, "can't open archive file %s\n", (const char*) archive_name);
         return -1;
@@ -101,72 +120,42 @@ int NsaReader::getNumFiles()
 }
 
 
-size_t NsaReader::getFileLengthSub(ArchiveInfo* ai, const pstring& file_name)
+// Lookups go through the index SarReader keeps; open() only adds the
+// NSA archives to it when there is no arc.sar, which preserves the old
+// rule that a SAR archive hides any NSA archives alongside it.
+size_t NsaReader::getFile(const pstring& file_name, unsigned char* buffer,
+			  int* location)
 {
-    unsigned int i = getIndexFromFile(ai, file_name);
-
-    if (i == ai->num_of_files) return 0;
+    size_t ret = SarReader::getFile(file_name, buffer, location);
 
-    if ( ai->fi_list[i].original_length != 0 ){
-        return ai->fi_list[i].original_length;
-    }
+    if (!sar_flag && location && *location == ARCHIVE_TYPE_SAR)
+        *location = ARCHIVE_TYPE_NSA;
 
-    int type = ai->fi_list[i].compression_type;
-    if ( type == NO_COMPRESSION )
-        type = getRegisteredCompressionType( file_name );
-    if ( type == NBZ_COMPRESSION || type == SPB_COMPRESSION ) {
-        ai->fi_list[i].original_length = getDecompressedFileLength( type, ai->file_handle, ai->fi_list[i].offset );
-    }
-
-    return ai->fi_list[i].original_length;
+    return ret;
 }
 
 
-size_t NsaReader::getFileLength(const pstring& file_name)
+bool NsaReader::getFileView(const pstring& file_name,
+                            const unsigned char** data, size_t* length,
+                            int* location)
 {
-    if (sar_flag) return SarReader::getFileLength(file_name);
-
-    size_t ret;
-    int i;
+    if (!SarReader::getFileView(file_name, data, length, location))
+        return false;
 
-    if ((ret = DirectReader::getFileLength(file_name))) return ret;
+    if (!sar_flag && location) *location = ARCHIVE_TYPE_NSA;
 
-    if ((ret = getFileLengthSub(&archive_info, file_name))) return ret;
-
-    for (i = 0; i < num_of_nsa_archives; i++) {
-        if ((ret = getFileLengthSub(&archive_info2[i], file_name))) return ret;
-    }
-
-    return 0;
+    return true;
 }
 
 
-size_t NsaReader::getFile(const pstring& file_name, unsigned char* buffer,
-			  int* location)
+SDL_Surface* NsaReader::getImage(const pstring& file_name, int* location)
 {
-    size_t ret;
-
-    if (sar_flag)
-	return SarReader::getFile(file_name, buffer, location);
+    SDL_Surface* image = SarReader::getImage(file_name, location);
 
-    if ((ret = DirectReader::getFile(file_name, buffer, location)))
-	return ret;
-
-    if ((ret = getFileSub(&archive_info, file_name, buffer))) {
-        if (location) *location = ARCHIVE_TYPE_NSA;
-
-        return ret;
-    }
-
-    for (int i = 0; i < num_of_nsa_archives; i++) {
-        if ((ret = getFileSub(&archive_info2[i], file_name, buffer))) {
-            if (location) *location = ARCHIVE_TYPE_NSA;
-
-            return ret;
-        }
-    }
+    if (!sar_flag && location && *location == ARCHIVE_TYPE_SAR)
+        *location = ARCHIVE_TYPE_NSA;
 
-    return 0;
+    return image;
 }
 
 
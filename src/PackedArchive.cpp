@@ -0,0 +1,399 @@
+/* -*- C++ -*-
+ *
+ *  PackedArchive.cpp - Reader for archives in ponspack's indexed format
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#include "PackedArchive.h"
+#include "ArchiveIndex.h"
+#include <string.h>
+#include <bzlib.h>
+
+const char PackedArchive::MAGIC[4] = { 'P', 'S', 'A', 0x1a };
+
+static inline Uint32 get32(const unsigned char* p)
+{
+    Uint32 v;
+    memcpy(&v, p, 4);
+    return SDL_SwapLE32(v);
+}
+
+
+static inline Uint64 get64(const unsigned char* p)
+{
+    Uint64 v;
+    memcpy(&v, p, 8);
+    return SDL_SwapLE64(v);
+}
+
+
+PackedArchive::PackedArchive()
+    : fp(NULL), buckets(NULL), entries(NULL), boundaries(NULL), names(NULL),
+      num_entries(0), num_buckets(0), num_boundaries(0), chunk_size(0),
+      names_length(0)
+{}
+
+
+PackedArchive::~PackedArchive()
+{
+    close();
+}
+
+
+void PackedArchive::close()
+{
+    map.unmap();
+    if (fp) fclose(fp);
+    fp = NULL;
+    directory_copy.clear();
+    num_entries = 0;
+}
+
+
+bool PackedArchive::isPacked(FILE* fp)
+{
+    unsigned char magic[4];
+    return MappedFile::readAt(fp, 0, magic, 4) == 4 &&
+           memcmp(magic, MAGIC, 4) == 0;
+}
+
+
+bool PackedArchive::open(const pstring& path)
+{
+    FILE* fp = fopen(path, "rb");
+    return fp && open(fp, path);
+}
+
+
+bool PackedArchive::open(FILE* file, const pstring& path)
+{
+    close();
+    fp = file;
+    file_name = path;
+
+    unsigned char header[HEADER_SIZE];
+    if (MappedFile::readAt(fp, 0, header, HEADER_SIZE) != HEADER_SIZE ||
+        memcmp(header, MAGIC, 4) != 0 || get32(header + 4) != VERSION) {
+        fprintf(stderr, "%s is not a packed archive this version can read\n",
+                (const char*) path);
+        close();
+        return false;
+    }
+    num_entries    = get32(header + 8);
+    num_buckets    = get32(header + 12);
+    chunk_size     = get32(header + 16);
+    num_boundaries = get32(header + 20);
+    size_t directory_length = get32(header + 24);
+
+    map.map(fp);
+    const unsigned char* directory;
+    if (map.contains(HEADER_SIZE, directory_length)) {
+        directory = map.data() + HEADER_SIZE;
+    }
+    else {
+        directory_copy.resize(directory_length + 1);
+        if (MappedFile::readAt(fp, HEADER_SIZE, &directory_copy[0],
+                               directory_length) != directory_length) {
+            fprintf(stderr, "%s is truncated\n", (const char*) path);
+            close();
+            return false;
+        }
+        directory = &directory_copy[0];
+    }
+
+    // Sizes are checked in 64 bits so that no count can wrap them.
+    Uint64 fixed = (Uint64) 4 * (num_buckets + 1) +
+                   (Uint64) ENTRY_SIZE * num_entries +
+                   (Uint64) 8 * num_boundaries;
+    if (checksum(directory, directory_length) != get32(header + 28) ||
+        fixed > directory_length || num_buckets == 0 ||
+        (num_buckets & (num_buckets - 1)) != 0 || chunk_size == 0) {
+        fprintf(stderr, "%s has a damaged directory\n", (const char*) path);
+        close();
+        return false;
+    }
+    buckets      = directory;
+    entries      = buckets + 4 * (num_buckets + 1);
+    boundaries   = entries + (size_t) ENTRY_SIZE * num_entries;
+    names        = boundaries + (size_t) 8 * num_boundaries;
+    names_length = directory_length - (size_t) fixed;
+
+    size_t file_length = map.size();
+    if (!map.data()) {
+        fseek(fp, 0, SEEK_END);
+        file_length = ftell(fp);
+    }
+    if (!check(file_length)) {
+        fprintf(stderr, "%s has a damaged directory\n", (const char*) path);
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+
+// Everything later reads take on trust: bucket bounds, names, where
+// the data lies and chunk boundaries.
+bool PackedArchive::check(size_t file_length) const
+{
+    for (unsigned int b = 0; b < num_buckets; b++)
+        if (get32(buckets + 4 * b) > get32(buckets + 4 * (b + 1)))
+            return false;
+    if (get32(buckets + 4 * num_buckets) != num_entries) return false;
+
+    for (unsigned int i = 0; i < num_entries; i++) {
+        const unsigned char* e = entry(i);
+        Uint64 name_offset = get32(e + 4), name_length = get32(e + 8);
+        Uint64 offset = get64(e + 16), length = get64(e + 24);
+        Uint64 original = get64(e + 32);
+        if (name_offset + name_length > names_length ||
+            offset > file_length || length > file_length - offset)
+            return false;
+
+        switch (get32(e + 12)) {
+        case STORED:
+            if (original != length) return false;
+            break;
+        case SPB:
+            break;
+        case CHUNKED: {
+            Uint64 chunks = (original + chunk_size - 1) / chunk_size;
+            Uint64 first = get32(e + 44);
+            if (first + chunks + 1 > num_boundaries) return false;
+            for (Uint64 k = 0; k < chunks; k++)
+                if (get64(boundaries + 8 * (first + k)) >=
+                    get64(boundaries + 8 * (first + k + 1)))
+                    return false;
+            if (get64(boundaries + 8 * (first + chunks)) > length)
+                return false;
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+bool PackedArchive::find(const pstring& key, unsigned int& index) const
+{
+    if (!num_entries) return false;
+
+    Uint32 h = ArchiveIndex::hash(key);
+    const unsigned char* b = buckets + 4 * (h & (num_buckets - 1));
+    for (unsigned int i = get32(b), end = get32(b + 4); i < end; i++) {
+        const unsigned char* e = entry(i);
+        Uint32 eh = get32(e);
+        if (eh > h) break;
+        if (eh == h && get32(e + 8) == (Uint32) key.length() &&
+            memcmp(names + get32(e + 4), (const char*) key,
+                   key.length()) == 0) {
+            index = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+pstring PackedArchive::name(unsigned int index) const
+{
+    const unsigned char* e = entry(index);
+    return pstring((const char*) names + get32(e + 4), get32(e + 8));
+}
+
+
+int PackedArchive::type(unsigned int index) const
+{
+    return get32(entry(index) + 12);
+}
+
+
+size_t PackedArchive::offset(unsigned int index) const
+{
+    return get64(entry(index) + 16);
+}
+
+
+size_t PackedArchive::storedLength(unsigned int index) const
+{
+    return get64(entry(index) + 24);
+}
+
+
+size_t PackedArchive::length(unsigned int index) const
+{
+    return get64(entry(index) + 32);
+}
+
+
+// Stored bytes at offset, from the mapping or else read into buf;
+// NULL if they can't be read.
+const unsigned char* PackedArchive::storedData(size_t offset, size_t len,
+                                std::vector<unsigned char>& buf) const
+{
+    if (map.contains(offset, len)) return map.data() + offset;
+
+    buf.resize(len + 1);
+    if (MappedFile::readAt(fp, offset, &buf[0], len) != len) return NULL;
+    return &buf[0];
+}
+
+
+bool PackedArchive::verify(unsigned int index) const
+{
+    const unsigned char* e = entry(index);
+    std::vector<unsigned char> buf;
+    const unsigned char* data = storedData(get64(e + 16), get64(e + 24), buf);
+    if (data && checksum(data, get64(e + 24)) == get32(e + 40)) return true;
+
+    fprintf(stderr, "checksum error in %s of %s\n",
+            (const char*) name(index), (const char*) file_name);
+    return false;
+}
+
+
+size_t PackedArchive::read(unsigned int index, unsigned char* buf) const
+{
+    const unsigned char* e = entry(index);
+    if (get32(e + 12) == CHUNKED)
+        return readChunks(index, 0, get64(e + 32), buf, true);
+
+    size_t offset = get64(e + 16), len = get64(e + 24);
+    if (map.contains(offset, len))
+        memcpy(buf, map.data() + offset, len);
+    else if (MappedFile::readAt(fp, offset, buf, len) != len)
+        return 0;
+
+    if (checksum(buf, len) != get32(e + 40)) {
+        fprintf(stderr, "checksum error in %s of %s\n",
+                (const char*) name(index), (const char*) file_name);
+        return 0;
+    }
+    return len;
+}
+
+
+size_t PackedArchive::readRange(unsigned int index, size_t start,
+                                size_t len, unsigned char* buf) const
+{
+    const unsigned char* e = entry(index);
+    size_t total = get64(e + 32);
+    if (start >= total) return 0;
+    if (len > total - start) len = total - start;
+    if (len == 0) return 0;
+
+    if (get32(e + 12) == CHUNKED)
+        return readChunks(index, start, len, buf, false);
+
+    size_t offset = get64(e + 16) + start;
+    if (map.contains(offset, len)) {
+        memcpy(buf, map.data() + offset, len);
+        return len;
+    }
+    return MappedFile::readAt(fp, offset, buf, len);
+}
+
+
+bool PackedArchive::view(unsigned int index, const unsigned char** data,
+                         size_t* len) const
+{
+    const unsigned char* e = entry(index);
+    size_t offset = get64(e + 16), length = get64(e + 24);
+    if (get32(e + 12) != STORED || !map.contains(offset, length))
+        return false;
+
+    *data = map.data() + offset;
+    *len = length;
+    return true;
+}
+
+
+// Decodes the chunks covering [start, start + len) into buf; with
+// verify, which needs every chunk, the checksum is checked on the way.
+size_t PackedArchive::readChunks(unsigned int index, size_t start,
+                                 size_t len, unsigned char* buf,
+                                 bool verify) const
+{
+    const unsigned char* e = entry(index);
+    size_t base = get64(e + 16), total = get64(e + 32);
+    const unsigned char* bound = boundaries + 8 * (size_t) get32(e + 44);
+    if (len == 0) return 0;
+
+    std::vector<unsigned char> in, partial;
+    Uint32 sum = 1;
+    size_t done = 0;
+    for (size_t k = start / chunk_size; done < len; k++) {
+        size_t from = get64(bound + 8 * k), to = get64(bound + 8 * (k + 1));
+        const unsigned char* src = storedData(base + from, to - from, in);
+        if (!src) return 0;
+        if (verify) sum = checksum(src, to - from, sum);
+
+        // Whole chunks go straight to buf, others through partial.
+        size_t chunk_start = k * chunk_size;
+        unsigned int chunk_len = chunk_size;
+        if (chunk_len > total - chunk_start) chunk_len = total - chunk_start;
+        size_t skip = start > chunk_start ? start - chunk_start : 0;
+        size_t want = chunk_len - skip;
+        if (want > len - done) want = len - done;
+
+        unsigned char* dst = buf + done;
+        if (want < chunk_len) {
+            partial.resize(chunk_size);
+            dst = &partial[0];
+        }
+        unsigned int dst_len = chunk_len;
+        if (BZ2_bzBuffToBuffDecompress((char*) dst, &dst_len,
+                                       (char*) src, to - from, 0, 0) != BZ_OK ||
+            dst_len != chunk_len) {
+            fprintf(stderr, "can't decode %s of %s\n",
+                    (const char*) name(index), (const char*) file_name);
+            return 0;
+        }
+        if (dst != buf + done) memcpy(buf + done, dst + skip, want);
+        done += want;
+    }
+
+    if (verify && sum != get32(e + 40)) {
+        fprintf(stderr, "checksum error in %s of %s\n",
+                (const char*) name(index), (const char*) file_name);
+        return 0;
+    }
+    return done;
+}
+
+
+// Adler-32, reducing the sums in runs short enough not to overflow.
+Uint32 PackedArchive::checksum(const unsigned char* data, size_t len,
+                               Uint32 sum)
+{
+    Uint32 a = sum & 0xffff, b = sum >> 16;
+    while (len > 0) {
+        size_t n = len < 5552 ? len : 5552;
+        len -= n;
+        while (n--) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return b << 16 | a;
+}
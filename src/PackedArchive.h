@@ -0,0 +1,139 @@
+/* -*- C++ -*-
+ *
+ *  PackedArchive.h - Reader for archives in ponspack's indexed format
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __PACKED_ARCHIVE_H__
+#define __PACKED_ARCHIVE_H__
+
+#include <SDL.h>
+#include <vector>
+#include "defs.h"
+#include "MappedFile.h"
+
+// An archive written by ponspack from NSA/SAR archives.  The directory
+// is a single block that is mapped or read whole on opening, already
+// sorted into hash buckets, so nothing is parsed or indexed entry by
+// entry.  Entries of a page or more start on page boundaries, so
+// stored ones map well, and compressed entries are split into bzip2
+// chunks that decode independently, so part of a file can be read
+// without decoding the rest.
+//
+// Layout; all integers are little-endian.
+//
+//   header     "PSA\x1a", u32 version, u32 entries, u32 buckets (a
+//              power of two), u32 chunk size, u32 chunk boundaries,
+//              u32 directory length, u32 directory checksum
+//   directory  u32 first entry of each bucket, then the entry count
+//              entries of 48 bytes: u32 hash, u32 name offset, u32
+//              name length, u32 type, u64 offset, u64 length, u64
+//              original length, u32 checksum, u32 first boundary
+//              u64 chunk boundaries
+//              names
+//   data       from a multiple of PAGE_SIZE; entries of PAGE_SIZE
+//              bytes or more start at multiples of it
+//
+// Names are stored as ArchiveIndex::normalize() leaves them and hashed
+// with ArchiveIndex::hash(); a name's bucket is the low bits of its
+// hash, and entries are sorted by bucket, hash and name.  Chunk k of a
+// CHUNKED entry is bytes boundary[first + k] to boundary[first + k + 1]
+// of its data and decodes to CHUNK_SIZE bytes, less for the last.
+// Checksums are Adler-32 of the data as stored.
+//
+// Once opened, any number of threads may read at once.
+class PackedArchive {
+public:
+    enum { STORED = 0, SPB = 1, CHUNKED = 2 };
+    enum {
+        VERSION     = 1,
+        HEADER_SIZE = 32,
+        ENTRY_SIZE  = 48,
+        PAGE_SIZE   = 4096
+    };
+    static const char MAGIC[4];
+
+    PackedArchive();
+    ~PackedArchive();
+
+    // False, with a message unless the file is missing, if path is
+    // not an archive of this kind.
+    bool open(const pstring& path);
+    // The same for a file already open, which is closed on failure.
+    bool open(FILE* fp, const pstring& name);
+
+    // True if the file starts with MAGIC.
+    static bool isPacked(FILE* fp);
+    const pstring& fileName() const { return file_name; }
+    FILE* file() const { return fp; }
+    const MappedFile& mapping() const { return map; }
+
+    unsigned int numEntries() const { return num_entries; }
+
+    // Looks up a key made by ArchiveIndex::normalize().
+    bool find(const pstring& key, unsigned int& index) const;
+
+    pstring name(unsigned int index) const;
+    int type(unsigned int index) const;
+    size_t offset(unsigned int index) const;
+    size_t storedLength(unsigned int index) const;
+    size_t length(unsigned int index) const;
+
+    // Checks the entry's checksum.
+    bool verify(unsigned int index) const;
+
+    // The whole entry, decoded if it is CHUNKED, after checking its
+    // checksum; returns 0 on failure.  SPB entries come as stored.
+    size_t read(unsigned int index, unsigned char* buf) const;
+
+    // Up to len bytes from start, decoding only the chunks needed.
+    // The checksum is not checked.
+    size_t readRange(unsigned int index, size_t start, size_t len,
+                     unsigned char* buf) const;
+
+    // Points data at a STORED entry in the mapping, if there is one.
+    bool view(unsigned int index, const unsigned char** data,
+              size_t* len) const;
+
+    static Uint32 checksum(const unsigned char* data, size_t len,
+                           Uint32 sum = 1);
+
+private:
+    FILE* fp;
+    MappedFile map;
+    pstring file_name;
+
+    std::vector<unsigned char> directory_copy; // when not mapped
+    const unsigned char* buckets, * entries, * boundaries, * names;
+    unsigned int num_entries, num_buckets, num_boundaries, chunk_size;
+    size_t names_length;
+
+    const unsigned char* entry(unsigned int index) const {
+        return entries + (size_t) index * ENTRY_SIZE;
+    }
+    bool check(size_t file_length) const;
+    const unsigned char* storedData(size_t offset, size_t len,
+                                    std::vector<unsigned char>& buf) const;
+    size_t readChunks(unsigned int index, size_t start, size_t len,
+                      unsigned char* buf, bool verify) const;
+    void close();
+
+    PackedArchive(const PackedArchive&);
+    PackedArchive& operator=(const PackedArchive&);
+};
+
+#endif // __PACKED_ARCHIVE_H__
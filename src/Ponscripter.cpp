@@ -73,6 +73,22 @@ static void optionHelp()
            "acceleration routines\n");
 #endif
     printf("      --record-render-time\tRecord render times to the given csv file\n");
+    printf("      --image-cache-size MB\tkeep up to MB megabytes of decoded "
+           "images in memory (default %d, 0 to disable)\n",
+           DEFAULT_IMAGE_CACHE_SIZE / (1024 * 1024));
+    printf("      --sound-cache-size MB\tkeep up to MB megabytes of decoded "
+           "sound effects in memory (default %d, 0 to disable)\n",
+           DEFAULT_SOUND_CACHE_SIZE / (1024 * 1024));
+    printf("      --render-threads N\tcomposite the screen on N threads "
+           "(default 1, 0 for one per CPU)\n");
+    printf("      --prefetch N\tload images and sounds used in the next N "
+           "lines of script in the background (default 0, off)\n");
+    printf("      --prefetch-size MB\thold up to MB megabytes of prefetched "
+           "data (default %d)\n", DEFAULT_PREFETCH_SIZE / (1024 * 1024));
+    printf("      --profile FILE\twrite a Chrome trace of the main stages to "
+           "FILE and print a timing summary every few seconds\n");
+    printf("      --script-cache FILE\tkeep the processed script in FILE so "
+           "later runs start faster\n");
     printf("      --enable-wheeldown-advance\tadvance the text on mouse "
            "wheeldown event\n");
 //    printf("      --nsa-offset offset\tuse byte offset x when reading "
@@ -195,6 +211,41 @@ static void parseOptions(int argc, char **argv, PonscripterLabel &ons,
                 argv++;
                 ons.recordRenderTimes(argv[0]);
             }
+            else if (!strcmp(argv[0] + 1, "-image-cache-size")) {
+                argc--;
+                argv++;
+                ons.setImageCacheSize(argv[0]);
+            }
+            else if (!strcmp(argv[0] + 1, "-sound-cache-size")) {
+                argc--;
+                argv++;
+                ons.setSoundCacheSize(argv[0]);
+            }
+            else if (!strcmp(argv[0] + 1, "-render-threads")) {
+                argc--;
+                argv++;
+                ons.setRenderThreads(argv[0]);
+            }
+            else if (!strcmp(argv[0] + 1, "-prefetch")) {
+                argc--;
+                argv++;
+                ons.setPrefetchLines(argv[0]);
+            }
+            else if (!strcmp(argv[0] + 1, "-prefetch-size")) {
+                argc--;
+                argv++;
+                ons.setPrefetchSize(argv[0]);
+            }
+            else if (!strcmp(argv[0] + 1, "-profile")) {
+                argc--;
+                argv++;
+                ons.setProfile(argv[0]);
+            }
+            else if (!strcmp(argv[0] + 1, "-script-cache")) {
+                argc--;
+                argv++;
+                ons.setScriptCache(argv[0]);
+            }
             else if (!strcmp(argv[0] + 1, "-disable-rescale")) {
                 ons.disableRescale();
             }
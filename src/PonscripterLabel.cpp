@@ -93,6 +93,9 @@ typedef int (PonscripterLabel::*PonscrFun)(const pstring&);
 static class sfunc_lut_t {
     typedef dictionary<pstring, PonscrFun>::t dic_t;
     dic_t dict;
+    // Indexed by ScriptHandler::getCommandId().
+    std::vector<PonscrFun> by_id;
+    std::vector<bool> resolved;
 public:
     sfunc_lut_t();
     PonscrFun get(pstring what) const {
@@ -100,6 +103,18 @@ public:
         if (it == dict.end()) return 0;
         return it->second;
     }
+    PonscrFun get(int id, const pstring& what) {
+        if (id < 0) return get(what);
+        if (id >= (int) by_id.size()) {
+            by_id.resize(id + 1, 0);
+            resolved.resize(id + 1, false);
+        }
+        if (!resolved[id]) {
+            by_id[id] = get(what);
+            resolved[id] = true;
+        }
+        return by_id[id];
+    }
 } func_lut;
 sfunc_lut_t::sfunc_lut_t() {
     dict["abssetcursor"]     = &PonscripterLabel::setcursorCommand;
@@ -606,12 +621,16 @@ PonscripterLabel::PonscripterLabel()
       midi_cmd(getenv("MUSIC_CMD"))
 {
     AnimationInfo::gfx = AcceleratedGraphicsFunctions::accelerated();
+    AnimationInfo::compositor = &compositor;
+    AnimationInfo::pending_loader = pendingImageLoader;
+    AnimationInfo::pending_loader_data = this;
 
     renderTimesFile      = NULL;
     disable_rescale_flag = false;
     edit_flag            = false;
     fullscreen_mode      = false;
     minimized_flag       = false;
+    present_pending_flag = true;
     fullscreen_flags     = SDL_WINDOW_FULLSCREEN_DESKTOP;
     window_mode          = false;
 #ifdef WIN32
@@ -621,6 +640,7 @@ PonscripterLabel::PonscripterLabel()
     skip_to_wait         = 0;
     sprite_info          = new AnimationInfo[MAX_SPRITE_NUM];
     sprite2_info         = new AnimationInfo[MAX_SPRITE2_NUM];
+    sprite_layers_generation = AnimationInfo::generation - 1;
     enable_wheeldown_advance_flag = false;
 
     for (int i = 0; i < MAX_SPRITE2_NUM; ++i)
@@ -631,6 +651,7 @@ PonscripterLabel::PonscripterLabel()
 
 PonscripterLabel::~PonscripterLabel()
 {
+    AnimationInfo::pending_loader = NULL;
     reset();
     delete[] sprite_info;
     delete[] sprite2_info;
@@ -733,6 +754,48 @@ void PonscripterLabel::recordRenderTimes(const char* file) {
 }
 
 
+void PonscripterLabel::setImageCacheSize(const char* megabytes)
+{
+    image_cache.setBudget((size_t) atoi(megabytes) * 1024 * 1024);
+}
+
+
+void PonscripterLabel::setSoundCacheSize(const char* megabytes)
+{
+    sound_cache.setBudget((size_t) atoi(megabytes) * 1024 * 1024);
+}
+
+
+void PonscripterLabel::setRenderThreads(const char* threads)
+{
+    compositor.setThreads(atoi(threads));
+}
+
+
+void PonscripterLabel::setPrefetchLines(const char* lines)
+{
+    prefetcher.setLines(atoi(lines));
+}
+
+
+void PonscripterLabel::setPrefetchSize(const char* megabytes)
+{
+    prefetcher.setBudget((size_t) atoi(megabytes) * 1024 * 1024);
+}
+
+
+void PonscripterLabel::setProfile(const char* trace_file)
+{
+    Profiler::start(trace_file);
+}
+
+
+void PonscripterLabel::setScriptCache(const char* cache_file)
+{
+    script_h.setScriptCache(cache_file);
+}
+
+
 void PonscripterLabel::disableRescale()
 {
     disable_rescale_flag = true;
@@ -1258,6 +1321,7 @@ int PonscripterLabel::init(const char* preferred_script)
     midi_file_name.trunc(0);
     midi_info  = 0;
     mp3_sample = 0;
+    mp3_src = 0;
     music_file_name.trunc(0);
     music_buffer = 0;
     music_buffer_length = 0;
@@ -1298,6 +1362,10 @@ int PonscripterLabel::init(const char* preferred_script)
 
 void PonscripterLabel::reset()
 {
+    // The define section may be about to replace the archive reader.
+    prefetcher.clear();
+    sound_cache.clear();
+
     automode_flag  = false;
     automode_time  = 3000;
     autoclick_time = 0;
@@ -1443,6 +1511,13 @@ void PonscripterLabel::resetSentenceFont()
 }
 
 void PonscripterLabel::rerender() {
+  // Idle screens get nothing new between refreshes; don't copy the
+  // whole texture and wait for vsync just to show the same frame.
+  if (!present_pending_flag) return;
+  present_pending_flag = false;
+
+  Profiler::Scope scope(Profiler::FRAME);
+  Profiler::frame();
   SDL_RenderClear(renderer);
   SDL_RenderCopy(renderer, screen_tex, NULL, NULL);
   SDL_RenderPresent(renderer);
@@ -1463,11 +1538,12 @@ void PonscripterLabel::flush(int refresh_mode, SDL_Rect* rect, bool clear_dirty_
                 flushDirect(dirty_rect.bounding_box, refresh_mode);
             }
             else {
+                // Upload each rect by itself: two small changes in
+                // opposite corners would otherwise send the whole
+                // screen.
                 for (int i = 0; i < dirty_rect.num_history; i++) {
-                    flushDirect(dirty_rect.history[i], refresh_mode, false);
+                    flushDirect(dirty_rect.history[i], refresh_mode);
                 }
-
-                flushDirect(dirty_rect.bounding_box, REFRESH_NONE_MODE);
             }
         }
     }
@@ -1482,19 +1558,30 @@ void PonscripterLabel::flushDirect(SDL_Rect &rect, int refresh_mode, bool update
 
     if(!updaterect) return;
 
-    SDL_Rect r = rect;
-    if (r.w > accumulation_surface->w) r.w = accumulation_surface->w;
-    if (r.h > accumulation_surface->h) r.h = accumulation_surface->h;
+    updateScreenTexture(&rect);
+}
+
+
+// Copy part of accumulation_surface (all of it if rect is NULL) to
+// the screen texture.
+void PonscripterLabel::updateScreenTexture(const SDL_Rect* rect)
+{
+    SDL_Rect r = { 0, 0, accumulation_surface->w, accumulation_surface->h };
+    if (rect && !SDL_IntersectRect(rect, &r, &r)) return;
     char* px = (char *)accumulation_surface->pixels + accumulation_surface->pitch * r.y;
     px += accumulation_surface->format->BytesPerPixel * r.x;
     Uint64 begin = renderTimesFile ? SDL_GetPerformanceCounter() : 0;
-    if(SDL_UpdateTexture(screen_tex, &r, px, accumulation_surface->pitch)) {
-        fprintf(stderr,"Error updating texture: %s\n", SDL_GetError());
+    {
+        Profiler::Scope scope(Profiler::TEXTURE_UPLOAD);
+        if(SDL_UpdateTexture(screen_tex, &r, px, accumulation_surface->pitch)) {
+            fprintf(stderr,"Error updating texture: %s\n", SDL_GetError());
+        }
     }
     if (renderTimesFile) {
         float msElapsed = (SDL_GetPerformanceCounter() - begin) * perfMultiplier;
         fprintf(renderTimesFile, "%llu,UpdateTexture,%f\n", frameNo, msElapsed);
     }
+    present_pending_flag = true;
 }
 
 
@@ -1677,9 +1764,18 @@ void PonscripterLabel::executeLabel()
             && !script_h.isKidoku())
             setSkipMode(false);
 
+        if (current_mode == NORMAL_MODE)
+            prefetcher.scan(script_h.getAddress(0),
+                            script_h.getScriptBufferLength(),
+                            script_h.getOffset(script_h.getNext()));
+
         const char* current = script_h.getCurrent();
-        int ret = ScriptParser::parseLine();
-        if (ret == RET_NOMATCH) ret = this->parseLine();
+        int ret;
+        {
+            Profiler::Scope scope(Profiler::SCRIPT);
+            ret = ScriptParser::parseLine();
+            if (ret == RET_NOMATCH) ret = this->parseLine();
+        }
 
         if (ret & RET_SKIP_LINE) {
             script_h.skipLine();
@@ -1794,7 +1890,7 @@ int PonscripterLabel::parseLine()
                  cmd[2] <= '9')
             return dvCommand(cmd);
 
-        PonscrFun f = func_lut.get(cmd);
+        PonscrFun f = func_lut.get(script_h.getCommandId(), cmd);
         if (f) {
             if (is_orig_cmd && (debug_level > 0)) {
                 printf("** executing builtin command '%s' **\n",
@@ -2027,7 +2123,10 @@ void PonscripterLabel::shadowTextDisplay(SDL_Surface* surface, SDL_Rect &clip)
         if (rect.x + rect.w > surface->w) rect.w = surface->w - rect.x;
         if (rect.y + rect.h > surface->h) rect.h = surface->h - rect.y;
 
-        SDL_LockSurface(surface);
+        {
+            Compositor::Guard guard;
+            SDL_LockSurface(surface);
+        }
         ONSBuf* buf = (ONSBuf*) surface->pixels + rect.y * surface->w + rect.x;
 
         SDL_PixelFormat* fmt = surface->format;
@@ -2046,6 +2145,7 @@ void PonscripterLabel::shadowTextDisplay(SDL_Surface* surface, SDL_Rect &clip)
             }
             buf += surface->w - rect.w;
         }
+        Compositor::Guard guard;
         SDL_UnlockSurface(surface);
     }
     else if (sentence_font_info.image_surface) {
@@ -2274,31 +2374,25 @@ void PonscripterLabel::loadEnvData()
 void PonscripterLabel::saveEnvData()
 {
     file_io_buf_ptr = 0;
-    bool output_flag = false;
-    for (int i = 0; i < 2; i++) {
-        writeInt(fullscreen_mode ? 1 : 0, output_flag);
-        writeInt(volume_on_flag ? 1 : 0, output_flag);
-        writeInt(text_speed_no, output_flag);
-        writeInt(draw_one_page_flag ? 1 : 0, output_flag);
-        writeStr(default_env_font, output_flag);
-        writeInt(0, output_flag); // old cdrom drive enable
-        writeStr("", output_flag); // old cdrom drive name
-        writeInt(DEFAULT_VOLUME - voice_volume, output_flag);
-        writeInt(DEFAULT_VOLUME - se_volume, output_flag);
-        writeInt(DEFAULT_VOLUME - music_volume, output_flag);
-        writeInt(kidokumode_flag ? 1 : 0, output_flag);
-        writeInt(0, output_flag); //bgmdownmode
-        writeStr(savedir, output_flag);
-        writeInt(1000, output_flag); //automode_time
-
-        // Ponscripter extras
-        writeInt(0x534e4f50, output_flag);
-        writeInt(fullscreen_flags, output_flag);
-
-        if (i == 1) break;
-        allocFileIOBuf();
-        output_flag = true;
-    }
+    bool output_flag = true;
+    writeInt(fullscreen_mode ? 1 : 0, output_flag);
+    writeInt(volume_on_flag ? 1 : 0, output_flag);
+    writeInt(text_speed_no, output_flag);
+    writeInt(draw_one_page_flag ? 1 : 0, output_flag);
+    writeStr(default_env_font, output_flag);
+    writeInt(0, output_flag); // old cdrom drive enable
+    writeStr("", output_flag); // old cdrom drive name
+    writeInt(DEFAULT_VOLUME - voice_volume, output_flag);
+    writeInt(DEFAULT_VOLUME - se_volume, output_flag);
+    writeInt(DEFAULT_VOLUME - music_volume, output_flag);
+    writeInt(kidokumode_flag ? 1 : 0, output_flag);
+    writeInt(0, output_flag); //bgmdownmode
+    writeStr(savedir, output_flag);
+    writeInt(1000, output_flag); //automode_time
+
+    // Ponscripter extras
+    writeInt(0x534e4f50, output_flag);
+    writeInt(fullscreen_flags, output_flag);
 
     saveFileIOBuf("envdata");
 }
@@ -2315,6 +2409,12 @@ void PonscripterLabel::quit()
 {
     saveAll();
 
+    if (debug_level > 0) {
+        image_cache.printStats(stdout);
+        sound_cache.printStats(stdout);
+    }
+    Profiler::stop();
+
     if (midi_info) {
         Mix_HaltMusic();
         Mix_FreeMusic(midi_info);
@@ -29,6 +29,12 @@
 #include "DirPaths.h"
 #include "ScriptParser.h"
 #include "DirtyRect.h"
+#include "ImageCache.h"
+#include "Compositor.h"
+#include "Prefetcher.h"
+#include "SoundCache.h"
+#include "Profiler.h"
+#include "SaveBlock.h"
 #include <SDL.h>
 #include <SDL_image.h>
 #include <SDL_mixer.h>
@@ -124,6 +130,13 @@ public:
     void setKeyEXE(const char* path);
     void setGameIdentifier(const char *gameid);
     void setMaskType(int mask_type) { png_mask_type = mask_type; }
+    void setImageCacheSize(const char* megabytes);
+    void setSoundCacheSize(const char* megabytes);
+    void setRenderThreads(const char* threads);
+    void setPrefetchLines(const char* lines);
+    void setPrefetchSize(const char* megabytes);
+    void setProfile(const char* trace_file);
+    void setScriptCache(const char* cache_file);
 
     pstring getSavePath(pstring gameid, const pstring& local_savedir);
 
@@ -505,6 +518,9 @@ public:
     SDL_Window *screen;
     SDL_Renderer *renderer;
     SDL_Texture *screen_tex;
+    // Set when screen_tex or the window needs to be presented again;
+    // rerender() does nothing until then.
+    bool present_pending_flag;
 private:
     SDL_Surface* effect_dst_surface; // Intermediate source buffer for effect
     SDL_Surface* effect_src_surface; // Intermediate dest buffer for effect
@@ -619,6 +635,9 @@ private:
 	   PNG_MASK_USE_NSCRIPTER = 2
     };
     int png_mask_type;
+    ImageCache image_cache;
+    Compositor compositor;
+    Prefetcher prefetcher;
 
     /* ---------------------------------------- */
     /* Background related variables */
@@ -637,6 +656,13 @@ private:
     bool all_sprite_hide_flag;
     bool all_sprite2_hide_flag;
 
+    // Numbers of the sprites that have an image and are showing,
+    // highest first, so that refreshSurface() doesn't have to visit
+    // every slot.  Rebuilt whenever AnimationInfo::generation moves.
+    std::vector<int> sprite_layers, sprite2_layers;
+    unsigned int sprite_layers_generation;
+    void updateSpriteLayers();
+
     /* ---------------------------------------- */
     /* Parameter related variables */
     AnimationInfo* bar_info[MAX_PARAM_NUM];
@@ -823,6 +849,7 @@ private:
     unsigned char *music_buffer; // for looped music
     long music_buffer_length;
     SMPEG*  mp3_sample;
+    SDL_RWops* mp3_src; // what mp3_sample reads
     Uint32  mp3fadeout_start;
     Uint32  mp3fadeout_duration;
     Mix_Music* music_info;
@@ -830,6 +857,7 @@ private:
 
     int channelvolumes[ONS_MIX_CHANNELS]; //insani's addition
     Mix_Chunk *wave_sample[ONS_MIX_CHANNELS+ONS_MIX_EXTRA_CHANNELS];
+    SoundCache sound_cache;
 
     pstring music_cmd;
     pstring midi_cmd;
@@ -839,8 +867,8 @@ private:
 
     int playWave(Mix_Chunk* chunk, int format, bool loop_flag, int channel);
     int playMP3();
-    int playOGG(int format, unsigned char* buffer, long length, bool loop_flag,
-                int channel);
+    int playOGG(const pstring& filename, int format, SDL_RWops* src,
+                bool loop_flag, int channel);
     int playExternalMusic(bool loop_flag);
     int playMIDI(bool loop_flag);
     // Mion: for music status and fades
@@ -859,10 +887,14 @@ private:
     void stopBGM(bool continue_flag);
     void stopAllDWAVE();
     void playClickVoice();
+    bool soundCacheable(int format, int channel);
+    void preloadSoundEffects();
+    Mix_Chunk* loadSoundChunk(const pstring& filename);
+    Mix_Chunk* decodeOggChunk(OVInfo* ovi, int channels, int rate);
     void setupWaveHeader(unsigned char* buffer, int channels, int rate,
                          int bits, unsigned long data_length);
-    OVInfo* openOggVorbis(unsigned char* buf, long len, int &channels,
-                          int &rate);
+    // Takes src over if it succeeds.
+    OVInfo* openOggVorbis(SDL_RWops* src, int &channels, int &rate);
     int  closeOggVorbis(OVInfo* ovi);
 
     /* ---------------------------------------- */
@@ -879,6 +911,7 @@ private:
     void flush(int refresh_mode, SDL_Rect* rect = 0,
                bool clear_dirty_flag = true, bool direct_flag = false);
     void flushDirect(SDL_Rect &rect, int refresh_mode, bool updaterect = true);
+    void updateScreenTexture(const SDL_Rect* rect);
 
     void executeLabel();
     int parseLine();
@@ -894,6 +927,9 @@ private:
     int  estimateNextDuration(AnimationInfo* anim, SDL_Rect &rect, int minimum);
     void resetRemainingTime(int t);
     void setupAnimationInfo(AnimationInfo* anim, Fontinfo* info = NULL);
+    void setupAnimationInfos(const std::vector<AnimationInfo*>& anims);
+    void loadPendingImage(AnimationInfo& anim);
+    static void pendingImageLoader(void* data, AnimationInfo* anim);
     void parseTaggedString(AnimationInfo *anim, bool is_mask=false);
     void drawTaggedSurface(SDL_Surface* dst_surface, AnimationInfo* anim,
                            SDL_Rect &clip);
@@ -911,6 +947,10 @@ private:
     int  loadSaveFile2(SaveFileType file_type, int file_version);
     void saveSaveFile2(bool output_flag);
 
+    // The sprite, sprite2 and variable sections of the last savepoint,
+    // copied into the next one if nothing in them has changed.
+    SaveBlock sprite_save_block, sprite2_save_block, variable_save_block;
+
     /* ---------------------------------------- */
     /* Image processing */
     SDL_Surface* loadImage(const pstring& file_name, bool* has_alpha = NULL, bool twox = false, bool isflipped = false);
@@ -922,6 +962,7 @@ private:
                         Uint32 mask_value = 255, SDL_Rect *clip=NULL,
                         SDL_Surface *src1=NULL, SDL_Surface *src2=NULL,
                         SDL_Surface *dst=NULL);
+    static void alphaMaskBlendBand(void* data, SDL_Rect& rect);
     void alphaBlendText(SDL_Surface *dst_surface, SDL_Rect dst_rect,
                         SDL_Surface *txt_surface, SDL_Color &color,
                         SDL_Rect *clip, bool rotate_flag);
@@ -929,6 +970,8 @@ private:
     void makeMonochromeSurface(SDL_Surface* surface, SDL_Rect &clip);
     void refreshSurface(SDL_Surface* surface, SDL_Rect* clip_src,
              int refresh_mode = REFRESH_NORMAL_MODE);
+    static void refreshBand(void* data, SDL_Rect& clip);
+    void drawLayers(SDL_Surface* surface, SDL_Rect& clip, int refresh_mode);
     void createBackground();
 
     /* ---------------------------------------- */
@@ -268,6 +268,56 @@ void PonscripterLabel::setupAnimationInfo(AnimationInfo* anim, Fontinfo* info)
 }
 
 
+// Adds the file loadImage() would read for filename to files, unless
+// the image is already in the cache.
+static void wantImage(std::vector<pstring>& files, const ImageCache& cache,
+                      const pstring& filename, bool twox, bool isflipped,
+                      bool want_alpha)
+{
+    if (!filename || filename[0] == '>') return;
+    if (cache.contains(ImageCache::makeKey(filename, twox, isflipped,
+                                           want_alpha)))
+        return;
+
+    pstring file = filename;
+    int amp = file.find('&');
+    if (amp >= 0) file.trunc(amp);
+    files.push_back(file);
+}
+
+
+// setupAnimationInfo() for several images at once, with the files
+// decoded in parallel beforehand.  Not for TRANS_STRING.
+void PonscripterLabel::setupAnimationInfos(const std::vector<AnimationInfo*>& anims)
+{
+    std::vector<pstring> files;
+    for (size_t i = 0; i < anims.size(); i++) {
+        const AnimationInfo* anim = anims[i];
+        wantImage(files, image_cache, anim->file_name,
+                  anim->twox, anim->isflipped, true);
+        if (anim->trans_mode == AnimationInfo::TRANS_MASK)
+            wantImage(files, image_cache, anim->mask_file_name,
+                      anim->twox, anim->isflipped, false);
+    }
+    prefetcher.preload(files);
+
+    for (size_t i = 0; i < anims.size(); i++)
+        setupAnimationInfo(anims[i]);
+}
+
+
+void PonscripterLabel::loadPendingImage(AnimationInfo& anim)
+{
+    if (anim.image_pending) setupAnimationInfo(&anim);
+}
+
+
+void PonscripterLabel::pendingImageLoader(void* data, AnimationInfo* anim)
+{
+    ((PonscripterLabel*) data)->loadPendingImage(*anim);
+}
+
+
 void PonscripterLabel::parseTaggedString(AnimationInfo* anim, bool is_mask)
 {
     if (!anim->image_name) return;
@@ -444,6 +444,7 @@ int PonscripterLabel::sp_rgb_gradationCommand(const pstring& cmd)
     AnimationInfo* si;
     if (no == -1) si = &sentence_font_info;
     else si = &sprite_info[no];
+    loadPendingImage(*si);
 
     SDL_Surface* surface = si->image_surface;
     if (surface == NULL) return RET_CONTINUE;
@@ -516,6 +517,7 @@ int PonscripterLabel::sp_rgb_gradationCommand(const pstring& cmd)
     }
 
     SDL_UnlockSurface(surface);
+    si->rebuildSpans();
 
     if (si->showing())
         dirty_rect.add(si->pos);
@@ -606,6 +608,7 @@ int PonscripterLabel::spbtnCommand(const pstring& cmd)
 	ButtonElt button;
 	button.button_type = ButtonElt::SPRITE_BUTTON;
 	button.sprite_no = sprite_no;
+	loadPendingImage(sprite_info[sprite_no]);
 
 	if (sprite_info[sprite_no].image_surface
 	    || sprite_info[sprite_no].trans_mode ==
@@ -1081,6 +1084,8 @@ int PonscripterLabel::savescreenshotCommand(const pstring& cmd)
     pstring ext = file_extension(filename);
     ext.toupper();
     if (ext == "BMP") {
+        image_cache.invalidate(filename);
+        script_h.cBR->invalidate(filename);
 	filename = script_h.save_path + filename;
 	replace_ascii(filename, '/', DELIMITER[0]);
 	replace_ascii(filename, '\\', DELIMITER[0]);
@@ -2287,6 +2292,7 @@ int PonscripterLabel::getspsizeCommand(const pstring& cmd)
 {
     int no = script_h.readIntValue();
     int multiplier = multiplier_style <= ScriptHandler::UMINEKO ? 1 : res_multiplier;
+    loadPendingImage(sprite_info[no]);
 
     script_h.readIntExpr().mutate(
         (sprite_info[no].pos.w * screen_ratio2 / screen_ratio1) /
@@ -2578,6 +2584,8 @@ int PonscripterLabel::gameCommand(const pstring& cmd)
     setCurrentLabel("start");
     saveSaveFile(-1);
 
+    preloadSoundEffects();
+
     return RET_CONTINUE;
 }
 
@@ -2662,6 +2670,7 @@ int PonscripterLabel::exbtnCommand(const pstring& cmd)
     button->sprite_no = sprite_no;
     button->exbtn_ctl = script_h.readStrValue();
 
+    if (sprite_no >= 0) loadPendingImage(sprite_info[sprite_no]);
     if (sprite_no >= 0
         && (sprite_info[sprite_no].image_surface ||
             sprite_info[sprite_no].trans_mode == AnimationInfo::TRANS_STRING)) {
@@ -2767,6 +2776,7 @@ int PonscripterLabel::drawsp3Command(const pstring& cmd)
     int y         = script_h.readIntValue() * screen_ratio1 * res_multiplier / screen_ratio2;
 
     AnimationInfo &si = sprite_info[sprite_no];
+    loadPendingImage(si);
     int old_cell_no = si.current_cell;
     si.setCell(cell_no);
 
@@ -2801,6 +2811,7 @@ int PonscripterLabel::drawsp2Command(const pstring& cmd)
     int alpha     = script_h.readIntValue();
 
     AnimationInfo &si = sprite_info[sprite_no];
+    loadPendingImage(si);
     si.pos.x   = script_h.readIntValue() * screen_ratio1 * res_multiplier / screen_ratio2;
     si.pos.y   = script_h.readIntValue() * screen_ratio1 * res_multiplier / screen_ratio2;
     si.scale_x = script_h.readIntValue();
@@ -2829,6 +2840,7 @@ int PonscripterLabel::drawspCommand(const pstring& cmd)
     int y         = script_h.readIntValue() * screen_ratio1 * res_multiplier / screen_ratio2;
 
     AnimationInfo &si = sprite_info[sprite_no];
+    loadPendingImage(si);
     int old_cell_no = si.current_cell;
     si.setCell(cell_no);
     SDL_Rect clip = { 0, 0, accumulation_surface->w, accumulation_surface->h };
@@ -3398,7 +3410,7 @@ int PonscripterLabel::bltCommand(const pstring& cmd)
         SDL_BlitSurface(btndef_info.image_surface, &src_rect, accumulation_surface, &dst_rect);
         //TODO, fix this. haven't found it used yet
         //SDL_UpdateRect(screen_surface, dst_rect.x, dst_rect.y, dst_rect.w, dst_rect.h);
-        SDL_UpdateTexture(screen_tex, NULL, accumulation_surface->pixels, accumulation_surface->pitch);
+        updateScreenTexture(&dst_rect);
         rerender();
         dirty_rect.clear();
     }
@@ -3529,7 +3541,7 @@ int PonscripterLabel::endrollCommand(const pstring& cmd)
             SDL_BlitSurface(btndef_info.image_surface, &src_rect, accumulation_surface, &dst_rect);
             //TODO, fix this. haven't found it used yet
             //SDL_UpdateRect(screen_surface, dst_rect.x, dst_rect.y, dst_rect.w, dst_rect.h);
-            SDL_UpdateTexture(screen_tex, NULL, accumulation_surface->pixels, accumulation_surface->pitch);
+            updateScreenTexture(&dst_rect);
             rerender();
             //dirty_rect.clear();
 
@@ -1224,7 +1224,27 @@ int PonscripterLabel::eventLoop()
     first_buttonwait_mode_frame = false;  // if it's the first frame of a buttonwait (menu/choice), snap to default button
     SDL_GetMouseState(&last_mouse_x, &last_mouse_y);
 
-    while (SDL_WaitEvent(&event)) {
+    for (;;) {
+        /* Sleep until the next thing that is due: a frame, if there is
+         * anything new to show, or the next timer event.  Input, audio
+         * and SDL timers wake us with their own events.  If the wait
+         * runs out, handle it as a redraw event.
+         */
+        Sint32 timeout = -1;
+        if (!minimized_flag && (present_pending_flag || timer_event_flag)) {
+            Uint32 deadline = present_pending_flag ? last_refresh + refresh_delay
+                                                   : timer_event_time;
+            if (timer_event_flag && (Sint32) (timer_event_time - deadline) < 0)
+                deadline = timer_event_time;
+            timeout = deadline - SDL_GetTicks();
+            if (timeout < 0) timeout = 0;
+        }
+        if (timeout < 0) {
+            if (!SDL_WaitEvent(&event)) break;
+        }
+        else if (!SDL_WaitEventTimeout(&event, timeout))
+            event.type = INTERNAL_REDRAW_EVENT;
+
         // ignore continous SDL_MOUSEMOTION
         while (event.type == SDL_MOUSEMOTION) {
             if (SDL_PeepEvents(&tmp_event, 1, SDL_PEEKEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT) == 0) break;
@@ -1395,9 +1415,9 @@ int PonscripterLabel::eventLoop()
             while(SDL_PeepEvents(&tmp_event, 1, SDL_GETEVENT, INTERNAL_REDRAW_EVENT, INTERNAL_REDRAW_EVENT) == 1)
                 ;
 
-            /* If there are any events on the queue, re-add us and let it get those events asap.
-             * It'll then come back to us with no events and we'll just sleep until it's time to redraw again.
-             * If there are no events, sleep right away
+            /* Let any other events on the queue go first; the top of the
+             * loop brings us back here once they're done, as the timer
+             * event is still due.
              */
             if(SDL_PeepEvents(&tmp_event, 1, SDL_PEEKEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT) == 0) {
                 if(timer_event_flag && timer_event_time <= current_time) {
@@ -1423,12 +1443,8 @@ int PonscripterLabel::eventLoop()
                         }
                         fprintf(renderTimesFile, "%llu,%s,%f\n", frameNo, eventName, msElapsed);
                     }
-                } else if(last_refresh <= current_time && refresh_delay >= (current_time - last_refresh)) {
-                    SDL_Delay(std::min(refresh_delay / 3, refresh_delay - (current_time - last_refresh)));
                 }
             }
-            tmp_event.type = INTERNAL_REDRAW_EVENT;
-            SDL_PushEvent(&tmp_event);
 
             break;
 
@@ -1454,6 +1470,8 @@ int PonscripterLabel::eventLoop()
             break;
 
         case SDL_WINDOWEVENT:
+            /* The window may have lost what was last presented */
+            present_pending_flag = true;
             switch(event.window.event) {
               case SDL_WINDOWEVENT_FOCUS_LOST:
                 break;
@@ -24,6 +24,7 @@
  */
 
 #include "PonscripterLabel.h"
+#include <algorithm>
 
 #if defined (LINUX) || defined (MACOSX)
 #include <sys/types.h>
@@ -212,13 +213,10 @@ int PonscripterLabel::saveSaveFile(int no, const char* savestr)
     // make save data structure on memory
     if (no < 0 || (saveon_flag && internal_saveon_flag)) {
         file_io_buf_ptr = 0;
-        saveMagicNumber(false);
-        saveSaveFile2(false);
-        allocFileIOBuf();
         saveMagicNumber(true);
         saveSaveFile2(true);
+        std::swap(save_data_buf, file_io_buf);
         save_data_len = file_io_buf_ptr;
-        memcpy(save_data_buf, file_io_buf, save_data_len);
     }
 
     if (no >= 0) {
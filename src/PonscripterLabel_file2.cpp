@@ -31,6 +31,10 @@ int PonscripterLabel::loadSaveFile2(SaveFileType file_type, int file_version)
 
     int i, j;
 
+    // Images the restored scene shows, loaded together once every
+    // record has been read.
+    std::vector<AnimationInfo*> scene;
+
     readInt(); // 1
 
     if (file_type == Ponscripter) {
@@ -57,18 +61,20 @@ int PonscripterLabel::loadSaveFile2(SaveFileType file_type, int file_version)
     cursor_info[0].image_name = readStr();
     if (cursor_info[0].image_name) {
 	parseTaggedString(&cursor_info[0]);
-	setupAnimationInfo(&cursor_info[0]);
-	if (cursor_info[0].image_surface)
-	    cursor_info[0].visible(true);
+	if (cursor_info[0].trans_mode == AnimationInfo::TRANS_STRING)
+	    setupAnimationInfo(&cursor_info[0]);
+	else
+	    scene.push_back(&cursor_info[0]);
     }
 
     cursor_info[1].remove();
     cursor_info[1].image_name = readStr();
     if (cursor_info[1].image_name) {
 	parseTaggedString(&cursor_info[1]);
-	setupAnimationInfo(&cursor_info[1]);
-	if (cursor_info[1].image_surface)
-	    cursor_info[1].visible(true);
+	if (cursor_info[1].trans_mode == AnimationInfo::TRANS_STRING)
+	    setupAnimationInfo(&cursor_info[1]);
+	else
+	    scene.push_back(&cursor_info[1]);
     }
 
     window_effect.effect   = readInt();
@@ -122,7 +128,10 @@ int PonscripterLabel::loadSaveFile2(SaveFileType file_type, int file_version)
 	tachi_info[i].image_name = readStr();
 	if (tachi_info[i].image_name) {
 	    parseTaggedString(&tachi_info[i]);
-	    setupAnimationInfo(&tachi_info[i]);
+	    if (tachi_info[i].trans_mode == AnimationInfo::TRANS_STRING)
+		setupAnimationInfo(&tachi_info[i]);
+	    else
+		scene.push_back(&tachi_info[i]);
         tachi_info[i].visible(true);
 	}
     }
@@ -148,7 +157,8 @@ int PonscripterLabel::loadSaveFile2(SaveFileType file_type, int file_version)
 	sprite_info[i].image_name = readStr();
 	if (sprite_info[i].image_name) {
 	    parseTaggedString(&sprite_info[i]);
-	    setupAnimationInfo(&sprite_info[i]);
+	    if (sprite_info[i].trans_mode == AnimationInfo::TRANS_STRING)
+		setupAnimationInfo(&sprite_info[i]);
 	}
 
 	sprite_info[i].pos.x = readInt() * screen_ratio1 / screen_ratio2;
@@ -157,6 +167,13 @@ int PonscripterLabel::loadSaveFile2(SaveFileType file_type, int file_version)
 	sprite_info[i].visible(visible_flags & 1);
 	sprite_info[i].enabled(visible_flags & 2);
         sprite_info[i].enablemode = visible_flags >> 2;
+	if (sprite_info[i].image_name &&
+	    sprite_info[i].trans_mode != AnimationInfo::TRANS_STRING) {
+	    if (sprite_info[i].showing())
+		scene.push_back(&sprite_info[i]);
+	    else
+		sprite_info[i].image_pending = true;
+	}
 	sprite_info[i].current_cell = readInt();
 	if (file_version >= 203) {
 	    int trans = readInt();
@@ -393,7 +410,8 @@ int PonscripterLabel::loadSaveFile2(SaveFileType file_type, int file_version)
 	    sprite2_info[i].image_name = readStr();
 	    if (sprite2_info[i].image_name) {
 		parseTaggedString(&sprite2_info[i]);
-		setupAnimationInfo(&sprite2_info[i]);
+		if (sprite2_info[i].trans_mode == AnimationInfo::TRANS_STRING)
+		    setupAnimationInfo(&sprite2_info[i]);
 	    }
 	    sprite2_info[i].pos.x = readInt() * screen_ratio1 / screen_ratio2;
 	    sprite2_info[i].pos.y = readInt() * screen_ratio1 / screen_ratio2;
@@ -405,6 +423,13 @@ int PonscripterLabel::loadSaveFile2(SaveFileType file_type, int file_version)
             sprite2_info[i].visible(visible_flags & 1);
             sprite2_info[i].enabled(visible_flags & 2);
             sprite2_info[i].enablemode = visible_flags >> 2;
+	    if (sprite2_info[i].image_name &&
+		sprite2_info[i].trans_mode != AnimationInfo::TRANS_STRING) {
+		if (sprite2_info[i].showing())
+		    scene.push_back(&sprite2_info[i]);
+		else
+		    sprite2_info[i].image_pending = true;
+	    }
 
 	    j = readInt();
 	    sprite2_info[i].trans = j == -1 ? 256 : j;
@@ -418,6 +443,12 @@ int PonscripterLabel::loadSaveFile2(SaveFileType file_type, int file_version)
 	readInt();
 	readInt();
     }
+
+    // Hidden sprites load their images when first shown.
+    setupAnimationInfos(scene);
+    for (i = 0; i < 2; i++)
+	if (cursor_info[i].image_surface)
+	    cursor_info[i].visible(true);
     
     for (j = 0; j < 2; j++) {
         int text_num = readInt();
@@ -543,21 +574,60 @@ void PonscripterLabel::saveSaveFile2(bool output_flag)
     writeInt(-1, output_flag);
     writeInt(-1, output_flag);
     
-    for (i = 0; i < MAX_SPRITE_NUM; i++) {
-	writeStr(sprite_info[i].image_name, output_flag);
-	writeInt(sprite_info[i].pos.x * screen_ratio2 / screen_ratio1,
-		 output_flag);
-	writeInt(sprite_info[i].pos.y * screen_ratio2 / screen_ratio1,
-		 output_flag);
-	writeInt(sprite_info[i].savestate(), output_flag);
-	writeInt(sprite_info[i].current_cell, output_flag);
-        if (sprite_info[i].trans == 256)
-            writeInt(-1, output_flag);
-        else
-            writeInt(sprite_info[i].trans, output_flag);
+    // Sprites are compared with what the last savepoint recorded for
+    // them, and their records reused if nothing has moved.
+    if (output_flag) {
+        sprite_save_block.begin(MAX_SPRITE_NUM, 5);
+        for (i = 0; i < MAX_SPRITE_NUM; i++) {
+            AnimationInfo& s = sprite_info[i];
+            int v[5] = { s.pos.x * screen_ratio2 / screen_ratio1,
+                         s.pos.y * screen_ratio2 / screen_ratio1,
+                         s.savestate(), s.current_cell, s.trans };
+            sprite_save_block.record(i, v, s.image_name);
+        }
+    }
+    if (output_flag && sprite_save_block.unchanged()) {
+        writeBytes(sprite_save_block.data(), sprite_save_block.size(),
+                   output_flag);
+    }
+    else {
+        size_t start = file_io_buf_ptr;
+        for (i = 0; i < MAX_SPRITE_NUM; i++) {
+            writeStr(sprite_info[i].image_name, output_flag);
+            writeInt(sprite_info[i].pos.x * screen_ratio2 / screen_ratio1,
+                     output_flag);
+            writeInt(sprite_info[i].pos.y * screen_ratio2 / screen_ratio1,
+                     output_flag);
+            writeInt(sprite_info[i].savestate(), output_flag);
+            writeInt(sprite_info[i].current_cell, output_flag);
+            if (sprite_info[i].trans == 256)
+                writeInt(-1, output_flag);
+            else
+                writeInt(sprite_info[i].trans, output_flag);
+        }
+        if (output_flag)
+            sprite_save_block.store(file_io_buf + start,
+                                    file_io_buf_ptr - start);
     }
 
-    writeVariables(0, script_h.global_variable_border, output_flag);
+    // Variables only need comparing with a generation count.
+    if (output_flag) {
+        int v[2] = { script_h.global_variable_border,
+                     (int) ScriptHandler::VariableData::generation };
+        variable_save_block.begin(1, 2);
+        variable_save_block.record(0, v);
+    }
+    if (output_flag && variable_save_block.unchanged()) {
+        writeBytes(variable_save_block.data(), variable_save_block.size(),
+                   output_flag);
+    }
+    else {
+        size_t start = file_io_buf_ptr;
+        writeVariables(0, script_h.global_variable_border, output_flag);
+        if (output_flag)
+            variable_save_block.store(file_io_buf + start,
+                                      file_io_buf_ptr - start);
+    }
 
     // nested info
     int num_nest = 0;
@@ -692,21 +762,42 @@ void PonscripterLabel::saveSaveFile2(bool output_flag)
 
     writeInt(0, output_flag);
 
-    for (i = 0; i < MAX_SPRITE2_NUM; ++i) {
-	writeStr(sprite2_info[i].image_name, output_flag);
-	writeInt(sprite2_info[i].pos.x * screen_ratio2 / screen_ratio1,
-		 output_flag);
-	writeInt(sprite2_info[i].pos.y * screen_ratio2 / screen_ratio1,
-		 output_flag);
-	writeInt(sprite2_info[i].scale_x, output_flag);
-	writeInt(sprite2_info[i].scale_y, output_flag);
-	writeInt(sprite2_info[i].rot, output_flag);
-	writeInt(sprite2_info[i].savestate(), output_flag);
-	if (sprite2_info[i].trans == 256)
-	    writeInt(-1, output_flag);
-	else
-	    writeInt(sprite2_info[i].trans, output_flag);
-	writeInt(sprite2_info[i].blending_mode, output_flag);
+    if (output_flag) {
+        sprite2_save_block.begin(MAX_SPRITE2_NUM, 8);
+        for (i = 0; i < MAX_SPRITE2_NUM; ++i) {
+            AnimationInfo& s = sprite2_info[i];
+            int v[8] = { s.pos.x * screen_ratio2 / screen_ratio1,
+                         s.pos.y * screen_ratio2 / screen_ratio1,
+                         s.scale_x, s.scale_y, s.rot, s.savestate(),
+                         s.trans, s.blending_mode };
+            sprite2_save_block.record(i, v, s.image_name);
+        }
+    }
+    if (output_flag && sprite2_save_block.unchanged()) {
+        writeBytes(sprite2_save_block.data(), sprite2_save_block.size(),
+                   output_flag);
+    }
+    else {
+        size_t start = file_io_buf_ptr;
+        for (i = 0; i < MAX_SPRITE2_NUM; ++i) {
+            writeStr(sprite2_info[i].image_name, output_flag);
+            writeInt(sprite2_info[i].pos.x * screen_ratio2 / screen_ratio1,
+                     output_flag);
+            writeInt(sprite2_info[i].pos.y * screen_ratio2 / screen_ratio1,
+                     output_flag);
+            writeInt(sprite2_info[i].scale_x, output_flag);
+            writeInt(sprite2_info[i].scale_y, output_flag);
+            writeInt(sprite2_info[i].rot, output_flag);
+            writeInt(sprite2_info[i].savestate(), output_flag);
+            if (sprite2_info[i].trans == 256)
+                writeInt(-1, output_flag);
+            else
+                writeInt(sprite2_info[i].trans, output_flag);
+            writeInt(sprite2_info[i].blending_mode, output_flag);
+        }
+        if (output_flag)
+            sprite2_save_block.store(file_io_buf + start,
+                                     file_io_buf_ptr - start);
     }
 
     writeInt(0, output_flag);
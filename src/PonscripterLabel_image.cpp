@@ -33,6 +33,16 @@ SDL_Surface *PonscripterLabel::loadImage(const pstring& filename,
 {
     if (!filename) return NULL;
 
+    pstring cache_key = ImageCache::makeKey(filename, twox, isflipped,
+                                            has_alpha != NULL);
+    SDL_Surface *cached = image_cache.get(cache_key, has_alpha);
+    if (cached) {
+        Profiler::count(Profiler::IMAGE_CACHE_HIT);
+        return cached;
+    }
+    Profiler::count(Profiler::IMAGE_CACHE_MISS);
+    Profiler::Scope scope(Profiler::IMAGE_LOAD);
+
     if (lastRenderEvent < RENDER_EVENT_LOAD_IMAGE) { lastRenderEvent = RENDER_EVENT_LOAD_IMAGE; }
 
     SDL_Surface *tmp = NULL, *tmpb = NULL;
@@ -159,11 +169,11 @@ SDL_Surface *PonscripterLabel::loadImage(const pstring& filename,
         SDL_BlitScaled(ret, NULL, retb, NULL);
 
         SDL_FreeSurface( ret );
-        return retb;
-    } else {
-        return ret;
+        ret = retb;
     }
-    
+
+    image_cache.add(cache_key, ret, has_alpha && *has_alpha);
+    return ret;
 }
 
 SDL_Surface *PonscripterLabel::createRectangleSurface(const char* filename)
@@ -220,6 +230,28 @@ SDL_Surface *PonscripterLabel::createRectangleSurface(const char* filename)
     return tmp;
 }
 
+// Decodes an image file already in memory, retrying a misnamed or
+// broken .jpg with the JPEG loader.
+static SDL_Surface* decodeImage(const pstring& filename,
+                                const unsigned char* data, size_t length)
+{
+    SDL_Surface* tmp = IMG_Load_RW(SDL_RWFromConstMem(data, length), 1);
+    if (!tmp && file_extension(filename).caselessEqual("jpg")) {
+        fprintf(stderr, " *** force-loading a JPEG image [%s]\n",
+                (const char*) filename);
+        SDL_RWops* src = SDL_RWFromConstMem(data, length);
+        tmp = IMG_LoadJPG_RW(src);
+        SDL_RWclose(src);
+    }
+
+    if (!tmp)
+        fprintf(stderr, " *** can't load file [%s]: %s ***\n",
+                (const char*)filename, IMG_GetError());
+
+    return tmp;
+}
+
+
 SDL_Surface *PonscripterLabel::createSurfaceFromFile(const pstring& filename,
                                                     int *location)
 {
@@ -251,6 +283,19 @@ SDL_Surface *PonscripterLabel::createSurfaceFromFile(const pstring& filename,
     }
     if (filelog_flag) script_h.file_log.add(filename);
 
+    if (!alt_filename) {
+        SDL_Surface* tmp = prefetcher.takeImage(filename);
+        if (!tmp) tmp = script_h.cBR->getImage(filename, location);
+        if (tmp) return tmp;
+    }
+
+    // Stored archive entries can be decoded straight from the mapping.
+    const unsigned char* view;
+    size_t view_len;
+    if (!alt_filename &&
+        script_h.cBR->getFileView(filename, &view, &view_len, location))
+        return decodeImage(filename, view, view_len);
+
     pstring dat = "";
     if (!alt_filename) {
         dat = script_h.cBR->getFile(filename, location);
@@ -262,23 +307,17 @@ SDL_Surface *PonscripterLabel::createSurfaceFromFile(const pstring& filename,
                     (const char*)alt_filename);
     }
 
-    SDL_Surface* tmp = IMG_Load_RW(rwops(dat), 1);
-    if (!tmp && file_extension(filename).caselessEqual("jpg")) {
-        fprintf(stderr, " *** force-loading a JPEG image [%s]\n",
-                (const char*) filename);
-        SDL_RWops* src = rwops(dat);
-        tmp = IMG_LoadJPG_RW(src);
-        SDL_RWclose(src);
-    }
-
-    if (!tmp)
-        fprintf(stderr, " *** can't load file [%s]: %s ***\n",
-                (const char*)filename, IMG_GetError());
-
-    return tmp;
+    return decodeImage(filename, dat.data, dat.length());
 }
 
 
+struct AlphaMaskJob {
+    SDL_Surface *mask_surface, *src1, *src2, *dst;
+    int trans_mode;
+    Uint32 mask_value;
+    int screen_width;
+};
+
 // alphaMaskBlend
 // dst: accumulation_surface
 // src1: effect_src_surface
@@ -309,19 +348,36 @@ void PonscripterLabel::alphaMaskBlend(SDL_Surface *mask_surface, int trans_mode,
     SDL_LockSurface( src2 );
     SDL_LockSurface( dst );
     if ( mask_surface ) SDL_LockSurface( mask_surface );
-    
+
+    AlphaMaskJob job = { mask_surface, src1, src2, dst, trans_mode,
+                         mask_value >> dst->format->Bloss, screen_width };
+    compositor.run(alphaMaskBlendBand, &job, rect);
+
+    if ( mask_surface ) SDL_UnlockSurface( mask_surface );
+    SDL_UnlockSurface( dst );
+    SDL_UnlockSurface( src2 );
+    SDL_UnlockSurface( src1 );
+}
+
+
+void PonscripterLabel::alphaMaskBlendBand(void* data, SDL_Rect& rect)
+{
+    AlphaMaskJob* job = (AlphaMaskJob*) data;
+    SDL_Surface *mask_surface = job->mask_surface;
+    SDL_Surface *src1 = job->src1, *src2 = job->src2, *dst = job->dst;
+    const int trans_mode = job->trans_mode;
+    const Uint32 mask_value = job->mask_value;
+
     ONSBuf *src1_buffer = (ONSBuf *)src1->pixels + src1->w * rect.y + rect.x;
     ONSBuf *src2_buffer = (ONSBuf *)src2->pixels + src2->w * rect.y + rect.x;
     ONSBuf *dst_buffer  = (ONSBuf *)dst->pixels + dst->w * rect.y + rect.x;
 
-    const int rwidth = screen_width - rect.w;
+    const int rwidth = job->screen_width - rect.w;
     SDL_PixelFormat *fmt = dst->format;
     Uint32 overflow_mask = 0xffffffff;
     if ( trans_mode != ALPHA_BLEND_FADE_MASK )
         overflow_mask = ~fmt->Bmask;
 
-    mask_value >>= fmt->Bloss;
-
     if (( trans_mode == ALPHA_BLEND_FADE_MASK || trans_mode == ALPHA_BLEND_CROSSFADE_MASK ) && mask_surface) {
         bool accelerated_ok = sizeof(ONSBuf) == 4 && fmt->Bmask == 0xff;
         if (accelerated_ok) {
@@ -375,11 +431,6 @@ void PonscripterLabel::alphaMaskBlend(SDL_Surface *mask_surface, int trans_mode,
             }
         }
     }
-    
-    if ( mask_surface ) SDL_UnlockSurface( mask_surface );
-    SDL_UnlockSurface( dst );
-    SDL_UnlockSurface( src2 );
-    SDL_UnlockSurface( src1 );
 }
 
 
@@ -457,7 +508,10 @@ void PonscripterLabel::alphaBlendText(SDL_Surface *dst_surface, SDL_Rect dst_rec
 
 void PonscripterLabel::makeNegaSurface( SDL_Surface *surface, SDL_Rect &clip )
 {
-    SDL_LockSurface( surface );
+    {
+        Compositor::Guard guard;
+        SDL_LockSurface( surface );
+    }
     ONSBuf *buf = (ONSBuf *)surface->pixels + clip.y * surface->w + clip.x;
 
     ONSBuf mask = surface->format->Rmask | surface->format->Gmask | surface->format->Bmask;
@@ -467,13 +521,17 @@ void PonscripterLabel::makeNegaSurface( SDL_Surface *surface, SDL_Rect &clip )
         buf += surface->w - clip.w;
     }
 
+    Compositor::Guard guard;
     SDL_UnlockSurface( surface );
 }
 
 
 void PonscripterLabel::makeMonochromeSurface( SDL_Surface *surface, SDL_Rect &clip )
 {
-    SDL_LockSurface( surface );
+    {
+        Compositor::Guard guard;
+        SDL_LockSurface( surface );
+    }
     ONSBuf *buffer = (ONSBuf *)surface->pixels + clip.y * surface->w + clip.x;
 
     for ( int i=clip.h ; i>0 ; i-- ){
@@ -486,32 +544,60 @@ void PonscripterLabel::makeMonochromeSurface( SDL_Surface *surface, SDL_Rect &cl
         buffer += surface->w - clip.w;
     }
 
+    Compositor::Guard guard;
     SDL_UnlockSurface( surface );
 }
 
 
+struct RefreshJob {
+    PonscripterLabel* ons;
+    SDL_Surface* surface;
+    int refresh_mode;
+};
+
 void
 PonscripterLabel::refreshSurface(SDL_Surface* surface, SDL_Rect* clip_src,
 				 int refresh_mode)
 {
     if (refresh_mode == REFRESH_NONE_MODE) return;
 
+    Profiler::Scope scope(Profiler::REFRESH);
     SDL_Rect clip = { 0, 0, surface->w, surface->h };
     if (clip_src && AnimationInfo::doClipping(&clip, clip_src)) return;
 
-    int i, top;
     SDL_BlitSurface( bg_info.image_surface, &clip, surface, &clip );
 
+    updateSpriteLayers();
+
+    RefreshJob job = { this, surface, refresh_mode };
+    compositor.run(refreshBand, &job, clip);
+}
+
+
+void PonscripterLabel::refreshBand(void* data, SDL_Rect& clip)
+{
+    RefreshJob* job = (RefreshJob*) data;
+    job->ons->drawLayers(job->surface, clip, job->refresh_mode);
+}
+
+
+// Everything refreshSurface() draws over the background.  This may run
+// on several threads at once, each with its own band of the clip rect.
+void PonscripterLabel::drawLayers(SDL_Surface* surface, SDL_Rect& clip,
+                                  int refresh_mode)
+{
+    int i, top;
+    std::vector<int>::const_iterator it;
+
     if (!all_sprite_hide_flag) {
         if (z_order < 10 && refresh_mode & REFRESH_SAYA_MODE)
             top = 9;
         else
             top = z_order;
     
-        for (i = MAX_SPRITE_NUM - 1; i > top; --i) {
-            if (sprite_info[i].image_surface && sprite_info[i].showing())
-                drawTaggedSurface(surface, &sprite_info[i], clip);
-        }
+        for (it = sprite_layers.begin();
+             it != sprite_layers.end() && *it > top; ++it)
+            drawTaggedSurface(surface, &sprite_info[*it], clip);
     }
 
     for (i = 0; i < 3; ++i) {
@@ -526,10 +612,8 @@ PonscripterLabel::refreshSurface(SDL_Surface* surface, SDL_Rect* clip_src,
         if (nega_mode == 2) makeNegaSurface(surface, clip);
 
         if (!all_sprite2_hide_flag) {
-            for (i = MAX_SPRITE2_NUM - 1; i >= 0; --i) {
-                if (sprite2_info[i].image_surface && sprite2_info[i].showing())
-                    drawTaggedSurface(surface, &sprite2_info[i], clip);
-            }
+            for (it = sprite2_layers.begin(); it != sprite2_layers.end(); ++it)
+                drawTaggedSurface(surface, &sprite2_info[*it], clip);
         }
 
         if (refresh_mode & REFRESH_SHADOW_MODE)
@@ -543,19 +627,17 @@ PonscripterLabel::refreshSurface(SDL_Surface* surface, SDL_Rect* clip_src,
             top = 10;
         else
             top = 0;
-        for (i = z_order; i >= top; --i) {
-            if (sprite_info[i].image_surface && sprite_info[i].showing())
-                drawTaggedSurface(surface, &sprite_info[i], clip);
-        }
+        it = sprite_layers.begin();
+        while (it != sprite_layers.end() && *it > z_order) ++it;
+        for (; it != sprite_layers.end() && *it >= top; ++it)
+            drawTaggedSurface(surface, &sprite_info[*it], clip);
     }
 
     if (!windowback_flag) {
         //Mion - ogapee2008
         if (!all_sprite2_hide_flag) {
-            for (i = MAX_SPRITE2_NUM - 1; i >= 0; --i) {
-                if (sprite2_info[i].image_surface && sprite2_info[i].showing())
-                    drawTaggedSurface(surface, &sprite2_info[i], clip);
-            }
+            for (it = sprite2_layers.begin(); it != sprite2_layers.end(); ++it)
+                drawTaggedSurface(surface, &sprite2_info[*it], clip);
         }
         if (nega_mode == 1) makeNegaSurface(surface, clip);
         if (monocro_flag)   makeMonochromeSurface(surface, clip);
@@ -591,6 +673,24 @@ PonscripterLabel::refreshSurface(SDL_Surface* surface, SDL_Rect* clip_src,
 }
 
 
+void PonscripterLabel::updateSpriteLayers()
+{
+    if (sprite_layers_generation == AnimationInfo::generation) return;
+    sprite_layers_generation = AnimationInfo::generation;
+
+    int i;
+    sprite_layers.clear();
+    for (i = MAX_SPRITE_NUM - 1; i >= 0; --i)
+        if (sprite_info[i].image_surface && sprite_info[i].showing())
+            sprite_layers.push_back(i);
+
+    sprite2_layers.clear();
+    for (i = MAX_SPRITE2_NUM - 1; i >= 0; --i)
+        if (sprite2_info[i].image_surface && sprite2_info[i].showing())
+            sprite2_layers.push_back(i);
+}
+
+
 void PonscripterLabel::refreshSprite(int sprite_no, bool active_flag,
                                      int cell_no, SDL_Rect* check_src_rect,
                                      SDL_Rect* check_dst_rect)
@@ -25,6 +25,7 @@
 
 #include "PonscripterLabel.h"
 #include "PonscripterUserEvents.h"
+#include "ArchiveStream.h"
 #ifdef LINUX
 #include <signal.h>
 #endif
@@ -169,18 +170,22 @@ extern long decodeOggVorbis(PonscripterLabel::MusicStruct *music_struct, Uint8 *
 }
 
 
+// Copies what is left of src to fp, for players that want a file.
+static void copyToFile(SDL_RWops* src, FILE* fp)
+{
+    unsigned char buf[16384];
+    size_t n;
+    while ((n = SDL_RWread(src, buf, 1, sizeof buf)) > 0)
+        fwrite(buf, 1, n, fp);
+}
+
+
 int PonscripterLabel::playSound(const pstring& filename, int format,
                                 bool loop_flag, int channel)
 {
     if ( !audio_open_flag ) return SOUND_NONE;
     if (filename.length() == 0) return SOUND_NONE;
 
-    long length = script_h.cBR->getFileLength( filename );
-    if (length == 0) {
-        errorAndCont(filename + " not found");
-        return SOUND_NONE;
-    }
-
     //Mion: account for mode_wave_demo setting
     //(i.e. if not set, then don't play non-bgm wave/ogg during skip mode)
     if (!mode_wave_demo_flag &&
@@ -191,30 +196,83 @@ int PonscripterLabel::playSound(const pstring& filename, int format,
             return SOUND_NONE;
     }
 
-    unsigned char* buffer;
+    // Played before: no need even to look the file up.
+    if (soundCacheable(format, channel)) {
+        Mix_Chunk* chunk = sound_cache.get(filename);
+        if (chunk) {
+            Profiler::count(Profiler::SOUND_CACHE_HIT);
+            playWave(chunk, format, loop_flag, channel);
+            return SOUND_WAVE;
+        }
+        Profiler::count(Profiler::SOUND_CACHE_MISS);
+    }
+
+    long length = script_h.cBR->getFileLength( filename );
+    if (length == 0) {
+        errorAndCont(filename + " not found");
+        return SOUND_NONE;
+    }
+
+    Profiler::Scope scope(Profiler::AUDIO_LOAD);
+    unsigned char* buffer = NULL;
+    bool owned = true;
+    const unsigned char* view;
+    size_t view_len;
+    SDL_RWops* src = NULL;
 
     if ((format & (SOUND_MP3 | SOUND_OGG_STREAMING)) &&
         (length == music_buffer_length) &&
         music_buffer ){
         buffer = music_buffer;
     }
+    else if (prefetcher.takeSound(filename, &buffer, &length)) {
+        // Already read by the prefetch thread.
+    }
+    else if (!(format & (SOUND_MP3 | SOUND_OGG_STREAMING)) &&
+             script_h.cBR->getFileView(filename, &view, &view_len)) {
+        // Decoded into a chunk before we return, so the archive
+        // mapping can be used in place.  Nothing writes through this.
+        buffer = const_cast<unsigned char*>(view);
+        owned = false;
+    }
+    else if (length > ArchiveStream::MIN_LENGTH &&
+             (src = ArchiveStream::open(script_h.cBR, filename))) {
+        // Long music and voices are read as they play rather than
+        // whole before they start.
+    }
     else{
         if (lastRenderEvent < RENDER_EVENT_LOAD_AUDIO) { lastRenderEvent = RENDER_EVENT_LOAD_AUDIO; }
         buffer = new unsigned char[length];
         script_h.cBR->getFile( filename, buffer );
     }
+    // Each decoder below reads src from the start; whichever takes
+    // the sound keeps it open.
+    if (!src) src = SDL_RWFromConstMem(buffer, length);
 
     if (format & (SOUND_OGG | SOUND_OGG_STREAMING)) {
-        int ret = playOGG(format, buffer, length, loop_flag, channel);
-        if (ret & (SOUND_OGG | SOUND_OGG_STREAMING)) return ret;
+        int ret = playOGG(filename, format, src, loop_flag, channel);
+        if (ret & SOUND_OGG) {
+            if (owned) delete[] buffer;
+            return ret;
+        }
+        if (ret & SOUND_OGG_STREAMING) {
+            music_buffer = buffer;
+            music_buffer_length = length;
+            return ret;
+        }
+        SDL_RWseek(src, 0, RW_SEEK_SET);
     }
 
     if (format & SOUND_WAVE) {
-        Mix_Chunk* chunk = Mix_LoadWAV_RW(SDL_RWFromMem(buffer, length), 1);
+        Mix_Chunk* chunk = Mix_LoadWAV_RW(src, 0);
         if (playWave(chunk, format, loop_flag, channel) == 0) {
-            delete[] buffer;
+            if (soundCacheable(format, channel))
+                sound_cache.add(filename, chunk);
+            SDL_RWclose(src);
+            if (owned) delete[] buffer;
             return SOUND_WAVE;
         }
+        SDL_RWseek(src, 0, RW_SEEK_SET);
     }
 
     if (format & SOUND_MP3) {
@@ -225,31 +283,39 @@ int PonscripterLabel::playSound(const pstring& filename, int format,
                         TMP_MUSIC_FILE);
             }
             else {
-                fwrite(buffer, 1, length, fp);
+                copyToFile(src, fp);
                 fclose(fp);
+                script_h.cBR->invalidate(TMP_MUSIC_FILE);
                 ext_music_play_once_flag = !loop_flag;
                 if (playExternalMusic(loop_flag) == 0) {
+                    SDL_RWclose(src);
                     music_buffer = buffer;
                     music_buffer_length = length;
                     return SOUND_MP3;
                 }
             }
+            SDL_RWseek(src, 0, RW_SEEK_SET);
         }
 
-        mp3_sample = SMPEG_new_rwops(SDL_RWFromMem(buffer, length), NULL, 0, 0);
+        mp3_sample = SMPEG_new_rwops(src, NULL, 0, 0);
         if (playMP3() == 0) {
+            mp3_src = src;
             music_buffer = buffer;
             music_buffer_length = length;
             return SOUND_MP3;
         }
+        SDL_RWseek(src, 0, RW_SEEK_SET);
     }
 
     /* check WMA */
-    if (buffer[0] == 0x30 && buffer[1] == 0x26
-        && buffer[2] == 0xb2 && buffer[3] == 0x75) {
-        delete[] buffer;
+    unsigned char magic[4];
+    if (SDL_RWread(src, magic, 1, 4) == 4 && magic[0] == 0x30 &&
+        magic[1] == 0x26 && magic[2] == 0xb2 && magic[3] == 0x75) {
+        SDL_RWclose(src);
+        if (owned) delete[] buffer;
         return SOUND_OTHER;
     }
+    SDL_RWseek(src, 0, RW_SEEK_SET);
 
     if (format & SOUND_MIDI) {
         FILE* fp = fopen(script_h.save_path + TMP_MIDI_FILE, "wb");
@@ -258,17 +324,20 @@ int PonscripterLabel::playSound(const pstring& filename, int format,
                     TMP_MIDI_FILE);
         }
         else {
-            fwrite(buffer, 1, length, fp);
+            copyToFile(src, fp);
             fclose(fp);
+            script_h.cBR->invalidate(TMP_MIDI_FILE);
             ext_music_play_once_flag = !loop_flag;
             if (playMIDI(loop_flag) == 0) {
-                delete[] buffer;
+                SDL_RWclose(src);
+                if (owned) delete[] buffer;
                 return SOUND_MIDI;
             }
         }
     }
 
-    delete[] buffer;
+    SDL_RWclose(src);
+    if (owned) delete[] buffer;
 
     return SOUND_OTHER;
 }
@@ -334,31 +403,50 @@ int PonscripterLabel::playMP3()
 }
 
 
-int PonscripterLabel::playOGG(int format, unsigned char* buffer, long length, bool loop_flag, int channel)
+// Decodes all of an OGG file into a chunk, and closes it.
+Mix_Chunk* PonscripterLabel::decodeOggChunk(OVInfo* ovi, int channels,
+                                            int rate)
+{
+    unsigned char* buffer2 = new unsigned char[sizeof(WAVE_HEADER) + ovi->decoded_length];
+
+    // Volume is only applied when converting, for streaming.
+    MusicStruct ms;
+    ms.ovi = ovi;
+    ms.voice_sample = NULL;
+    ms.volume = DEFAULT_VOLUME;
+    ms.is_mute = false;
+    decodeOggVorbis(&ms, buffer2 + sizeof(WAVE_HEADER), ovi->decoded_length, false);
+    setupWaveHeader(buffer2, channels, rate, 16, ovi->decoded_length);
+    Mix_Chunk* chunk = Mix_LoadWAV_RW(SDL_RWFromMem(buffer2, sizeof(WAVE_HEADER) + ovi->decoded_length), 1);
+    delete[] buffer2;
+    closeOggVorbis(ovi);
+
+    return chunk;
+}
+
+
+int PonscripterLabel::playOGG(const pstring& filename, int format,
+                              SDL_RWops* src, bool loop_flag, int channel)
 {
     int channels, rate;
-    OVInfo* ovi = openOggVorbis(buffer, length, channels, rate);
+    OVInfo* ovi = openOggVorbis(src, channels, rate);
     if (ovi == NULL) return SOUND_OTHER;
 
     if (format & SOUND_OGG) {
-        unsigned char* buffer2 = new unsigned char[sizeof(WAVE_HEADER) + ovi->decoded_length];
-
-        MusicStruct ms;
-        ms.ovi = ovi;
-        ms.voice_sample = NULL;
-        ms.volume = channelvolumes[channel];
-        decodeOggVorbis(&ms, buffer2 + sizeof(WAVE_HEADER), ovi->decoded_length, false);
-        setupWaveHeader(buffer2, channels, rate, 16, ovi->decoded_length);
-        Mix_Chunk* chunk = Mix_LoadWAV_RW(SDL_RWFromMem(buffer2, sizeof(WAVE_HEADER) + ovi->decoded_length), 1);
-        delete[] buffer2;
-        closeOggVorbis(ovi);
-        delete[] buffer;
-
-        playWave(chunk, format, loop_flag, channel);
+        Mix_Chunk* chunk = decodeOggChunk(ovi, channels, rate);
+        if (playWave(chunk, format, loop_flag, channel) == 0 &&
+            soundCacheable(format, channel))
+            sound_cache.add(filename, chunk);
 
         return SOUND_OGG;
     }
 
+    // oggcallback() seeks back to the loop start itself, in the audio
+    // thread, and mustn't wait for the archive to get there.  The
+    // stream reads the file in while the music plays up to the loop
+    // end, which takes far longer.
+    if (ovi->loop == 1) ArchiveStream::keepWhole(src);
+
     if ((audio_format.format != AUDIO_S16) ||
         (audio_format.freq != rate)) {
         Mix_CloseAudio();
@@ -381,9 +469,6 @@ int PonscripterLabel::playOGG(int format, unsigned char* buffer, long length, bo
     music_struct.is_mute = !volume_on_flag;
     Mix_HookMusic(oggcallback, &music_struct);
 
-    music_buffer = buffer;
-    music_buffer_length = length;
-
     return SOUND_OGG_STREAMING;
 }
 
@@ -529,8 +614,14 @@ int PonscripterLabel::playMPEG(const pstring& filename, bool click_flag, bool lo
     int ret = 0;
 #ifndef MP3_MAD
     bool different_spec = false;
-    pstring mpeg_dat = ScriptHandler::cBR->getFile(filename);
-    SMPEG* mpeg_sample = SMPEG_new_rwops(rwops(mpeg_dat), 0, 0, 0);
+    // Read the movie as it plays where the archive allows it.
+    pstring mpeg_dat;
+    SDL_RWops* src = ArchiveStream::open(ScriptHandler::cBR, filename);
+    if (!src) {
+        mpeg_dat = ScriptHandler::cBR->getFile(filename);
+        src = rwops(mpeg_dat);
+    }
+    SMPEG* mpeg_sample = SMPEG_new_rwops(src, 0, 0, 0);
     if (!SMPEG_error(mpeg_sample)) {
         SMPEG_enableaudio(mpeg_sample, 0);
 
@@ -752,10 +843,13 @@ int PonscripterLabel::playMPEG(const pstring& filename, bool click_flag, bool lo
         }
         overlays.clear();
 
+        /* The last movie frame is still on screen */
+        present_pending_flag = true;
         if(interrupted_redraw) {
             queueRerender();
         }
     }
+    SDL_RWclose(src);
 
 #else
     fprintf(stderr, "mpegplay command is disabled.\n");
@@ -808,6 +902,8 @@ void PonscripterLabel::stopBGM(bool continue_flag)
         Mix_HookMusic(NULL, NULL);
         SMPEG_delete(mp3_sample);
         mp3_sample = NULL;
+        SDL_RWclose(mp3_src);
+        mp3_src = NULL;
     }
 
     if (music_struct.ovi){
@@ -873,6 +969,56 @@ void PonscripterLabel::stopAllDWAVE()
 }
 
 
+// Sounds decoded whole into a chunk are worth keeping: effects above
+// all, but voices and loops too.  Music is streamed.
+bool PonscripterLabel::soundCacheable(int format, int channel)
+{
+    return !(format & (SOUND_MP3 | SOUND_OGG_STREAMING | SOUND_MIDI)) &&
+           channel != MIX_BGM_CHANNEL;
+}
+
+
+// The click and selection voices play all the time, so they are
+// decoded as soon as the define section has named them, and kept.
+void PonscripterLabel::preloadSoundEffects()
+{
+    if (!audio_open_flag) return;
+
+    std::vector<pstring> names;
+    names.insert(names.end(), clickvoice_file_name,
+                 clickvoice_file_name + CLICKVOICE_NUM);
+    names.insert(names.end(), selectvoice_file_name,
+                 selectvoice_file_name + SELECTVOICE_NUM);
+    names.insert(names.end(), menuselectvoice_file_name,
+                 menuselectvoice_file_name + MENUSELECTVOICE_NUM);
+
+    for (size_t i = 0; i < names.size(); i++) {
+        if (!names[i].length() || sound_cache.contains(names[i])) continue;
+        Mix_Chunk* chunk = loadSoundChunk(names[i]);
+        if (!chunk) continue;
+        sound_cache.add(names[i], chunk, true);
+        Mix_FreeChunk(chunk);
+    }
+}
+
+
+// Reads and decodes an OGG or WAVE file as playSound() would for an
+// effect; NULL if it is neither.
+Mix_Chunk* PonscripterLabel::loadSoundChunk(const pstring& filename)
+{
+    pstring data = script_h.cBR->getFile(filename);
+    if (!data.length()) return NULL;
+
+    SDL_RWops* src = rwops(data);
+    int channels, rate;
+    OVInfo* ovi = openOggVorbis(src, channels, rate);
+    if (ovi) return decodeOggChunk(ovi, channels, rate);
+
+    SDL_RWseek(src, 0, RW_SEEK_SET);
+    return Mix_LoadWAV_RW(src, 1);
+}
+
+
 void PonscripterLabel::playClickVoice()
 {
     if (clickstr_state == CLICK_NEWPAGE) {
@@ -935,14 +1081,7 @@ static size_t oc_read_func(void* ptr, size_t size, size_t nmemb,
 {
     OVInfo* ogg_vorbis_info = (OVInfo*) datasource;
 
-    ogg_int64_t len = size * nmemb;
-    if (ogg_vorbis_info->pos + len > ogg_vorbis_info->length)
-        len = ogg_vorbis_info->length - ogg_vorbis_info->pos;
-
-    memcpy(ptr, ogg_vorbis_info->buf + ogg_vorbis_info->pos, len);
-    ogg_vorbis_info->pos += len;
-
-    return len;
+    return SDL_RWread(ogg_vorbis_info->src, ptr, size, nmemb);
 }
 
 
@@ -950,17 +1089,8 @@ static int oc_seek_func(void* datasource, ogg_int64_t offset, int whence)
 {
     OVInfo* ogg_vorbis_info = (OVInfo*) datasource;
 
-    ogg_int64_t pos = 0;
-    if (whence == 0)
-        pos = offset;
-    else if (whence == 1)
-        pos = ogg_vorbis_info->pos + offset;
-    else if (whence == 2)
-        pos = ogg_vorbis_info->length + offset;
-
-    if (pos < 0 || pos > ogg_vorbis_info->length) return -1;
-
-    ogg_vorbis_info->pos = pos;
+    // stdio's whence values, which RW_SEEK_* share.
+    if (SDL_RWseek(ogg_vorbis_info->src, offset, whence) < 0) return -1;
 
     return 0;
 }
@@ -976,13 +1106,13 @@ static long oc_tell_func(void* datasource)
 {
     OVInfo* ogg_vorbis_info = (OVInfo*) datasource;
 
-    return ogg_vorbis_info->pos;
+    return (long) SDL_RWtell(ogg_vorbis_info->src);
 }
 
 
 #endif
-OVInfo* PonscripterLabel::openOggVorbis(unsigned char* buf, long len,
-                                        int &channels, int &rate)
+OVInfo* PonscripterLabel::openOggVorbis(SDL_RWops* src, int &channels,
+                                        int &rate)
 {
     OVInfo* ovi = NULL;
 
@@ -993,10 +1123,8 @@ OVInfo* PonscripterLabel::openOggVorbis(unsigned char* buf, long len,
     ogg_int64_t fullLength;
     ovi = new OVInfo();
 
-    ovi->buf = buf;
+    ovi->src = src;
     ovi->decoded_length = 0;
-    ovi->length = len;
-    ovi->pos = 0;
     ovi->loop         = -1;
     ovi->loop_start   = -1;
     ovi->loop_end     =  0;
@@ -1094,13 +1222,12 @@ OVInfo* PonscripterLabel::openOggVorbis(unsigned char* buf, long len,
 
 int PonscripterLabel::closeOggVorbis(OVInfo* ovi)
 {
-    if (ovi->buf) {
-        ovi->buf = NULL;
+    if (ovi->src) {
 #ifdef USE_OGG_VORBIS
-        ovi->length = 0;
-        ovi->pos = 0;
         ov_clear(&ovi->ovf);
 #endif
+        SDL_RWclose(ovi->src);
+        ovi->src = NULL;
     }
 
     if (ovi->cvt.buf) {
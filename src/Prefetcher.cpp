@@ -0,0 +1,673 @@
+/* -*- C++ -*-
+ *
+ *  Prefetcher.cpp - Background loading of the images and sounds the
+ *                   script is about to use
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#include "Prefetcher.h"
+#include "ScriptHandler.h"
+#include "ArchiveIndex.h"
+#include "ArchiveStream.h"
+#include "Profiler.h"
+#include <SDL_image.h>
+#include <ctype.h>
+#include <limits.h>
+#include <string.h>
+
+// Threads used by preload(); the scan ahead only ever needs one.
+#define MAX_WORKERS 8
+
+// Commands that load a file, and which of their arguments names it.
+static const struct {
+    const char* name;
+    int arg;
+    bool image;
+} asset_commands[] = {
+    { "bg",        0, true  },
+    { "ld",        1, true  },
+    { "lsp",       1, true  },
+    { "lsp2",      1, true  },
+    { "lsph",      1, true  },
+    { "lsph2",     1, true  },
+    { "bgm",       0, false },
+    { "bgmonce",   0, false },
+    { "dwave",     1, false },
+    { "dwaveload", 1, false },
+    { "dwaveloop", 1, false },
+    { "mp3",       0, false },
+    { "mp3loop",   0, false },
+    { "mp3save",   0, false },
+    { "wave",      0, false },
+    { "waveloop",  0, false },
+    { NULL,        0, false }
+};
+
+
+// Argument n of a command whose arguments start at p, if it is a
+// string literal.
+static bool literalArg(const char* p, const char* end, int n, pstring& value)
+{
+    for (;;) {
+        while (p < end && (*p == ' ' || *p == '\t')) ++p;
+        if (n == 0) {
+            if (p >= end || *p != '"') return false;
+            const char* start = ++p;
+            while (p < end && *p != '"') ++p;
+            if (p >= end) return false;
+            value = pstring(start, p - start);
+            return true;
+        }
+
+        bool in_string = false;
+        while (p < end && (in_string || *p != ',')) {
+            if (*p == '"') in_string = !in_string;
+            ++p;
+        }
+        if (p >= end) return false;
+        ++p;
+        --n;
+    }
+}
+
+
+// The worker's loaders.  Both go through the shared reader, which
+// can be read from any number of threads at once (see DirectReader).
+static SDL_Surface* loadImageFile(const pstring& file_name)
+{
+    BaseReader* reader = ScriptHandler::cBR;
+
+    SDL_Surface* image = reader->getImage(file_name);
+    if (image) return image;
+
+    const unsigned char* view;
+    size_t length;
+    if (reader->getFileView(file_name, &view, &length))
+        return IMG_Load_RW(SDL_RWFromConstMem(view, length), 1);
+
+    pstring dat = reader->getFile(file_name);
+    if (!dat.length()) return NULL;
+    return IMG_Load_RW(rwops(dat), 1);
+}
+
+
+static unsigned char* loadSoundFile(const pstring& file_name, size_t& size)
+{
+    BaseReader* reader = ScriptHandler::cBR;
+
+    size_t length = reader->getFileLength(file_name);
+    if (!length) return NULL;
+    // playSound() streams these instead.
+    if (length > ArchiveStream::MIN_LENGTH && reader->canReadRange(file_name))
+        return NULL;
+
+    unsigned char* buffer = new unsigned char[length];
+    if (!reader->getFile(file_name, buffer)) {
+        delete[] buffer;
+        return NULL;
+    }
+    size = length;
+    return buffer;
+}
+
+
+Prefetcher::Prefetcher()
+    : lines(0), max_size(DEFAULT_PREFETCH_SIZE),
+      scan_begin(-1), scan_end(-1),
+      mutex(NULL), work_cond(NULL), done_cond(NULL),
+      quit(false), helping(false), cur_size(0), epoch(0), cur_pos(0),
+      loading(0)
+{}
+
+
+Prefetcher::~Prefetcher()
+{
+    stop();
+}
+
+
+void Prefetcher::setLines(int n)
+{
+    lines = n > 0 ? n : 0;
+    if (lines && workers.empty()) start();
+    else if (!lines) stop();
+}
+
+
+void Prefetcher::setBudget(size_t bytes)
+{
+    if (mutex) SDL_LockMutex(mutex);
+    max_size = bytes;
+    if (mutex) {
+        SDL_CondSignal(work_cond);
+        SDL_UnlockMutex(mutex);
+    }
+}
+
+
+// Sets up what the threads share, before the first of them starts.
+void Prefetcher::init()
+{
+    // SDL_image initialises its loaders on first use, which isn't safe
+    // to race with the main thread; do it now.
+    IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG);
+
+    mutex = SDL_CreateMutex();
+    work_cond = SDL_CreateCond();
+    done_cond = SDL_CreateCond();
+    quit = false;
+}
+
+
+void Prefetcher::start()
+{
+    if (!mutex) init();
+
+    addWorkers(1);
+    if (workers.empty()) {
+        stop();
+        lines = 0;
+    }
+}
+
+
+void Prefetcher::addWorkers(int n)
+{
+    while (n-- > 0) {
+        SDL_Thread* worker = SDL_CreateThread(workerMain, "prefetch", this);
+        if (!worker) {
+            fprintf(stderr, "Couldn't start prefetch thread: %s\n",
+                    SDL_GetError());
+            return;
+        }
+        workers.push_back(worker);
+    }
+}
+
+
+void Prefetcher::stop()
+{
+    if (!mutex) return;
+
+    clear();
+
+    SDL_LockMutex(mutex);
+    quit = true;
+    SDL_CondBroadcast(work_cond);
+    SDL_UnlockMutex(mutex);
+
+    for (size_t i = 0; i < workers.size(); i++)
+        SDL_WaitThread(workers[i], NULL);
+    workers.clear();
+
+    SDL_DestroyCond(done_cond);
+    SDL_DestroyCond(work_cond);
+    SDL_DestroyMutex(mutex);
+    done_cond = work_cond = NULL;
+    mutex = NULL;
+}
+
+
+void Prefetcher::clear()
+{
+    scan_begin = scan_end = -1;
+    line_ends.clear();
+    if (!mutex) return;
+
+    SDL_LockMutex(mutex);
+    queue.clear();
+    while (loading) SDL_CondWait(done_cond, mutex);
+
+    for (items_t::iterator it = items.begin(); it != items.end(); ++it) {
+        if (it->second.surface) SDL_FreeSurface(it->second.surface);
+        delete[] it->second.buffer;
+    }
+    items.clear();
+    ready.clear();
+    cur_size = 0;
+    ++epoch;
+    SDL_UnlockMutex(mutex);
+}
+
+
+void Prefetcher::scan(const char* buf, int length, int pos)
+{
+    if (!lines || pos < 0 || pos > length) return;
+
+    // Anything outside the lines we've looked at means a jump.
+    if (pos < scan_begin || pos > scan_end) restart(pos);
+
+    int passed = -1;
+    while (!line_ends.empty() && line_ends.front() <= pos) {
+        passed = scan_begin = line_ends.front();
+        line_ends.pop_front();
+    }
+    if (passed >= 0) {
+        SDL_LockMutex(mutex);
+        cur_pos = passed;
+        SDL_CondSignal(work_cond);
+        SDL_UnlockMutex(mutex);
+    }
+
+    while ((int) line_ends.size() < lines && scan_end < length) {
+        const char* p = buf + scan_end;
+        const char* nl = (const char*) memchr(p, 0x0a, length - scan_end);
+        int end = nl ? nl - buf + 1 : length;
+        scanLine(p, buf + end, end);
+        line_ends.push_back(end);
+        scan_end = end;
+    }
+}
+
+
+// Drop what was queued for the old position.  Files already loaded
+// are kept in case the script comes back to them, but may be evicted
+// to make room for new ones.
+void Prefetcher::restart(int pos)
+{
+    line_ends.clear();
+    scan_begin = scan_end = pos;
+
+    SDL_LockMutex(mutex);
+    ++epoch;
+    cur_pos = pos;
+    queue.clear();
+    items_t::iterator it = items.begin();
+    while (it != items.end()) {
+        if (it->second.state == QUEUED || it->second.state == FAILED)
+            items.erase(it++);
+        else
+            ++it;
+    }
+    SDL_CondSignal(work_cond);
+    SDL_UnlockMutex(mutex);
+}
+
+
+void Prefetcher::scanLine(const char* p, const char* end, int offset)
+{
+    // Statements are separated by colons, and a semicolon starts a
+    // comment, except inside strings.
+    const char* statement = p;
+    bool in_string = false;
+    for (; p < end; ++p) {
+        if (*p == '"')
+            in_string = !in_string;
+        else if (!in_string && (*p == ':' || *p == ';' || *p == 0x0a)) {
+            scanStatement(statement, p, offset);
+            if (*p != ':') return;
+            statement = p + 1;
+        }
+    }
+    scanStatement(statement, end, offset);
+}
+
+
+void Prefetcher::scanStatement(const char* p, const char* end, int offset)
+{
+    // After an if or notif, any word of the condition might be the
+    // start of the command.
+    bool conditional = false;
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t')) ++p;
+        const char* word = p;
+        while (p < end && (isalnum((unsigned char) *p) || *p == '_')) ++p;
+
+        pstring cmd(word, p - word);
+        cmd.tolower();
+        if (cmd == "if" || cmd == "notif") {
+            conditional = true;
+        }
+        else if (cmd.length()) {
+            for (int i = 0; asset_commands[i].name; ++i) {
+                if (cmd != asset_commands[i].name) continue;
+
+                pstring arg;
+                if (!literalArg(p, end, asset_commands[i].arg, arg))
+                    return;
+                if (!asset_commands[i].image) {
+                    request(SOUND, arg, offset);
+                    return;
+                }
+                pstring file_name, mask_file_name;
+                if (cmd == "bg" && (arg == "white" || arg == "black"))
+                    return;
+                if (imageFileName(arg, file_name, mask_file_name)) {
+                    request(IMAGE, file_name, offset);
+                    if (mask_file_name.length())
+                        request(IMAGE, mask_file_name, offset);
+                }
+                return;
+            }
+        }
+        if (!conditional) return;
+
+        bool in_string = false;
+        while (p < end && (in_string || (*p != ' ' && *p != '\t'))) {
+            if (*p == '"') in_string = !in_string;
+            ++p;
+        }
+    }
+}
+
+
+void Prefetcher::request(Kind kind, const pstring& file_name, int offset)
+{
+    pstring key = makeKey(kind, file_name);
+
+    SDL_LockMutex(mutex);
+    items_t::iterator it = items.find(key);
+    if (it != items.end()) {
+        // Wanted again; keep it from being evicted.
+        it->second.epoch = epoch;
+        it->second.offset = offset;
+    }
+    else {
+        Item& item = items[key];
+        item.file_name = file_name;
+        item.kind = kind;
+        item.state = QUEUED;
+        item.epoch = epoch;
+        item.offset = offset;
+        item.pinned = false;
+        item.surface = NULL;
+        item.buffer = NULL;
+        item.size = 0;
+        queue.push_back(key);
+        SDL_CondSignal(work_cond);
+    }
+    SDL_UnlockMutex(mutex);
+}
+
+
+void Prefetcher::preload(const std::vector<pstring>& filenames)
+{
+    if (filenames.empty()) return;
+    if (!mutex) init();
+
+    // Helper threads load the images, alongside the worker if
+    // prefetching is on, and exit once they are done, so a one-off
+    // preload leaves no threads running.
+    int cpus = SDL_GetCPUCount();
+    if (cpus > MAX_WORKERS) cpus = MAX_WORKERS;
+    std::vector<SDL_Thread*> helpers;
+    SDL_LockMutex(mutex);
+    helping = true;
+    while ((int) (workers.size() + helpers.size()) < cpus) {
+        SDL_Thread* helper = SDL_CreateThread(helperMain, "preload", this);
+        if (!helper) break;
+        helpers.push_back(helper);
+    }
+    if (workers.empty() && helpers.empty()) {
+        // Nothing to load them; the caller will.
+        helping = false;
+        SDL_UnlockMutex(mutex);
+        return;
+    }
+
+    std::vector<pstring> keys;
+    for (size_t i = 0; i < filenames.size(); i++) {
+        pstring key = makeKey(IMAGE, filenames[i]);
+        items_t::iterator it = items.find(key);
+        if (it == items.end()) {
+            Item& item = items[key];
+            item.file_name = filenames[i];
+            item.kind = IMAGE;
+            item.state = QUEUED;
+            item.surface = NULL;
+            item.buffer = NULL;
+            item.size = 0;
+            it = items.find(key);
+        }
+        else if (it->second.pinned) {
+            continue; // named twice
+        }
+        it->second.epoch = epoch;
+        it->second.offset = INT_MAX;
+        it->second.pinned = true;
+        keys.push_back(key);
+    }
+    // Ahead of anything the scan has asked for; a key queued twice is
+    // skipped once it has been loaded.
+    queue.insert(queue.begin(), keys.begin(), keys.end());
+    SDL_CondBroadcast(work_cond);
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        items_t::iterator it = items.find(keys[i]);
+        while (it->second.state == QUEUED || it->second.state == LOADING) {
+            SDL_CondWait(done_cond, mutex);
+            it = items.find(keys[i]);
+        }
+    }
+    // From here on they compete for the budget like anything else.
+    for (size_t i = 0; i < keys.size(); i++) {
+        items_t::iterator it = items.find(keys[i]);
+        it->second.pinned = false;
+        it->second.offset = cur_pos;
+    }
+    helping = false;
+    SDL_CondBroadcast(work_cond);
+    SDL_UnlockMutex(mutex);
+
+    for (size_t i = 0; i < helpers.size(); i++)
+        SDL_WaitThread(helpers[i], NULL);
+}
+
+
+SDL_Surface* Prefetcher::takeImage(const pstring& filename)
+{
+    if (!mutex) return NULL;
+
+    SDL_LockMutex(mutex);
+    SDL_Surface* surface = NULL;
+    items_t::iterator it = claim(IMAGE, filename);
+    Profiler::count(it != items.end() ? Profiler::PREFETCH_HIT
+                                      : Profiler::PREFETCH_MISS);
+    if (it != items.end()) {
+        surface = it->second.surface;
+        it->second.surface = NULL;
+        release(it);
+    }
+    SDL_UnlockMutex(mutex);
+
+    return surface;
+}
+
+
+bool Prefetcher::takeSound(const pstring& filename, unsigned char** buffer,
+                           long* length)
+{
+    if (!mutex) return false;
+
+    SDL_LockMutex(mutex);
+    items_t::iterator it = claim(SOUND, filename);
+    bool found = it != items.end();
+    Profiler::count(found ? Profiler::PREFETCH_HIT : Profiler::PREFETCH_MISS);
+    if (found) {
+        *buffer = it->second.buffer;
+        *length = it->second.size;
+        it->second.buffer = NULL;
+        release(it);
+    }
+    SDL_UnlockMutex(mutex);
+
+    return found;
+}
+
+
+// Find a loaded item, waiting for it if the worker is on it.  Items
+// that haven't been loaded are forgotten, since the caller is about to
+// load the file itself.  Call with the mutex held.
+Prefetcher::items_t::iterator Prefetcher::claim(Kind kind,
+                                                const pstring& filename)
+{
+    pstring key = makeKey(kind, filename);
+    items_t::iterator it = items.find(key);
+    while (it != items.end() && it->second.state == LOADING) {
+        SDL_CondWait(done_cond, mutex);
+        it = items.find(key);
+    }
+    if (it == items.end() || it->second.state == READY) return it;
+
+    items.erase(it);
+    return items.end();
+}
+
+
+// Forget a loaded item, freeing whatever hasn't been taken from it.
+// Call with the mutex held.
+void Prefetcher::release(items_t::iterator it)
+{
+    cur_size -= it->second.size;
+    if (it->second.surface) SDL_FreeSurface(it->second.surface);
+    delete[] it->second.buffer;
+    ready.remove(it->first);
+    items.erase(it);
+    SDL_CondSignal(work_cond);
+}
+
+
+// Evict items the script has moved past until there is room for more.
+// Call with the mutex held.
+bool Prefetcher::makeRoom()
+{
+    while (cur_size >= max_size) {
+        std::list<pstring>::iterator r = ready.begin();
+        for (; r != ready.end(); ++r) {
+            const Item& item = items[*r];
+            if (item.epoch != epoch || item.offset <= cur_pos) break;
+        }
+        if (r == ready.end()) return false;
+        release(items.find(*r));
+    }
+    return true;
+}
+
+
+pstring Prefetcher::makeKey(Kind kind, const pstring& file_name)
+{
+    pstring key = kind == IMAGE ? "i:" : "s:";
+    key += ArchiveIndex::normalize(file_name);
+    return key;
+}
+
+
+// Pull the file names out of a sprite tag string, as
+// PonscripterLabel::parseTaggedString() would.  Text sprites and
+// rectangles don't have one.
+bool Prefetcher::imageFileName(const pstring& tag, pstring& file_name,
+                               pstring& mask_file_name)
+{
+    const char* p = tag;
+    if (*p == ':') {
+        while (*++p == ' ') ;
+        if (*p == 'b') ++p;
+        if (*p == 'f') ++p;
+        if (*p == 's' || *p == 'S') return false;
+        if (*p == 'm') {
+            const char* start = ++p;
+            while (*p && *p != ';') ++p;
+            if (*p) mask_file_name = pstring(start, p - start);
+        }
+        while (*p && *p != ';') ++p;
+        if (!*p) return false;
+        ++p;
+    }
+    if (!*p || *p == '>' || *p == '#') return false;
+
+    // Only the first part of a composite image is a plain file.
+    const char* amp = strchr(p, '&');
+    file_name = amp ? pstring(p, amp - p) : pstring(p);
+    return file_name.length() > 0;
+}
+
+
+void Prefetcher::work(bool helper)
+{
+    SDL_LockMutex(mutex);
+    while (!quit && (!helper || helping)) {
+        if (queue.empty()) {
+            SDL_CondWait(work_cond, mutex);
+            continue;
+        }
+
+        items_t::iterator it = items.find(queue.front());
+        if (it == items.end() || it->second.state != QUEUED) {
+            queue.pop_front();
+            continue;
+        }
+        if (!it->second.pinned && !makeRoom()) {
+            SDL_CondWait(work_cond, mutex);
+            continue;
+        }
+
+        pstring key = queue.front();
+        queue.pop_front();
+
+        it->second.state = LOADING;
+        Kind kind = it->second.kind;
+        pstring file_name = it->second.file_name;
+        ++loading;
+        SDL_UnlockMutex(mutex);
+
+        SDL_Surface* surface = NULL;
+        unsigned char* buffer = NULL;
+        size_t size = 0;
+        {
+            Profiler::Scope scope(Profiler::PREFETCH);
+            if (kind == IMAGE) {
+                surface = loadImageFile(file_name);
+                if (surface) size = surface->pitch * surface->h;
+            }
+            else {
+                buffer = loadSoundFile(file_name, size);
+            }
+        }
+
+        SDL_LockMutex(mutex);
+        --loading;
+        // Nothing removes an item while it is loading.
+        Item& item = items[key];
+        item.surface = surface;
+        item.buffer = buffer;
+        item.size = size;
+        if (surface || buffer) {
+            item.state = READY;
+            ready.push_back(key);
+            cur_size += size;
+        }
+        else {
+            item.state = FAILED;
+        }
+        SDL_CondBroadcast(done_cond);
+    }
+    SDL_UnlockMutex(mutex);
+}
+
+
+int Prefetcher::workerMain(void* data)
+{
+    ((Prefetcher*) data)->work(false);
+    return 0;
+}
+
+
+int Prefetcher::helperMain(void* data)
+{
+    ((Prefetcher*) data)->work(true);
+    return 0;
+}
@@ -0,0 +1,134 @@
+/* -*- C++ -*-
+ *
+ *  Prefetcher.h - Background loading of the images and sounds the
+ *                 script is about to use
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __PREFETCHER_H__
+#define __PREFETCHER_H__
+
+#include <SDL.h>
+#include <deque>
+#include <list>
+#include <vector>
+#include "defs.h"
+
+#define DEFAULT_PREFETCH_SIZE (32 * 1024 * 1024)
+
+// Reads the script a few lines ahead of the interpreter, picks out
+// commands that load an image or sound from a literal file name (bg,
+// ld, lsp, mp3, wave, dwave and their variants), and has a worker
+// thread read, decompress and decode those files while the main thread
+// is busy elsewhere.  createSurfaceFromFile() and playSound() then take
+// the result instead of loading the file themselves.
+//
+// This is only a guess at what the script will do: anything that is
+// not wanted after all is dropped once the interpreter has gone past
+// it, or when it jumps somewhere else.
+//
+// preload() uses the same machinery to decode a known set of images
+// (everything a save file shows) on several threads at once.
+class Prefetcher {
+public:
+    Prefetcher();
+    ~Prefetcher();
+
+    // Number of lines to look ahead; 0 (the default) turns prefetching
+    // off.
+    void setLines(int n);
+    // Maximum number of bytes of decoded data to hold.
+    void setBudget(size_t bytes);
+
+    // Called before each command with the script buffer and the
+    // offset of the command that follows it.
+    void scan(const char* buf, int length, int pos);
+
+    // Forget everything, waiting for the worker to finish the file it
+    // is on.  Must be called before the archive reader is replaced.
+    void clear();
+
+    // Decode the named images on a pool of worker threads, returning
+    // once they are all ready to be taken.  Works whether or not
+    // prefetching is turned on; only the prefetch worker, if there is
+    // one, is left running.
+    void preload(const std::vector<pstring>& filenames);
+
+    // Hand over a prefetched surface or file, or return NULL/false if
+    // there isn't one.  Waits if the file is being loaded right now.
+    SDL_Surface* takeImage(const pstring& filename);
+    bool takeSound(const pstring& filename, unsigned char** buffer,
+                   long* length);
+
+private:
+    enum Kind  { IMAGE, SOUND };
+    enum State { QUEUED, LOADING, READY, FAILED };
+    struct Item {
+        pstring file_name;
+        Kind kind;
+        State state;
+        int epoch;
+        int offset; // end of the line that asked for it
+        bool pinned; // wanted by preload(); loaded regardless of budget
+        SDL_Surface* surface;
+        unsigned char* buffer;
+        size_t size;
+    };
+    typedef dictionary<pstring, Item>::t items_t;
+
+    int lines;
+    size_t max_size;
+
+    // Main thread only: the script lines currently looked at.
+    int scan_begin, scan_end;
+    std::deque<int> line_ends;
+
+    // Shared with the worker; guarded by mutex.
+    SDL_mutex* mutex;
+    SDL_cond*  work_cond;
+    SDL_cond*  done_cond;
+    std::vector<SDL_Thread*> workers;
+    bool quit;
+    bool helping; // preload()'s extra threads run while this is set
+    items_t items;
+    std::deque<pstring> queue;
+    std::list<pstring> ready; // oldest first
+    size_t cur_size;
+    int epoch, cur_pos, loading;
+
+    void init();
+    void start();
+    void stop();
+    void addWorkers(int n);
+    void restart(int pos);
+    void scanLine(const char* p, const char* end, int offset);
+    void scanStatement(const char* p, const char* end, int offset);
+    void request(Kind kind, const pstring& file_name, int offset);
+    items_t::iterator claim(Kind kind, const pstring& filename);
+    void release(items_t::iterator it);
+    bool makeRoom();
+
+    static pstring makeKey(Kind kind, const pstring& file_name);
+    static bool imageFileName(const pstring& tag, pstring& file_name,
+                              pstring& mask_file_name);
+
+    void work(bool helper);
+    static int workerMain(void* data);
+    static int helperMain(void* data);
+};
+
+#endif // __PREFETCHER_H__
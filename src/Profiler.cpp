@@ -0,0 +1,175 @@
+/* -*- C++ -*-
+ *
+ *  Profiler.cpp - Scoped timers and counters for the hot paths
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#include "Profiler.h"
+#include <algorithm>
+#include <vector>
+
+// Milliseconds between summaries.
+#define SUMMARY_INTERVAL 5000
+
+static const char* stage_names[Profiler::NUM_STAGES] = {
+    "frame", "script", "refreshSurface", "effect", "loadImage",
+    "playSound", "glyph", "updateTexture", "prefetch"
+};
+
+static const char* counter_names[Profiler::NUM_COUNTERS / 2] = {
+    "image cache", "glyph cache", "prefetch", "sound cache"
+};
+
+SDL_atomic_t Profiler::enabled = { 0 };
+
+// Everything below is guarded by mutex: scopes can end on the prefetch
+// thread and archives can be read from it.
+static SDL_mutex* mutex = NULL;
+static FILE* trace = NULL;
+static Uint64 origin, frequency;
+static unsigned long frame_no;
+static Uint32 last_summary;
+static std::vector<float> samples[Profiler::NUM_STAGES];
+static unsigned long counters[Profiler::NUM_COUNTERS];
+static dictionary<pstring, unsigned long>::t bytes_read;
+
+
+bool Profiler::start(const char* trace_file)
+{
+    trace = fopen(trace_file, "w");
+    if (!trace) {
+        fprintf(stderr, "Failed to open %s to write the profile to\n",
+                trace_file);
+        return false;
+    }
+    fputs("[\n", trace);
+
+    mutex = SDL_CreateMutex();
+    origin = SDL_GetPerformanceCounter();
+    frequency = SDL_GetPerformanceFrequency();
+    frame_no = 0;
+    last_summary = SDL_GetTicks();
+    SDL_AtomicSet(&enabled, 1);
+    return true;
+}
+
+
+void Profiler::stop()
+{
+    if (!on()) return;
+
+    SDL_LockMutex(mutex);
+    SDL_AtomicSet(&enabled, 0);
+    summary(stdout);
+    // A closing event, so that the array needs no trailing comma.
+    fprintf(trace, "{\"name\":\"end\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%.3f,"
+            "\"pid\":1,\"tid\":0}\n]\n",
+            (SDL_GetPerformanceCounter() - origin) * 1e6 / frequency);
+    fclose(trace);
+    trace = NULL;
+    SDL_UnlockMutex(mutex);
+    // The mutex is left alone: another thread may be about to take it.
+}
+
+
+void Profiler::frame()
+{
+    if (!on()) return;
+
+    SDL_LockMutex(mutex);
+    if (!on()) {
+        SDL_UnlockMutex(mutex);
+        return;
+    }
+    if (++frame_no % 64 == 0) fflush(trace);
+
+    Uint32 now = SDL_GetTicks();
+    if (now - last_summary >= SUMMARY_INTERVAL) {
+        summary(stdout);
+        last_summary = now;
+    }
+    SDL_UnlockMutex(mutex);
+}
+
+
+void Profiler::record(Stage stage, Uint64 begin)
+{
+    Uint64 end = SDL_GetPerformanceCounter();
+
+    SDL_LockMutex(mutex);
+    if (on()) {
+        double ts = (begin - origin) * 1e6 / frequency;
+        double dur = (end - begin) * 1e6 / frequency;
+        fprintf(trace, "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,"
+                "\"dur\":%.3f,\"pid\":1,\"tid\":%lu,"
+                "\"args\":{\"frame\":%lu}},\n",
+                stage_names[stage], ts, dur,
+                (unsigned long) SDL_ThreadID(), frame_no);
+        samples[stage].push_back(dur / 1000);
+    }
+    SDL_UnlockMutex(mutex);
+}
+
+
+void Profiler::add(Counter counter, unsigned long n)
+{
+    SDL_LockMutex(mutex);
+    if (on()) counters[counter] += n;
+    SDL_UnlockMutex(mutex);
+}
+
+
+void Profiler::addBytes(const pstring& source, size_t bytes)
+{
+    SDL_LockMutex(mutex);
+    if (on()) bytes_read[source] += bytes;
+    SDL_UnlockMutex(mutex);
+}
+
+
+// Print and reset the figures gathered since the last summary.  Call
+// with the mutex held.
+void Profiler::summary(FILE* fp)
+{
+    fprintf(fp, "profile: frame %lu\n", frame_no);
+    for (int i = 0; i < NUM_STAGES; i++) {
+        std::vector<float>& s = samples[i];
+        if (s.empty()) continue;
+
+        std::sort(s.begin(), s.end());
+        fprintf(fp, "  %-16s %7lu calls  p50 %8.3f ms  p99 %8.3f ms  "
+                "max %8.3f ms\n", stage_names[i], (unsigned long) s.size(),
+                s[s.size() / 2], s[s.size() * 99 / 100], s.back());
+        s.clear();
+    }
+
+    for (int i = 0; i < NUM_COUNTERS; i += 2) {
+        unsigned long hits = counters[i], total = hits + counters[i + 1];
+        if (!total) continue;
+        fprintf(fp, "  %-16s %7lu of %lu hit (%.1f%%)\n",
+                counter_names[i / 2], hits, total, hits * 100.0 / total);
+        counters[i] = counters[i + 1] = 0;
+    }
+
+    dictionary<pstring, unsigned long>::t::iterator it;
+    for (it = bytes_read.begin(); it != bytes_read.end(); ++it)
+        fprintf(fp, "  read %lu KB from %s\n", it->second / 1024,
+                (const char*) it->first);
+    bytes_read.clear();
+
+    fflush(fp);
+}
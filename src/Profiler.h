@@ -0,0 +1,101 @@
+/* -*- C++ -*-
+ *
+ *  Profiler.h - Scoped timers and counters for the hot paths
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include <SDL.h>
+#include <stdio.h>
+#include "defs.h"
+
+// Built-in timing of the main stages of the interpreter, switched on
+// with --profile.  Every timed scope is written to a trace file in the
+// Chrome trace event format (load it in chrome://tracing or Perfetto),
+// and every few seconds a summary of the median and 99th percentile
+// time of each stage, the bytes read from each archive and the cache
+// hit rates is printed to stdout.
+//
+// When profiling is off a Scope costs one atomic read of a flag.
+class Profiler {
+public:
+    enum Stage {
+        FRAME,
+        SCRIPT,
+        REFRESH,
+        EFFECT,
+        IMAGE_LOAD,
+        AUDIO_LOAD,
+        GLYPH,
+        TEXTURE_UPLOAD,
+        PREFETCH,
+        NUM_STAGES
+    };
+
+    enum Counter {
+        IMAGE_CACHE_HIT,
+        IMAGE_CACHE_MISS,
+        GLYPH_CACHE_HIT,
+        GLYPH_CACHE_MISS,
+        PREFETCH_HIT,
+        PREFETCH_MISS,
+        SOUND_CACHE_HIT,
+        SOUND_CACHE_MISS,
+        NUM_COUNTERS
+    };
+
+    static bool start(const char* trace_file);
+    static void stop();
+    static bool active() { return on(); }
+
+    // Called once per frame; prints the summary when it is due.
+    static void frame();
+
+    static void count(Counter counter) {
+        if (on()) add(counter, 1);
+    }
+    static void countBytes(const pstring& source, size_t bytes) {
+        if (on()) addBytes(source, bytes);
+    }
+
+    class Scope {
+    public:
+        Scope(Stage stage)
+            : stage(stage), begin(on() ? SDL_GetPerformanceCounter() : 0)
+        {}
+        ~Scope() { if (begin) record(stage, begin); }
+    private:
+        Stage stage;
+        Uint64 begin;
+    };
+    friend class Scope;
+
+private:
+    // Read from any thread without the mutex, so atomic; the mutex and
+    // trace file are set up before it is set.
+    static SDL_atomic_t enabled;
+    static bool on() { return SDL_AtomicGet(&enabled) != 0; }
+
+    static void record(Stage stage, Uint64 begin);
+    static void add(Counter counter, unsigned long n);
+    static void addBytes(const pstring& source, size_t bytes);
+    static void summary(FILE* fp);
+};
+
+#endif // __PROFILER_H__
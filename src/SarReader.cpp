@@ -24,11 +24,13 @@
  */
 
 #include "SarReader.h"
+#include "Profiler.h"
 #define WRITE_LENGTH 4096
 
 SarReader::SarReader(DirPaths *path, const unsigned char* key_table)
     : DirectReader(path, key_table),
-      num_of_sar_archives(0)
+      num_of_sar_archives(0),
+      misses_mutex(SDL_CreateMutex())
 {
     root_archive_info   = last_archive_info = &archive_info;
 }
@@ -37,21 +39,25 @@ SarReader::SarReader(DirPaths *path, const unsigned char* key_table)
 SarReader::~SarReader()
 {
     close();
+    SDL_DestroyMutex(misses_mutex);
 }
 
 
 int SarReader::open(const pstring& name, int archive_type)
 {
-    ArchiveInfo* info = new ArchiveInfo();
+    FILE* fp = fileopen(name, "rb");
+    if (fp == NULL) return -1;
 
-    if ((info->file_handle = fileopen(name, "rb")) == NULL) {
-        delete info;
-        return -1;
-    }
+    // "arc" may name a ponspack archive too.
+    if (PackedArchive::isPacked(fp)) return addPacked(fp, name) ? 0 : -1;
 
+    ArchiveInfo* info = new ArchiveInfo();
+    info->file_handle = fp;
     info->file_name = name;
 
     readArchive(info);
+    info->map.map(info->file_handle);
+    file_index.add(info);
 
     last_archive_info->next = info;
     last_archive_info = last_archive_info->next;
@@ -61,24 +67,38 @@ int SarReader::open(const pstring& name, int archive_type)
 }
 
 
+bool SarReader::addPacked(FILE* fp, const pstring& name)
+{
+    PackedArchive* pa = new PackedArchive();
+    if (!pa->open(fp, name)) {
+        delete pa;
+        return false;
+    }
+
+    packed_archives.push_back(pa);
+    return true;
+}
+
+
 int SarReader::readArchive(ArchiveInfo* ai, int archive_type)
 {
     unsigned int i = 0;
+    Stream s(ai->file_handle, NULL, 0);
 
     /* Read header */
     if (archive_type == ARCHIVE_TYPE_NS2) {
-        i = readChar(ai->file_handle); // FIXME: for what ?
+        i = readChar(s); // FIXME: for what ?
     }
 
     if (archive_type == ARCHIVE_TYPE_NS3) {
-        i = readChar(ai->file_handle); // FIXME: for what ?
-        i = readChar(ai->file_handle); // FIXME: for what ?
+        i = readChar(s); // FIXME: for what ?
+        i = readChar(s); // FIXME: for what ?
     }
 
-    ai->num_of_files = readShort(ai->file_handle);
+    ai->num_of_files = readShort(s);
     ai->fi_list = new FileInfo[ai->num_of_files];
 
-    ai->base_offset = readLong(ai->file_handle);
+    ai->base_offset = readLong(s);
     if (archive_type == ARCHIVE_TYPE_NS2)
         ai->base_offset++;
 
@@ -86,11 +106,11 @@ int SarReader::readArchive(ArchiveInfo* ai, int archive_type)
         ai->base_offset += 2;
 
     for (i = 0; i < ai->num_of_files; i++) {
-        unsigned char ch;
+        int ch;
 
 	pstring name;
-        while ((ch = key_table[fgetc(ai->file_handle)]))
-            name += ch;
+        while ((ch = readChar(s)) > 0)
+            name += (char) ch;
 
 	// Store names with the internal encoding -- transliterate to
 	// UTF-8 if necessary.
@@ -109,15 +129,15 @@ int SarReader::readArchive(ArchiveInfo* ai, int archive_type)
 	}	
 
         if (archive_type >= ARCHIVE_TYPE_NSA)
-            ai->fi_list[i].compression_type = readChar(ai->file_handle);
+            ai->fi_list[i].compression_type = readChar(s);
         else
             ai->fi_list[i].compression_type = NO_COMPRESSION;
 
-        ai->fi_list[i].offset = readLong(ai->file_handle) + ai->base_offset;
-        ai->fi_list[i].length = readLong(ai->file_handle);
+        ai->fi_list[i].offset = readLong(s) + ai->base_offset;
+        ai->fi_list[i].length = readLong(s);
 
         if (archive_type >= ARCHIVE_TYPE_NSA) {
-            ai->fi_list[i].original_length = readLong(ai->file_handle);
+            ai->fi_list[i].original_length = readLong(s);
         }
         else {
             ai->fi_list[i].original_length = ai->fi_list[i].length;
@@ -134,10 +154,13 @@ int SarReader::readArchive(ArchiveInfo* ai, int archive_type)
         // (checking every compressed file in this function caused
         //  a massive slowdown at program start when an archive had
         //  many compressed images...)
+        // The index isn't changed after this, so that it can be read
+        // from several threads; getFileLengthSub() reads the length
+        // each time it's asked.
         if ( (ai->fi_list[i].compression_type == NBZ_COMPRESSION) ||
               (ai->fi_list[i].compression_type == SPB_COMPRESSION) ){
             ai->fi_list[i].original_length = 0;
-            //ai->fi_list[i].original_length = getDecompressedFileLength( ai->fi_list[i].compression_type, ai->file_handle, ai->fi_list[i].offset );
+            //ai->fi_list[i].original_length = getDecompressedFileLength( ai->fi_list[i].compression_type, ai->file_handle, &ai->map, ai->fi_list[i].offset );
         }
     }
 
@@ -156,6 +179,15 @@ int SarReader::close()
     }
     num_of_sar_archives = 0;
 
+    for (size_t i = 0; i < packed_archives.size(); i++)
+        delete packed_archives[i];
+    packed_archives.clear();
+
+    file_index.clear();
+    SDL_LockMutex(misses_mutex);
+    direct_misses.clear();
+    SDL_UnlockMutex(misses_mutex);
+
     return 0;
 }
 
@@ -174,72 +206,127 @@ int SarReader::getNumFiles()
 }
 
 
-int SarReader::getIndexFromFile(ArchiveInfo* ai, pstring file_name)
+// Loose files override archived ones, so every lookup has to check
+// the filesystem first.  That probe walks every archive path (and, on
+// case-sensitive systems, every directory listing along the way), so
+// remember the names that aren't there.
+bool SarReader::knownMissing(const pstring& key)
 {
-    replace_ascii(file_name, '/', '\\');
-    
-    unsigned int i;
-    for (i = 0; i < ai->num_of_files; i++) {
-	if (file_name.caselessEqual(ai->fi_list[i].name)) break;
-    }
+    SDL_LockMutex(misses_mutex);
+    bool ret = direct_misses.find(key) != direct_misses.end();
+    SDL_UnlockMutex(misses_mutex);
+    return ret;
+}
+
 
-    return i;
+void SarReader::addMissing(const pstring& key)
+{
+    SDL_LockMutex(misses_mutex);
+    direct_misses.insert(key);
+    SDL_UnlockMutex(misses_mutex);
 }
 
 
-size_t SarReader::getFileLength(const pstring& file_name)
+size_t SarReader::getDirectFileLength(const pstring& key,
+                                      const pstring& file_name)
 {
-    size_t ret;
-    if ((ret = DirectReader::getFileLength(file_name))) return ret;
+    if (knownMissing(key)) return 0;
 
-    ArchiveInfo* info = archive_info.next;
-    unsigned int j = 0;
-    for (int i = 0; i < num_of_sar_archives; i++) {
-        j = getIndexFromFile(info, file_name);
-        if (j != info->num_of_files) break;
+    size_t ret = DirectReader::getFileLength(file_name);
+    if (!ret) addMissing(key);
 
-        info = info->next;
-    }
+    return ret;
+}
 
-    if (!info) return 0;
 
-    if ( info->fi_list[j].original_length != 0 ){
-        return info->fi_list[j].original_length;
+size_t SarReader::getFileLengthSub(ArchiveInfo* ai, unsigned int i,
+                                   const pstring& file_name)
+{
+    if ( ai->fi_list[i].original_length != 0 ){
+        return ai->fi_list[i].original_length;
     }
 
-    int type = info->fi_list[j].compression_type;
+    int type = ai->fi_list[i].compression_type;
     if ( type == NO_COMPRESSION )
         type = getRegisteredCompressionType( file_name );
     if ( type == NBZ_COMPRESSION || type == SPB_COMPRESSION ) {
-        info->fi_list[j].original_length = getDecompressedFileLength( type, info->file_handle, info->fi_list[j].offset );
+        return getDecompressedFileLength( type, ai->file_handle, &ai->map, ai->fi_list[i].offset );
     }
 
-    return info->fi_list[j].original_length;
+    return 0;
+}
+
+
+size_t SarReader::getFileLength(const pstring& file_name)
+{
+    pstring key = ArchiveIndex::normalize(file_name);
+
+    size_t ret;
+    if ((ret = getDirectFileLength(key, file_name))) return ret;
+
+    unsigned int i;
+    PackedArchive* pa = findPacked(key, i);
+    if (pa) return pa->length(i);
+
+    ArchiveIndex::Location loc;
+    if (!file_index.find(key, loc)) return 0;
+
+    return getFileLengthSub(loc.ai, loc.index, file_name);
 }
 
 
-size_t SarReader::getFileSub(ArchiveInfo* ai, const pstring& file_name,
-			     unsigned char* buf)
+PackedArchive* SarReader::findPacked(const pstring& key,
+                                     unsigned int& index) const
 {
-    unsigned int i = getIndexFromFile(ai, file_name);
-    if (i == ai->num_of_files) return 0;
+    for (size_t i = 0; i < packed_archives.size(); i++)
+        if (packed_archives[i]->find(key, index)) return packed_archives[i];
+
+    return NULL;
+}
+
+
+// Packed data is never under the key table, so the streams are plain.
+size_t SarReader::getPackedFile(PackedArchive* pa, unsigned int i,
+                                unsigned char* buf)
+{
+    Profiler::countBytes(pa->fileName(), pa->storedLength(i));
+
+    if (pa->type(i) != PackedArchive::SPB) return pa->read(i, buf);
+
+    if (!pa->verify(i)) return 0;
+    Stream s(pa->file(), &pa->mapping(), pa->offset(i));
+    s.plain = true;
+    return decodeSPB(s, buf);
+}
+
+
+size_t SarReader::getFileSub(ArchiveInfo* ai, unsigned int i,
+                             const pstring& file_name, unsigned char* buf)
+{
+    Profiler::countBytes(ai->file_name, ai->fi_list[i].length);
 
     int type = ai->fi_list[i].compression_type;
     if (type == NO_COMPRESSION) type = getRegisteredCompressionType(file_name);
 
-    if (type == NBZ_COMPRESSION) {
-        return decodeNBZ(ai->file_handle, ai->fi_list[i].offset, buf);
-    }
-    else if (type == LZSS_COMPRESSION) {
-        return decodeLZSS(ai, i, buf);
+    size_t offset = ai->fi_list[i].offset, ret = ai->fi_list[i].length;
+    if (type == NBZ_COMPRESSION || type == LZSS_COMPRESSION ||
+        type == SPB_COMPRESSION) {
+        Stream s(ai->file_handle, &ai->map, offset);
+        if (type == NBZ_COMPRESSION)
+            return decodeNBZ(s, buf);
+        else if (type == LZSS_COMPRESSION)
+            return decodeLZSS(s, ai->fi_list[i].original_length, buf);
+        else
+            return decodeSPB(s, buf);
     }
-    else if (type == SPB_COMPRESSION) {
-        return decodeSPB(ai->file_handle, ai->fi_list[i].offset, buf);
+
+    if (ai->map.contains(offset, ret)) {
+        decodeKeyTable(buf, ai->map.data() + offset, ret);
+        return ret;
     }
 
-    fseek(ai->file_handle, ai->fi_list[i].offset, SEEK_SET);
-    size_t ret = fread(buf, 1, ai->fi_list[i].length, ai->file_handle);
-    for (size_t j = 0; j < ret; j++) buf[j] = key_table[buf[j]];
+    ret = MappedFile::readAt(ai->file_handle, offset, buf, ret);
+    decodeKeyTable(buf, buf, ret);
 
     return ret;
 }
@@ -248,20 +335,160 @@ size_t SarReader::getFileSub(ArchiveInfo* ai, const pstring& file_name,
 size_t SarReader::getFile(const pstring& file_name, unsigned char* buf,
 			  int* location)
 {
+    pstring key = ArchiveIndex::normalize(file_name);
+
     size_t ret;
-    if ((ret = DirectReader::getFile(file_name, buf, location))) return ret;
+    if (!knownMissing(key)) {
+        if ((ret = DirectReader::getFile(file_name, buf, location)))
+            return ret;
+        addMissing(key);
+    }
 
-    ArchiveInfo* info = archive_info.next;
-    size_t j = 0;
-    for (int i = 0; i < num_of_sar_archives; i++) {
-        if ((j = getFileSub(info, file_name, buf)) > 0) break;
+    if (location) *location = ARCHIVE_TYPE_SAR;
 
-        info = info->next;
+    unsigned int i;
+    PackedArchive* pa = findPacked(key, i);
+    if (pa) return getPackedFile(pa, i, buf);
+
+    ArchiveIndex::Location loc;
+    if (!file_index.find(key, loc)) return 0;
+
+    return getFileSub(loc.ai, loc.index, file_name, buf);
+}
+
+
+bool SarReader::getFileView(const pstring& file_name,
+                            const unsigned char** data, size_t* length,
+                            int* location)
+{
+    pstring key = ArchiveIndex::normalize(file_name);
+    if (getDirectFileLength(key, file_name)) return false;
+
+    unsigned int i;
+    PackedArchive* pa = findPacked(key, i);
+    if (pa) {
+        if (!pa->view(i, data, length)) return false;
+        Profiler::countBytes(pa->fileName(), *length);
+        if (location) *location = ARCHIVE_TYPE_SAR;
+        return true;
+    }
+
+    if (key_table_flag) return false;
+
+    ArchiveIndex::Location loc;
+    if (!file_index.find(key, loc)) return false;
+
+    ArchiveInfo* ai = loc.ai;
+    FileInfo& fi = ai->fi_list[loc.index];
+    int type = fi.compression_type;
+    if (type == NO_COMPRESSION) type = getRegisteredCompressionType(file_name);
+    if (type != NO_COMPRESSION || !ai->map.contains(fi.offset, fi.length))
+        return false;
+
+    Profiler::countBytes(ai->file_name, fi.length);
+    *data = ai->map.data() + fi.offset;
+    *length = fi.length;
+    if (location) *location = ARCHIVE_TYPE_SAR;
+    return true;
+}
+
+
+SDL_Surface* SarReader::getImage(const pstring& file_name, int* location)
+{
+    pstring key = ArchiveIndex::normalize(file_name);
+    if (getDirectFileLength(key, file_name))
+        return DirectReader::getImage(file_name, location);
+
+    unsigned int i;
+    PackedArchive* pa = findPacked(key, i);
+    if (pa) {
+        if (pa->type(i) != PackedArchive::SPB || !pa->verify(i)) return NULL;
+        Profiler::countBytes(pa->fileName(), pa->storedLength(i));
+        if (location) *location = ARCHIVE_TYPE_SAR;
+        Stream s(pa->file(), &pa->mapping(), pa->offset(i));
+        s.plain = true;
+        return decodeSPBImage(s);
     }
 
+    ArchiveIndex::Location loc;
+    if (!file_index.find(key, loc)) return NULL;
+
+    ArchiveInfo* ai = loc.ai;
+    FileInfo& fi = ai->fi_list[loc.index];
+    int type = fi.compression_type;
+    if (type == NO_COMPRESSION) type = getRegisteredCompressionType(file_name);
+    if (type != SPB_COMPRESSION) return NULL;
+
+    Profiler::countBytes(ai->file_name, fi.length);
     if (location) *location = ARCHIVE_TYPE_SAR;
+    Stream s(ai->file_handle, &ai->map, fi.offset);
+    return decodeSPBImage(s);
+}
+
+
+// Packed entries decode only the chunks in the range, and stored
+// archive entries are read in place; anything else is read whole.
+size_t SarReader::getFileRange(const pstring& file_name, size_t offset,
+                               size_t length, unsigned char* buf)
+{
+    pstring key = ArchiveIndex::normalize(file_name);
+    if (getDirectFileLength(key, file_name))
+        return DirectReader::getFileRange(file_name, offset, length, buf);
+
+    unsigned int i;
+    PackedArchive* pa = findPacked(key, i);
+    if (pa && pa->type(i) != PackedArchive::SPB)
+        return pa->readRange(i, offset, length, buf);
+
+    ArchiveIndex::Location loc;
+    if (!pa && file_index.find(key, loc)) {
+        ArchiveInfo* ai = loc.ai;
+        FileInfo& fi = ai->fi_list[loc.index];
+        int type = fi.compression_type;
+        if (type == NO_COMPRESSION)
+            type = getRegisteredCompressionType(file_name);
+        if (type == NO_COMPRESSION) {
+            if (offset >= fi.length) return 0;
+            if (length > fi.length - offset) length = fi.length - offset;
+            if (ai->map.contains(fi.offset + offset, length)) {
+                decodeKeyTable(buf, ai->map.data() + fi.offset + offset,
+                               length);
+                return length;
+            }
+            length = MappedFile::readAt(ai->file_handle, fi.offset + offset,
+                                        buf, length);
+            decodeKeyTable(buf, buf, length);
+            return length;
+        }
+    }
+
+    return BaseReader::getFileRange(file_name, offset, length, buf);
+}
+
+
+void SarReader::invalidate(const pstring& file_name)
+{
+    pstring key = ArchiveIndex::normalize(file_name);
+    SDL_LockMutex(misses_mutex);
+    direct_misses.erase(key);
+    SDL_UnlockMutex(misses_mutex);
+}
+
+
+bool SarReader::canReadRange(const pstring& file_name)
+{
+    pstring key = ArchiveIndex::normalize(file_name);
+    if (getDirectFileLength(key, file_name))
+        return DirectReader::canReadRange(file_name);
+
+    unsigned int i;
+    PackedArchive* pa = findPacked(key, i);
+    if (pa) return pa->type(i) != PackedArchive::SPB;
 
-    return j;
+    ArchiveIndex::Location loc;
+    return file_index.find(key, loc) &&
+           loc.ai->fi_list[loc.index].compression_type == NO_COMPRESSION &&
+           getRegisteredCompressionType(file_name) == NO_COMPRESSION;
 }
 
 
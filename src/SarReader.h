@@ -26,7 +26,10 @@
 #ifndef __SAR_READER_H__
 #define __SAR_READER_H__
 
+#include <SDL.h>
 #include "DirectReader.h"
+#include "ArchiveIndex.h"
+#include "PackedArchive.h"
 
 class SarReader : public DirectReader {
 public:
@@ -42,16 +45,42 @@ public:
     size_t getFile(const pstring& file_name, unsigned char* buf,
 		   int* location = NULL);
     FileInfo getFileByIndex(unsigned int index);
+    bool getFileView(const pstring& file_name, const unsigned char** data,
+                     size_t* length, int* location = NULL);
+    SDL_Surface* getImage(const pstring& file_name, int* location = NULL);
+    size_t getFileRange(const pstring& file_name, size_t offset,
+                        size_t length, unsigned char* buf);
+    bool canReadRange(const pstring& file_name);
+    void invalidate(const pstring& file_name);
 
 protected:
     ArchiveInfo  archive_info;
     ArchiveInfo* root_archive_info, * last_archive_info;
     int num_of_sar_archives;
 
+    // Every archive entry we can serve, built as archives are opened,
+    // and the names already known not to exist as loose files.
+    ArchiveIndex file_index;
+    set<pstring>::t direct_misses;
+    SDL_mutex* misses_mutex;
+    std::vector<PackedArchive*> packed_archives;
+
     int readArchive(ArchiveInfo* ai, int archive_type = ARCHIVE_TYPE_SAR);
-    int getIndexFromFile(ArchiveInfo* ai, pstring file_name);
-    size_t getFileSub(ArchiveInfo* ai, const pstring& file_name,
-		      unsigned char* buf);
+
+    // Adds an archive written by ponspack, taking over fp.  Its
+    // entries are found before those of any NSA or SAR archive, and
+    // earlier packed archives win over later ones.
+    bool addPacked(FILE* fp, const pstring& name);
+    bool knownMissing(const pstring& key);
+    void addMissing(const pstring& key);
+    size_t getDirectFileLength(const pstring& key, const pstring& file_name);
+    size_t getFileLengthSub(ArchiveInfo* ai, unsigned int i,
+                            const pstring& file_name);
+    size_t getFileSub(ArchiveInfo* ai, unsigned int i,
+                      const pstring& file_name, unsigned char* buf);
+    PackedArchive* findPacked(const pstring& key, unsigned int& index) const;
+    size_t getPackedFile(PackedArchive* pa, unsigned int i,
+                         unsigned char* buf);
 };
 
 #endif // __SAR_READER_H__
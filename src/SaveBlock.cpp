@@ -0,0 +1,62 @@
+/* -*- C++ -*-
+ *
+ *  SaveBlock.cpp - Encoded block of a savepoint, kept for reuse
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#include "SaveBlock.h"
+#include <string.h>
+
+void SaveBlock::begin(size_t n, size_t w)
+{
+    if (names.size() != n || width != w) {
+        width = w;
+        values.assign(n * w, 0);
+        names.assign(n, pstring());
+        bytes.clear();
+        valid = false;
+    }
+    same = valid;
+}
+
+
+void SaveBlock::record(size_t i, const int* v)
+{
+    int* p = &values[i * width];
+    if (memcmp(p, v, width * sizeof(int))) {
+        memcpy(p, v, width * sizeof(int));
+        same = false;
+    }
+}
+
+
+void SaveBlock::record(size_t i, const int* v, const pstring& name)
+{
+    record(i, v);
+    if (names[i] != name) {
+        names[i] = name;
+        same = false;
+    }
+}
+
+
+void SaveBlock::store(const unsigned char* buf, size_t len)
+{
+    bytes.assign(buf, buf + len);
+    valid = true;
+    same = true;
+}
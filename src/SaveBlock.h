@@ -0,0 +1,63 @@
+/* -*- C++ -*-
+ *
+ *  SaveBlock.h - Encoded block of a savepoint, kept for reuse
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __SAVE_BLOCK_H__
+#define __SAVE_BLOCK_H__
+
+#include "pstring.h"
+#include <vector>
+
+// The bytes of one large block of a save file (the sprite records, say)
+// as last written, together with the values they were encoded from.
+// Before writing the block again the caller feeds in the current
+// values record by record; if none differ, the old bytes can be copied
+// out instead of encoding every record afresh.
+class SaveBlock {
+public:
+    SaveBlock() : width(0), same(false), valid(false) {}
+
+    // Starts a comparison of n records of width values each.
+    void begin(size_t n, size_t width);
+
+    // Feeds in the values record i is encoded from.
+    void record(size_t i, const int* values);
+    void record(size_t i, const int* values, const pstring& name);
+
+    // True if everything fed in since begin() matches the values the
+    // stored bytes were encoded from.
+    bool unchanged() const { return same; }
+
+    const unsigned char* data() const {
+        return bytes.empty() ? NULL : &bytes[0];
+    }
+    size_t size() const { return bytes.size(); }
+
+    // Keeps the encoding of the values fed in since begin().
+    void store(const unsigned char* buf, size_t len);
+
+private:
+    std::vector<int> values;
+    std::vector<pstring> names;
+    std::vector<unsigned char> bytes;
+    size_t width;
+    bool same, valid;
+};
+
+#endif // __SAVE_BLOCK_H__
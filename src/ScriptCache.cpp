@@ -0,0 +1,205 @@
+/* -*- C++ -*-
+ *
+ *  ScriptCache.cpp - Processed script and labels saved between runs
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#include "ScriptCache.h"
+#include <string.h>
+
+// Layout, every number a native 32-bit int:
+//   magic, key length, key,
+//   label count, then per label its name length, name, header, start,
+//     start line and line count,
+//   line break count, block count, per block its first offset and gap
+//     position, gap count, gaps,
+//   script length, script.
+// Bump the magic whenever the layout or the processing that produces
+// the script changes.
+static const unsigned int MAGIC = 0x50534301; // "PSC" 1
+
+// A label with an empty name: its name length and four fields.
+static const size_t LABEL_MIN_SIZE = 5 * 4;
+
+namespace {
+
+class Writer {
+public:
+    std::vector<unsigned char> buf;
+
+    void put(int n) { put(&n, 4); }
+    void put(const void* p, size_t len) {
+        const unsigned char* c = (const unsigned char*) p;
+        buf.insert(buf.end(), c, c + len);
+    }
+};
+
+class Reader {
+public:
+    Reader(const unsigned char* p, size_t len) : p(p), end(p + len) {}
+
+    bool get(int& n) {
+        if (end - p < 4) return false;
+        memcpy(&n, p, 4);
+        p += 4;
+        return true;
+    }
+    // Length-prefixed block; the length must be sane.
+    bool get(const unsigned char*& data, int& len) {
+        if (!get(len) || len < 0 || end - p < len) return false;
+        data = p;
+        p += len;
+        return true;
+    }
+
+    size_t left() const { return end - p; }
+
+private:
+    const unsigned char* p;
+    const unsigned char* end;
+};
+
+}
+
+
+void ScriptCache::close()
+{
+    file.unmap();
+    script_data = NULL;
+    script_length = 0;
+}
+
+
+bool ScriptCache::open(const pstring& path, const pstring& key,
+                       std::vector<Label>& labels, LineIndex& index)
+{
+    close();
+
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return false;
+    bool mapped = file.map(fp);
+    fclose(fp);
+    if (!mapped) return false;
+
+    Reader in(file.data(), file.size());
+    int magic, count;
+    const unsigned char* data;
+    int len;
+    if (!in.get(magic) || (unsigned int) magic != MAGIC ||
+        !in.get(data, len) || len != key.length() ||
+        memcmp(data, (const char*) key, len) ||
+        !in.get(count) || count < 0 ||
+        (size_t) count > in.left() / LABEL_MIN_SIZE) {
+        close();
+        return false;
+    }
+
+    labels.clear();
+    labels.reserve(count);
+    for (int i = 0; i < count; i++) {
+        Label l;
+        if (!in.get(data, len) || !in.get(l.header) || !in.get(l.start) ||
+            !in.get(l.start_line) || !in.get(l.num_of_lines)) {
+            close();
+            return false;
+        }
+        l.name = pstring(data, len);
+        labels.push_back(l);
+    }
+
+    index.clear();
+    int blocks;
+    bool ok = in.get(index.total) && in.get(blocks) && blocks >= 0;
+    for (int i = 0; ok && i < blocks; i++) {
+        LineIndex::Block b;
+        int pos;
+        ok = in.get(b.first) && in.get(pos) && pos >= 0;
+        b.pos = pos;
+        index.blocks.push_back(b);
+    }
+    // Every block points into the gaps; an index with no blocks may
+    // have none.
+    if (ok) ok = in.get(data, len) && (len > 0 || index.blocks.empty());
+    if (ok) {
+        index.gaps.assign(data, data + len);
+        for (size_t i = 0; i < index.blocks.size(); i++)
+            if (index.blocks[i].pos >= (unsigned int) len) ok = false;
+    }
+    if (ok) ok = in.get(data, len);
+    for (size_t i = 0; ok && i < labels.size(); i++) {
+        const Label& l = labels[i];
+        ok = l.header >= 0 && l.header <= l.start && l.start <= len;
+    }
+    if (!ok) {
+        index.clear();
+        close();
+        return false;
+    }
+    script_data = (const char*) data;
+    script_length = len;
+    return true;
+}
+
+
+bool ScriptCache::write(const pstring& path, const pstring& key,
+                        const char* script, int length,
+                        const std::vector<Label>& labels,
+                        const LineIndex& index)
+{
+    Writer out;
+    out.put(MAGIC);
+    out.put(key.length());
+    out.put((const char*) key, key.length());
+
+    out.put(labels.size());
+    for (size_t i = 0; i < labels.size(); i++) {
+        const Label& l = labels[i];
+        out.put(l.name.length());
+        out.put((const char*) l.name, l.name.length());
+        out.put(l.header);
+        out.put(l.start);
+        out.put(l.start_line);
+        out.put(l.num_of_lines);
+    }
+
+    out.put(index.total);
+    out.put(index.blocks.size());
+    for (size_t i = 0; i < index.blocks.size(); i++) {
+        out.put(index.blocks[i].first);
+        out.put(index.blocks[i].pos);
+    }
+    out.put(index.gaps.size());
+    if (!index.gaps.empty())
+        out.put(&index.gaps[0], index.gaps.size());
+
+    out.put(length);
+    out.put(script, length);
+
+    // Write beside the old cache and rename, so that a run cut short
+    // never leaves a half-written file to be mapped next time.
+    pstring tmp = path + ".tmp";
+    FILE* fp = fopen(tmp, "wb");
+    if (!fp) return false;
+    bool ok = fwrite(&out.buf[0], 1, out.buf.size(), fp) == out.buf.size();
+    if (fclose(fp)) ok = false;
+    if (ok) {
+        remove(path); // rename() won't replace a file on Windows
+        ok = rename(tmp, path) == 0;
+    }
+    if (!ok) remove(tmp);
+    return ok;
+}
@@ -0,0 +1,68 @@
+/* -*- C++ -*-
+ *
+ *  ScriptCache.h - Processed script and labels saved between runs
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __SCRIPT_CACHE_H__
+#define __SCRIPT_CACHE_H__
+
+#include "defs.h"
+#include "MappedFile.h"
+#include "LineIndex.h"
+
+// The script buffer as readScript leaves it, with its labels and line
+// index, written to a file so that later runs can map it instead of
+// decoding and scanning the sources again.  The key describes the
+// sources (names, sizes, modification times, encoding and key table);
+// a cache written for any other key is ignored.  The file uses native
+// byte order, so one copied to a different machine is just a miss.
+class ScriptCache {
+public:
+    ScriptCache() : script_data(NULL), script_length(0) {}
+
+    struct Label {
+        pstring name;
+        int header;       // offset of the '*'
+        int start;        // offset of the first line after the label
+        int start_line;
+        int num_of_lines;
+    };
+
+    // Maps the cache at path and fills labels and index from it.
+    // Returns false, with nothing mapped, if the file is missing,
+    // damaged or was written for another key.
+    bool open(const pstring& path, const pstring& key,
+              std::vector<Label>& labels, LineIndex& index);
+    void close();
+
+    // The script, inside the mapping; NULL unless open succeeded.
+    const char* script() const { return script_data; }
+    int length() const { return script_length; }
+
+    static bool write(const pstring& path, const pstring& key,
+                      const char* script, int length,
+                      const std::vector<Label>& labels,
+                      const LineIndex& index);
+
+private:
+    MappedFile file;
+    const char* script_data;
+    int script_length;
+};
+
+#endif // __SCRIPT_CACHE_H__
@@ -27,6 +27,7 @@
 #include "PonscripterMessage.h"
 #include "Fontinfo.h"
 #include <ctype.h>
+#include <algorithm>
 #include <sys/stat.h>
 #include <sys/types.h>
 #ifdef WIN32
@@ -38,12 +39,13 @@
 #include <CoreFoundation/CoreFoundation.h>
 #endif
 
-#define TMP_SCRIPT_BUF_LEN 4096
+#define TMP_SCRIPT_BUF_LEN 65536
 #define STRING_BUFFER_LENGTH 2048
 
 #define SKIP_SPACE(p) while (*(p) == ' ' || *(p) == '\t') (p)++
 
 BaseReader* ScriptHandler::cBR = NULL;
+unsigned int ScriptHandler::VariableData::generation = 0;
 
 FILE* cout = stdout;
 FILE* cerr = stderr;
@@ -61,6 +63,8 @@ ScriptHandler::ScriptHandler()
     raw_script_buffer = NULL;
     script_buffer = NULL;
     kidoku_buffer = NULL;
+    scan = AcceleratedScriptFunctions::accelerated();
+    command_id = -1;
     label_log.filename = "NScrllog.dat";
     file_log.filename  = "NScrflog.dat";
     clickstr_list.clear();
@@ -91,7 +95,7 @@ ScriptHandler::ScriptHandler()
 ScriptHandler::~ScriptHandler()
 {
     reset();
-    if (script_buffer) delete[] script_buffer;
+    if (script_buffer != script_cache.script()) delete[] script_buffer;
     if (kidoku_buffer) delete[] kidoku_buffer;
     if (utf_encoding != file_encoding) delete utf_encoding;
 }
@@ -206,6 +210,7 @@ const char* ScriptHandler::readToken(bool no_kidoku)
     const char* buf = current_script;
     end_status = END_NONE;
     current_variable.type = VAR_NONE;
+    command_id = -1;
 
     text_flag = false;
 
@@ -352,6 +357,16 @@ readTokenTop:
     else if ((ch >= 'a' && ch <= 'z')
              || (ch >= 'A' && ch <= 'Z')
              || ch == '_') { // command
+        int offset = buf - script_buffer;
+        const TokenCache::Token* token = token_cache.find(offset);
+        if (token) {
+            string_buffer = token_cache.name(token->id);
+            command_id  = token->id;
+            end_status  = token->end_status;
+            next_script = script_buffer + token->next;
+            return string_buffer;
+        }
+
         do {
             if (ch >= 'A' && ch <= 'Z') ch += 'a' - 'A';
 
@@ -362,6 +377,12 @@ readTokenTop:
                || (ch >= 'A' && ch <= 'Z')
                || (ch >= '0' && ch <= '9')
                || ch == '_');
+
+        next_script = checkComma(buf);
+        token = token_cache.add(offset, string_buffer,
+                                next_script - script_buffer, end_status);
+        command_id = token->id;
+        return string_buffer;
     }
     else if (ch == '*') { // label
         return readLabel();
@@ -390,6 +411,7 @@ const char* ScriptHandler::readLabel()
 {
     end_status = END_NONE;
     current_variable.type = VAR_NONE;
+    command_id = -1;
 
     current_script = next_script;
     SKIP_SPACE(current_script);
@@ -431,6 +453,7 @@ const char* ScriptHandler::readStr()
 {
     end_status = END_NONE;
     current_variable.type = VAR_NONE;
+    command_id = -1;
 
     current_script = next_script;
     SKIP_SPACE(current_script);
@@ -462,6 +485,7 @@ int ScriptHandler::readInt()
 
     end_status = END_NONE;
     current_variable.type = VAR_NONE;
+    command_id = -1;
 
     current_script = next_script;
     SKIP_SPACE(current_script);
@@ -541,54 +565,71 @@ const char* ScriptHandler::getAddress(int offset)
 
 int ScriptHandler::getLineByAddress(const char* address, bool absolute)
 {
-    LabelInfo label = getLabelByAddress(address);
+    const LabelInfo& label = *findLabelByAddress(address);
 
-    const char* addr = label.label_header;
     int line = absolute ? label.start_line + 1 : 0;
-    while (address > addr) {
-        if (*addr == 0x0a) line++;
-
-        addr++;
-    }
+    if (address > label.label_header)
+        line += line_index.countBefore(address - script_buffer)
+            - line_index.countBefore(label.label_header - script_buffer);
     return line;
 }
 
 
 const char* ScriptHandler::getAddressByLine(int line)
 {
-    LabelInfo label = getLabelByLine(line);
+    const LabelInfo& label = *findLabelByLine(line);
 
     int l = line - label.start_line;
-    const char* addr = label.label_header;
-    while (l > 0) {
-        while (*addr != 0x0a) addr++;
-        addr++;
-        l--;
-    }
-    return addr;
+    if (l <= 0) return label.label_header;
+
+    int n = line_index.countBefore(label.label_header - script_buffer)
+        + l - 1;
+    if (n >= line_index.size()) return script_buffer + script_buffer_length;
+    return script_buffer + line_index.offsetOf(n) + 1;
+}
+
+
+// label_info is in script order, so both start_address and start_line
+// are sorted and the label containing a position is the last one
+// starting at or before it (or the first label, for anything before).
+struct LabelStartsAfterAddress {
+    bool operator()(const char* address,
+                    const ScriptHandler::LabelInfo& label) const
+    { return label.start_address > address; }
+};
+
+struct LabelStartsAfterLine {
+    bool operator()(int line, const ScriptHandler::LabelInfo& label) const
+    { return label.start_line > line; }
+};
+
+
+ScriptHandler::LabelInfo::iterator
+ScriptHandler::findLabelByAddress(const char* address)
+{
+    LabelInfo::iterator i = std::upper_bound(label_info.begin() + 1,
+        label_info.end(), address, LabelStartsAfterAddress());
+    return i - 1;
+}
+
+
+ScriptHandler::LabelInfo::iterator ScriptHandler::findLabelByLine(int line)
+{
+    LabelInfo::iterator i = std::upper_bound(label_info.begin() + 1,
+        label_info.end(), line, LabelStartsAfterLine());
+    return i - 1;
 }
 
 
 ScriptHandler::LabelInfo ScriptHandler::getLabelByAddress(const char* address)
 {
-    LabelInfo::vec::size_type i;
-    for (i = 0; i < label_info.size() - 1; i++) {
-        if (label_info[i + 1].start_address > address)
-            return label_info[i];
-    }
-    return label_info[i];
+    return *findLabelByAddress(address);
 }
 
 
 ScriptHandler::LabelInfo ScriptHandler::getLabelByLine(int line)
 {
-    LabelInfo::vec::size_type i;
-    for (i = 0; i < label_info.size() - 1; i++) {
-        if (label_info[i + 1].start_line > line)
-            return label_info[i];
-    }
-
-    return label_info[i];
+    return *findLabelByLine(line);
 }
 
 
@@ -614,10 +655,10 @@ bool ScriptHandler::compareString(const char* buf)
 
 void ScriptHandler::skipLine(int no)
 {
-    for (int i = 0; i < no; i++) {
-        while (*current_script != 0x0a) current_script++;
-        current_script++;
-    }
+    const char* end = script_buffer + script_buffer_length;
+    for (int i = 0; i < no; i++)
+        current_script += scan.findByte(current_script, end - current_script,
+                                        0x0a) + 1;
 
     next_script = current_script;
 }
@@ -698,7 +739,7 @@ void ScriptHandler::addStrVariable(const char** buf)
 {
     (*buf)++;
     VariableData &vd = getVariableData(parseInt(buf));
-    string_buffer += vd.str;
+    string_buffer += vd.get_str();
 }
 
 
@@ -773,6 +814,13 @@ int ScriptHandler::readScriptSub(FILE* fp, char** buf, int encrypt_mode, bool is
     if (encrypt_mode == 3 && !key_table_flag)
         errorAndExit("readScriptSub: the EXE file must be specified with --key-exe option.");
 
+    // Modes 1 and 2 XOR with a repeating key; this is it from the
+    // start of the current chunk.
+    unsigned char key[SCRIPT_KEY_LENGTH];
+    if (encrypt_mode == 1) memset(key, 0x84, SCRIPT_KEY_LENGTH);
+
+    char* tmp_script_buf = new char[TMP_SCRIPT_BUF_LEN];
+
     size_t len = 0, count = 0;
     while (1) {
         if (len == count) {
@@ -784,18 +832,34 @@ int ScriptHandler::readScriptSub(FILE* fp, char** buf, int encrypt_mode, bool is
             }
 
             count = 0;
-        }
 
-        char ch = tmp_script_buf[count++];
-        if (encrypt_mode == 1) ch ^= 0x84;
-        else if (encrypt_mode == 2) {
-            ch = (ch ^ magic[magic_counter++]) & 0xff;
-            if (magic_counter == 5) magic_counter = 0;
+            unsigned char* p = (unsigned char*) tmp_script_buf;
+            if (encrypt_mode == 2) {
+                for (int i = 0; i < SCRIPT_KEY_LENGTH; i++)
+                    key[i] = magic[(magic_counter + i) % 5];
+                magic_counter = (magic_counter + len) % 5;
+            }
+            if (encrypt_mode == 1 || encrypt_mode == 2)
+                scan.xorKey(p, len, key);
+            else if (encrypt_mode == 3) {
+                for (size_t i = 0; i < len; i++)
+                    p[i] = key_table[p[i]] ^ 0x84;
+            }
         }
-        else if (encrypt_mode == 3) {
-            ch = key_table[(unsigned char) ch] ^ 0x84;
+
+        // Copy runs without a CR, or a byte that could start a BOM,
+        // straight through.
+        if (!cr_flag && bom_check == 0) {
+            size_t run = scan.findEither(tmp_script_buf + count, len - count,
+                                         0x0d, is_utf ? char(0xef) : 0x0d);
+            memcpy(*buf, tmp_script_buf + count, run);
+            *buf += run;
+            count += run;
+            if (count == len) continue;
         }
 
+        char ch = tmp_script_buf[count++];
+
         if (cr_flag && ch != 0x0a) {
             *(*buf)++    = 0x0a;
             cr_flag = false;
@@ -829,11 +893,31 @@ int ScriptHandler::readScriptSub(FILE* fp, char** buf, int encrypt_mode, bool is
         }
     }
 
+    delete[] tmp_script_buf;
     *(*buf)++ = 0x0a;
     return 0;
 }
 
 
+// FNV-1a.
+static unsigned int hashBytes(const unsigned char* p, size_t len)
+{
+    unsigned int h = 2166136261u;
+    while (len--) h = (h ^ *p++) * 16777619u;
+    return h;
+}
+
+
+// Appends name, size and modification time of an open script file.
+static void describeSource(pstring& key, const pstring& name, FILE* fp)
+{
+    struct stat st;
+    if (fstat(fileno(fp), &st)) st.st_size = st.st_mtime = 0;
+    key.formata("%s %ld %ld\n", (const char*) name, (long) st.st_size,
+                (long) st.st_mtime);
+}
+
+
 int ScriptHandler::readScript(DirPaths *path, const char* prefer_name)
 {
     archive_path = path;
@@ -844,6 +928,7 @@ int ScriptHandler::readScript(DirPaths *path, const char* prefer_name)
 
     pstring fname = "";
     pstring ext = "";
+    pstring source = "";
     while ((fp == NULL) && (n<archive_path->get_num_paths())) {
         script_path = archive_path->get_path(n++);
 
@@ -890,6 +975,7 @@ int ScriptHandler::readScript(DirPaths *path, const char* prefer_name)
             for (ScriptFilename::iterator ft = script_filenames.begin();
                  ft != script_filenames.end(); ++ft) {
                 if ((fp = fileopen(script_path, ft->filename, "rb")) != NULL) {
+                    source = ft->filename;
                     ext = pstr_split_last(ft->filename, '.').second;
                     encrypt_mode = ft->encryption;
                     enc = ft->_encoding;
@@ -918,6 +1004,13 @@ int ScriptHandler::readScript(DirPaths *path, const char* prefer_name)
         is_ponscripter = false;
     }
     
+    // Everything the processed script depends on, for the cache.
+    pstring cache_key;
+    cache_key.format("%d %d\n", enc, encrypt_mode);
+    if (encrypt_mode == 3)
+        cache_key.formata("key %08x\n", hashBytes(key_table, 256));
+    describeSource(cache_key, fname ? fname : script_path + source, fp);
+
     fseek(fp, 0, SEEK_END);
     int estimated_buffer_length = ftell(fp) + 1;
 
@@ -932,6 +1025,7 @@ int ScriptHandler::readScript(DirPaths *path, const char* prefer_name)
             }
 
             if (fp) {
+                describeSource(cache_key, script_path + filename, fp);
                 fseek(fp, 0, SEEK_END);
                 estimated_buffer_length += ftell(fp) + 1;
                 fclose(fp);
@@ -939,19 +1033,35 @@ int ScriptHandler::readScript(DirPaths *path, const char* prefer_name)
         }
     }
 
-    if (raw_script_buffer) delete[] raw_script_buffer;
+    if (raw_script_buffer != script_cache.script()) delete[] raw_script_buffer;
+    script_cache.close();
 
-    char* p_script_buffer = new char[estimated_buffer_length];
+    std::vector<ScriptCache::Label> cached_labels;
+    bool cached = script_cache_path &&
+        script_cache.open(script_cache_path, cache_key, cached_labels,
+                          line_index);
+    if (cached) {
+        if (encrypt_mode > 0 || fname) fclose(fp);
 
-    current_script = raw_script_buffer = p_script_buffer;
-    tmp_script_buf = new char[TMP_SCRIPT_BUF_LEN];
+        // Nothing writes to the script buffer, so it can stay in the
+        // read-only mapping.
+        current_script = raw_script_buffer = (char*) script_cache.script();
+        script_buffer_length = script_cache.length();
+    }
+    else if (encrypt_mode > 0 || fname) {
+        char* p_script_buffer = new char[estimated_buffer_length];
+        current_script = raw_script_buffer = p_script_buffer;
 
-    if (encrypt_mode > 0 || fname) {
         fseek(fp, 0, SEEK_SET);
         readScriptSub(fp, &p_script_buffer, encrypt_mode);
         fclose(fp);
+
+        script_buffer_length = p_script_buffer - raw_script_buffer;
     }
     else {
+        char* p_script_buffer = new char[estimated_buffer_length];
+        current_script = raw_script_buffer = p_script_buffer;
+
         for (int i = 0; i < 100; i++) {
             pstring filename;
             filename.format("%d.%s", i, (const char*)ext);
@@ -965,11 +1075,12 @@ int ScriptHandler::readScript(DirPaths *path, const char* prefer_name)
                 fclose(fp);
             }
         }
-    }
 
-    delete[] tmp_script_buf;
+        script_buffer_length = p_script_buffer - raw_script_buffer;
+    }
 
     script_buffer = raw_script_buffer;
+    token_cache.clear();
 
     // Search for gameid file (this overrides any builtin
     // ;gameid directive, or serves its purpose if none is available)
@@ -993,8 +1104,6 @@ int ScriptHandler::readScript(DirPaths *path, const char* prefer_name)
         }
     }
 
-    script_buffer_length = p_script_buffer - script_buffer;
-
     /* ---------------------------------------- */
     /* screen size and value check */
     const char* buf = script_buffer+1;
@@ -1082,7 +1191,45 @@ int ScriptHandler::readScript(DirPaths *path, const char* prefer_name)
         buf = end + 1;
     }
 
-    return labelScript();
+    if (cached) {
+        label_info.clear();
+        for (size_t i = 0; i < cached_labels.size(); i++) {
+            const ScriptCache::Label& l = cached_labels[i];
+            LabelInfo label;
+            label.name = l.name;
+            label.label_header = script_buffer + l.header;
+            label.start_address = script_buffer + l.start;
+            label.start_line = l.start_line;
+            label.num_of_lines = l.num_of_lines;
+            label_info.push_back(label);
+        }
+        indexLabels();
+        return 0;
+    }
+
+    int ret = labelScript();
+    if (script_cache_path) writeScriptCache(cache_key);
+    return ret;
+}
+
+
+void ScriptHandler::writeScriptCache(const pstring& key)
+{
+    std::vector<ScriptCache::Label> labels;
+    labels.reserve(label_info.size());
+    for (LabelInfo::iterator i = label_info.begin(); i != label_info.end(); ++i) {
+        ScriptCache::Label l;
+        l.name = i->name;
+        l.header = i->label_header - script_buffer;
+        l.start = i->start_address - script_buffer;
+        l.start_line = i->start_line;
+        l.num_of_lines = i->num_of_lines;
+        labels.push_back(l);
+    }
+    if (!ScriptCache::write(script_cache_path, key, script_buffer,
+                            script_buffer_length, labels, line_index))
+        fprintf(stderr, "Warning: couldn't write script cache `%s'\n",
+                (const char*) script_cache_path);
 }
 
 
@@ -1116,20 +1263,26 @@ int ScriptHandler::labelScript()
 	    if (label_info.size())
 		label_info.back().num_of_lines++;
 
-            while (*buf != 0x0a) buf++;
-            buf++;
+            buf += scan.findByte(buf, script_buffer + script_buffer_length - buf,
+                                 0x0a) + 1;
             current_line++;
         }
     }
 
-    // Index label names.
-    for (LabelInfo::iterator i = label_info.begin(); i != label_info.end(); ++i)
-	label_names[i->name] = i;
+    indexLabels();
+    line_index.build(script_buffer, script_buffer_length);
     
     return 0;
 }
 
 
+void ScriptHandler::indexLabels()
+{
+    for (LabelInfo::iterator i = label_info.begin(); i != label_info.end(); ++i)
+	label_names[i->name] = i;
+}
+
+
 ScriptHandler::LabelInfo ScriptHandler::lookupLabel(const pstring& label)
 {
     LabelInfo::iterator i = findLabel(label);
@@ -1247,7 +1400,7 @@ pstring ScriptHandler::parseStr(const char** buf)
         current_variable.type = VAR_STR;
         current_variable.var_no = no;
 
-        return getVariableData(no).str;
+        return getVariableData(no).get_str();
     }
     else if (**buf == '"') {
         (*buf)++;
@@ -30,6 +30,10 @@
 #include "BaseReader.h"
 #include "DirPaths.h"
 #include "expression.h"
+#include "TokenCache.h"
+#include "LineIndex.h"
+#include "ScriptCache.h"
+#include "script_accelerated.h"
 
 const int VARIABLE_RANGE = 4096;
 
@@ -112,6 +116,7 @@ public:
     void setKeyTable(const unsigned char* key_table);
 
     void setSavedir(const pstring& dir);
+    void setScriptCache(const pstring& path) { script_cache_path = path; }
 
     // basic parser function
     const char* readToken(bool no_kidoku = false);
@@ -138,6 +143,9 @@ public:
     inline pstring& getStrBuf() {
 	return string_buffer;
     }
+    // Interned name of the command readToken() has just returned, or
+    // -1 if the last thing read wasn't a command.
+    int getCommandId() const { return command_id; }
     inline const char* getStrBuf(int offset) {
 	if (offset < 0 || offset > string_buffer.length()) {
 	    fprintf(stderr, "getStrBuf outside buffer (offs %d, len %u)\n",
@@ -245,10 +253,14 @@ public:
     struct VariableData {
     private:
         int num;
+        pstring str;
     public:
+        // Bumped whenever any variable's value changes, so that saved
+        // copies of the variables can tell when they are out of date.
+        static unsigned int generation;
+
         ScriptHandler* owner;
         int watch_int_variable;
-        pstring str;
         bool num_limit_flag;
         int num_limit_upper;
         int num_limit_lower;
@@ -261,10 +273,23 @@ public:
                 fprintf(stderr, "WATCH (line %d): %%%d: %d -> %d\n",
                         owner->getLineByAddress(owner->getCurrent(), true),
                         watch_int_variable, num, val);
+            if (num != val) ++generation;
             num = val;
         }
 
-        VariableData() {
+        const pstring& get_str() const {
+            return str;
+        }
+        void set_str(const pstring& val) {
+            ++generation;
+            str = val;
+        }
+        void append_str(const pstring& val) {
+            ++generation;
+            str += val;
+        }
+
+        VariableData() : num(0) {
             watch_int_variable = -1;
             reset(true);
         };
@@ -272,7 +297,10 @@ public:
         {
             set_num(0);
             if (limit_reset_flag) num_limit_flag = false;
-            if (str) str.trunc(0);
+            if (str) {
+                ++generation;
+                str.trunc(0);
+            }
         };
     };
     VariableData &getVariableData(int no);
@@ -312,6 +340,8 @@ private:
     };
 
     LabelInfo::iterator findLabel(pstring label);
+    LabelInfo::iterator findLabelByAddress(const char* address);
+    LabelInfo::iterator findLabelByLine(int line);
 
     const char* checkComma(const char* buf);
     pstring parseStr(const char** buf);
@@ -341,12 +371,19 @@ private:
     int   script_buffer_length;
     char* raw_script_buffer;
     char* script_buffer;
-    char* tmp_script_buf;
+    ScriptCache script_cache; // holds script_buffer when it was mapped
+    pstring script_cache_path;
 
     pstring string_buffer; // updated only by readToken (is this true?)
+    TokenCache token_cache;
+    AcceleratedScriptFunctions scan;
+    int command_id;
 
     LabelInfo::vec label_info;
     LabelInfo::dic label_names;
+    LineIndex line_index;
+    void indexLabels();
+    void writeScriptCache(const pstring& key);
     
     bool  skip_enabled;
     bool  kidokuskip_flag;
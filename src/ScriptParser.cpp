@@ -50,6 +50,9 @@ typedef int (ScriptParser::*ParserFun)(const pstring&);
 static class func_lut_t {
     typedef dictionary<pstring, ParserFun>::t dic_t;
     dic_t dict;
+    // Indexed by ScriptHandler::getCommandId().
+    std::vector<ParserFun> by_id;
+    std::vector<bool> resolved;
 public:
     func_lut_t();
     ParserFun get(pstring what) const {
@@ -57,6 +60,18 @@ public:
 	if (it == dict.end()) return 0;
 	return it->second;
     }
+    ParserFun get(int id, const pstring& what) {
+	if (id < 0) return get(what);
+	if (id >= (int) by_id.size()) {
+	    by_id.resize(id + 1, 0);
+	    resolved.resize(id + 1, false);
+	}
+	if (!resolved[id]) {
+	    by_id[id] = get(what);
+	    resolved[id] = true;
+	}
+	return by_id[id];
+    }
 } func_lut;
 func_lut_t::func_lut_t() {
     dict["add"]             = &ScriptParser::addCommand;
@@ -211,6 +226,7 @@ ScriptParser::~ScriptParser()
 void ScriptParser::reset()
 {
     user_func_lut.clear();
+    user_func_ids.clear();
 
     // reset misc variables
     nsa_path.trunc(0);
@@ -327,7 +343,8 @@ void ScriptParser::reset()
 
 int ScriptParser::open(const char* preferred_script)
 {
-    ScriptHandler::cBR = new DirectReader(&archive_path, key_table);
+    ScriptHandler::cBR =
+        new DirectReader(&archive_path, key_table);
     ScriptHandler::cBR->open();
 
     script_h.game_identifier = cmdline_game_id;
@@ -452,6 +469,18 @@ rgb_t ScriptParser::readColour(const char* buf)
 }
 
 
+bool ScriptParser::isUserFunc(const pstring& cmd)
+{
+    int id = script_h.getCommandId();
+    if (id < 0) return user_func_lut.find(cmd) != user_func_lut.end();
+
+    if (id >= (int) user_func_ids.size()) user_func_ids.resize(id + 1, -1);
+    if (user_func_ids[id] < 0)
+        user_func_ids[id] = user_func_lut.find(cmd) != user_func_lut.end();
+    return user_func_ids[id];
+}
+
+
 int ScriptParser::parseLine()
 {
     pstring cmd = script_h.getStrBuf();
@@ -467,7 +496,7 @@ int ScriptParser::parseLine()
 
     bool is_orig_cmd = false;
     if (cmd[0] != '_') {
-	if (user_func_lut.find(cmd) != user_func_lut.end()) {
+	if (isUserFunc(cmd)) {
 	    gosubReal(cmd, script_h.getNext());
 	    return RET_CONTINUE;
 	}
@@ -476,7 +505,7 @@ int ScriptParser::parseLine()
 	cmd.remove(0, 1);
 	is_orig_cmd = true;
     }
-    ParserFun f = func_lut.get(cmd);
+    ParserFun f = func_lut.get(script_h.getCommandId(), cmd);
     if (f) {
         if (is_orig_cmd && (debug_level > 0)) {
             printf("** executing builtin command '%s' **\n",
@@ -515,8 +544,6 @@ void ScriptParser::saveGlobalData()
     if (!globalon_flag) return;
 
     file_io_buf_ptr = 0;
-    writeVariables(script_h.global_variable_border, VARIABLE_RANGE, false);
-    allocFileIOBuf();
     writeVariables(script_h.global_variable_border, VARIABLE_RANGE, true);
 
     if (saveFileIOBuf("global.sav")) {
@@ -547,6 +574,32 @@ void ScriptParser::allocFileIOBuf()
 }
 
 
+// Makes room for len more bytes at file_io_buf_ptr, keeping what has
+// been written so far and the current savepoint.  The write functions
+// call this as they go, so output can be produced in a single pass.
+void ScriptParser::growFileIOBuf(size_t len)
+{
+    size_t size = file_io_buf_len ? file_io_buf_len : 4096;
+    while (size < file_io_buf_ptr + len) size *= 2;
+
+    unsigned char* buf = new unsigned char[size];
+    if (file_io_buf) {
+        memcpy(buf, file_io_buf, file_io_buf_ptr);
+        delete[] file_io_buf;
+    }
+    file_io_buf = buf;
+
+    buf = new unsigned char[size];
+    if (save_data_buf) {
+        memcpy(buf, save_data_buf, save_data_len);
+        delete[] save_data_buf;
+    }
+    save_data_buf = buf;
+
+    file_io_buf_len = size;
+}
+
+
 int ScriptParser::saveFileIOBuf(const pstring& filename, int offset,
                                 const char* savestr)
 {
@@ -587,6 +640,7 @@ int ScriptParser::saveFileIOBuf(const pstring& filename, int offset,
     //(using "ret =" to avoid compiler warnings about unused return values)
     ret = remove(fullname); //ignore errors (like if fullname doesn't exist)
     if (rename(tmp, fullname)) return -1;
+    if (ScriptHandler::cBR) ScriptHandler::cBR->invalidate(filename);
 
     return 0;
 }
@@ -620,8 +674,10 @@ int ScriptParser::loadFileIOBuf(const pstring& filename)
 
 void ScriptParser::writeChar(char c, bool output_flag)
 {
-    if (output_flag)
+    if (output_flag) {
+        if (file_io_buf_ptr + 1 > file_io_buf_len) growFileIOBuf(1);
         file_io_buf[file_io_buf_ptr] = (unsigned char) c;
+    }
 
     file_io_buf_ptr++;
 }
@@ -638,6 +694,7 @@ char ScriptParser::readChar()
 void ScriptParser::writeInt(int i, bool output_flag)
 {
     if (output_flag) {
+        if (file_io_buf_ptr + 4 > file_io_buf_len) growFileIOBuf(4);
         file_io_buf[file_io_buf_ptr++] = i & 0xff;
         file_io_buf[file_io_buf_ptr++] = (i >> 8) & 0xff;
         file_io_buf[file_io_buf_ptr++] = (i >> 16) & 0xff;
@@ -665,14 +722,22 @@ int ScriptParser::readInt()
 
 void ScriptParser::writeStr(const pstring& s, bool output_flag)
 {
-    if (s) {
-	if (output_flag)
-	    memcpy(file_io_buf + file_io_buf_ptr, (const char*) s, s.length());
+    if (s) writeBytes((const unsigned char*) (const char*) s, s.length(),
+                      output_flag);
 
-	file_io_buf_ptr += s.length();
+    writeChar(0, output_flag);
+}
+
+
+void ScriptParser::writeBytes(const unsigned char* data, size_t len,
+                              bool output_flag)
+{
+    if (output_flag && len) {
+        if (file_io_buf_ptr + len > file_io_buf_len) growFileIOBuf(len);
+        memcpy(file_io_buf + file_io_buf_ptr, data, len);
     }
 
-    writeChar(0, output_flag);
+    file_io_buf_ptr += len;
 }
 
 
@@ -688,7 +753,7 @@ void ScriptParser::writeVariables(int from, int to, bool output_flag)
 {
     for (int i = from; i < to; i++) {
         writeInt(script_h.getVariableData(i).get_num(), output_flag);
-        writeStr(script_h.getVariableData(i).str, output_flag);
+        writeStr(script_h.getVariableData(i).get_str(), output_flag);
     }
 }
 
@@ -697,7 +762,7 @@ void ScriptParser::readVariables(int from, int to)
 {
     for (int i = from; i < to; i++) {
         script_h.getVariableData(i).set_num(readInt());
-        script_h.getVariableData(i).str = readStr();
+        script_h.getVariableData(i).set_str(readStr());
     }
 }
 
@@ -710,6 +775,7 @@ void ScriptParser::writeArrayVariable(bool output_flag)
 	     d != it->second.end(); ++d) {
             unsigned long ch = *d;
             if (output_flag) {
+                if (file_io_buf_ptr + 4 > file_io_buf_len) growFileIOBuf(4);
                 file_io_buf[file_io_buf_ptr + 3] = (unsigned char) ((ch >> 24) & 0xff);
                 file_io_buf[file_io_buf_ptr + 2] = (unsigned char) ((ch >> 16) & 0xff);
                 file_io_buf[file_io_buf_ptr + 1] = (unsigned char) ((ch >> 8) & 0xff);
@@ -62,11 +62,9 @@ struct OVInfo{
     int cvt_len;
     int mult1;
     int mult2;
-    unsigned char *buf;
+    SDL_RWops *src;
     long decoded_length;
 #if defined(USE_OGG_VORBIS)
-    ogg_int64_t length;
-    ogg_int64_t pos;
     int loop;
     ogg_int64_t loop_start;
     ogg_int64_t loop_end;
@@ -199,6 +197,10 @@ public:
 
 protected:
     set<pstring>::t user_func_lut;
+    // Membership of user_func_lut by ScriptHandler::getCommandId();
+    // -1 where not looked up yet.
+    std::vector<signed char> user_func_ids;
+    bool isUserFunc(const pstring& cmd);
 
     struct NestInfo {
     typedef std::vector<NestInfo> vector;
@@ -354,6 +356,9 @@ protected:
     pstring load_menu_name;
     pstring save_item_name;
 
+    // file_io_buf and save_data_buf always have the same capacity,
+    // file_io_buf_len, so that a freshly written savepoint can be
+    // swapped into save_data_buf rather than copied.
     unsigned char* save_data_buf;
     unsigned char* file_io_buf;
     size_t file_io_buf_ptr;
@@ -441,6 +446,7 @@ protected:
     void errorAndCont(const char* why, const char* reason = NULL);
 
     void allocFileIOBuf();
+    void growFileIOBuf(size_t len);
     int saveFileIOBuf(const pstring& filename, int offset = 0,
                       const char* savestr = NULL);
     int loadFileIOBuf(const pstring& filename);
@@ -451,6 +457,7 @@ protected:
     int readInt();
     void writeStr(const pstring& s, bool output_flag);
     pstring readStr();
+    void writeBytes(const unsigned char* data, size_t len, bool output_flag);
     void writeVariables(int from, int to, bool output_flag);
     void readVariables(int from, int to);
     void writeArrayVariable(bool output_flag);
@@ -425,7 +425,8 @@ int ScriptParser::nsaCommand(const pstring& cmd)
     }
 
     delete ScriptHandler::cBR;
-    ScriptHandler::cBR = new NsaReader(&archive_path, key_table);
+    ScriptHandler::cBR =
+        new NsaReader(&archive_path, key_table);
     if (ScriptHandler::cBR->open(nsa_path, archive_type))
         fprintf(stderr, " *** failed to open Nsa archive, ignored.  ***\n");
 
@@ -1085,6 +1086,7 @@ int ScriptParser::defvoicevolCommand(const pstring& cmd)
 int ScriptParser::defsubCommand(const pstring& cmd)
 {
     user_func_lut.insert(script_h.readBareword());
+    user_func_ids.clear();
     return RET_CONTINUE;
 }
 
@@ -1215,7 +1217,8 @@ int ScriptParser::arcCommand(const pstring& cmd)
         buf.trunc(buf.find('|', 0)); // TODO: check this removes the |
     if (ScriptHandler::cBR->getArchiveName() == "direct") {
         delete ScriptHandler::cBR;
-        ScriptHandler::cBR = new SarReader(&archive_path, key_table);
+        ScriptHandler::cBR =
+            new SarReader(&archive_path, key_table);
         if (ScriptHandler::cBR->open(buf))
             fprintf(stderr, " *** failed to open archive %s, ignored.  ***\n",
 		    (const char*) buf);
@@ -0,0 +1,164 @@
+/* -*- C++ -*-
+ *
+ *  SoundCache.cpp - Cache of decoded sound effects
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#include "SoundCache.h"
+#include <string.h>
+
+SoundCache::SoundCache(size_t budget)
+    : hits(0), misses(0), evictions(0),
+      max_size(budget), cur_size(0)
+{}
+
+
+SoundCache::~SoundCache()
+{
+    clear();
+}
+
+
+void SoundCache::setBudget(size_t bytes)
+{
+    max_size = bytes;
+    evict(0);
+}
+
+
+bool SoundCache::currentFormat(const Entry& entry)
+{
+    int freq, channels;
+    Uint16 format;
+    return Mix_QuerySpec(&freq, &format, &channels) &&
+           freq == entry.freq && format == entry.format &&
+           channels == entry.channels;
+}
+
+
+Mix_Chunk* SoundCache::get(const pstring& file_name)
+{
+    dictionary<pstring, lru_t::iterator>::t::iterator e =
+        entries.find(file_name);
+    if (e == entries.end() || !currentFormat(*e->second)) {
+        ++misses;
+        return NULL;
+    }
+
+    // Built as Mix_LoadWAV_RW() builds its chunks, so that
+    // Mix_FreeChunk() frees the samples with it.
+    lru_t::iterator it = e->second;
+    Mix_Chunk* chunk = (Mix_Chunk*) SDL_malloc(sizeof(Mix_Chunk));
+    Uint8* samples = (Uint8*) SDL_malloc(it->length);
+    if (!chunk || !samples) {
+        SDL_free(chunk);
+        SDL_free(samples);
+        ++misses;
+        return NULL;
+    }
+    ++hits;
+    lru.splice(lru.begin(), lru, it);
+
+    memcpy(samples, it->samples, it->length);
+    chunk->allocated = 1;
+    chunk->abuf = samples;
+    chunk->alen = it->length;
+    chunk->volume = it->volume;
+    return chunk;
+}
+
+
+bool SoundCache::contains(const pstring& file_name) const
+{
+    dictionary<pstring, lru_t::iterator>::t::const_iterator e =
+        entries.find(file_name);
+    return e != entries.end() && currentFormat(*e->second);
+}
+
+
+void SoundCache::add(const pstring& file_name, const Mix_Chunk* chunk,
+                     bool pin)
+{
+    if (!chunk || !chunk->abuf || max_size == 0) return;
+
+    // One long voice shouldn't push out every effect.
+    size_t size = chunk->alen;
+    if (!pin && size > max_size / 4) return;
+
+    Entry entry;
+    if (!Mix_QuerySpec(&entry.freq, &entry.format, &entry.channels)) return;
+
+    dictionary<pstring, lru_t::iterator>::t::iterator e =
+        entries.find(file_name);
+    if (e != entries.end()) {
+        pin = pin || e->second->pinned;
+        erase(e->second);
+    }
+
+    evict(size);
+
+    entry.key = file_name;
+    entry.samples = new Uint8[size];
+    memcpy(entry.samples, chunk->abuf, size);
+    entry.length = size;
+    entry.volume = chunk->volume;
+    entry.pinned = pin;
+
+    lru.push_front(entry);
+    entries[file_name] = lru.begin();
+    cur_size += size;
+}
+
+
+void SoundCache::clear()
+{
+    while (!lru.empty()) erase(lru.begin());
+}
+
+
+void SoundCache::printStats(FILE* fp) const
+{
+    unsigned long total = hits + misses;
+    fprintf(fp, "sound cache: %lu hits, %lu misses (%.1f%%), "
+            "%lu evictions, %lu entries, %lu/%lu KB\n",
+            hits, misses, total ? hits * 100.0 / total : 0.0, evictions,
+            (unsigned long) entries.size(), (unsigned long) cur_size / 1024,
+            (unsigned long) max_size / 1024);
+}
+
+
+// Make room for `wanted` more bytes, passing over pinned entries.
+void SoundCache::evict(size_t wanted)
+{
+    lru_t::iterator it = lru.end();
+    while (it != lru.begin() && cur_size + wanted > max_size) {
+        --it;
+        if (!it->pinned) {
+            erase(it++);
+            ++evictions;
+        }
+    }
+}
+
+
+void SoundCache::erase(lru_t::iterator it)
+{
+    cur_size -= it->length;
+    delete[] it->samples;
+    entries.erase(it->key);
+    lru.erase(it);
+}
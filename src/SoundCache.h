@@ -0,0 +1,81 @@
+/* -*- C++ -*-
+ *
+ *  SoundCache.h - Cache of decoded sound effects
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __SOUND_CACHE_H__
+#define __SOUND_CACHE_H__
+
+#include <SDL.h>
+#include <SDL_mixer.h>
+#include <list>
+#include "defs.h"
+
+#define DEFAULT_SOUND_CACHE_SIZE (16 * 1024 * 1024)
+
+// Least-recently-used cache of the samples of sounds played whole
+// (wave, dwave, click and selection voices), so that an effect played
+// again costs no file access or decoding.  Samples are in the format
+// the mixer had when they were decoded; an entry is ignored while the
+// mixer has another format, as it does when an MP3 reopens it.
+//
+// get() returns a chunk of its own, with a copy of the samples, which
+// the caller frees with Mix_FreeChunk() as it would any other; the
+// cache can then drop the entry while the chunk plays.  Pinned entries
+// (the effects the UI plays all the time) are never evicted.
+class SoundCache {
+public:
+    SoundCache(size_t budget = DEFAULT_SOUND_CACHE_SIZE);
+    ~SoundCache();
+
+    // Maximum number of bytes of samples to keep; 0 disables caching.
+    void setBudget(size_t bytes);
+    size_t budget() const { return max_size; }
+
+    Mix_Chunk* get(const pstring& file_name);
+    bool contains(const pstring& file_name) const;
+    void add(const pstring& file_name, const Mix_Chunk* chunk,
+             bool pin = false);
+    void clear();
+
+    void printStats(FILE* fp) const;
+
+    unsigned long hits, misses, evictions;
+
+private:
+    struct Entry {
+        pstring key;
+        Uint8* samples;
+        Uint32 length;
+        Uint8 volume;
+        int freq, channels;
+        Uint16 format;
+        bool pinned;
+    };
+    typedef std::list<Entry> lru_t;
+
+    lru_t lru; // most recently used first
+    dictionary<pstring, lru_t::iterator>::t entries;
+    size_t max_size, cur_size;
+
+    static bool currentFormat(const Entry& entry);
+    void evict(size_t wanted);
+    void erase(lru_t::iterator it);
+};
+
+#endif // __SOUND_CACHE_H__
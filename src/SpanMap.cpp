@@ -0,0 +1,69 @@
+/* -*- C++ -*-
+ *
+ *  SpanMap.cpp - Runs of transparent and opaque pixels in an image
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#include "SpanMap.h"
+#include "graphics_common.h"
+
+static inline int kindOf(Uint32 pixel)
+{
+    Uint32 a = pixel & AMASK;
+    return a == 0 ? SpanMap::SPAN_TRANSPARENT
+         : a == AMASK ? SpanMap::SPAN_OPAQUE : SpanMap::SPAN_PARTIAL;
+}
+
+
+void SpanMap::build(SDL_Surface* surface)
+{
+    spans.clear();
+    row_start.clear();
+    int width = surface->w;
+
+    SDL_LockSurface(surface);
+    for (int y = 0; y < surface->h; y++) {
+        const Uint32* p = (const Uint32*) ((const Uint8*) surface->pixels +
+                                           surface->pitch * y);
+        row_start.push_back(spans.size());
+        int x = 0;
+        while (x < width) {
+            Span s;
+            s.kind = kindOf(p[x]);
+            while (++x < width && kindOf(p[x]) == s.kind) ;
+            s.end = x;
+            spans.push_back(s);
+        }
+    }
+    row_start.push_back(spans.size());
+    SDL_UnlockSurface(surface);
+}
+
+
+const SpanMap::Span* SpanMap::find(int y, int x) const
+{
+    // Binary search on the ends; rows of antialiased art can have
+    // hundreds of spans.
+    const Span* lo = &spans[0] + row_start[y];
+    const Span* hi = rowEnd(y);
+    while (lo < hi) {
+        const Span* mid = lo + (hi - lo) / 2;
+        if (mid->end <= x) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
@@ -0,0 +1,51 @@
+/* -*- C++ -*-
+ *
+ *  SpanMap.h - Runs of transparent and opaque pixels in an image
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __SPAN_MAP_H__
+#define __SPAN_MAP_H__
+
+#include <SDL.h>
+#include <vector>
+
+// Each row of a 32-bit image split into runs of fully transparent,
+// fully opaque and partly transparent pixels.  Sprites are mostly
+// empty space around an opaque figure, so blending by span lets the
+// empty parts be skipped and the solid parts copied.
+class SpanMap {
+public:
+    enum Kind { SPAN_TRANSPARENT, SPAN_OPAQUE, SPAN_PARTIAL };
+    struct Span {
+        int end;   // one past the last pixel of the run
+        int kind;
+    };
+
+    void build(SDL_Surface* surface);
+
+    // The span of row y containing pixel x, and the end of the row's
+    // spans; x must be within the image.
+    const Span* find(int y, int x) const;
+    const Span* rowEnd(int y) const { return &spans[0] + row_start[y + 1]; }
+
+private:
+    std::vector<Span> spans;
+    std::vector<int> row_start; // index in spans of each row's first span
+};
+
+#endif // __SPAN_MAP_H__
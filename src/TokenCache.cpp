@@ -0,0 +1,107 @@
+/* -*- C++ -*-
+ *
+ *  TokenCache.cpp - Command tokens of the script, lexed once
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#include "TokenCache.h"
+
+#define INITIAL_SLOTS 4096
+
+// Offsets are dense and mostly increasing; multiplying by a large odd
+// constant spreads neighbouring ones across the table.
+static inline size_t slotOf(int offset, size_t mask)
+{
+    return ((unsigned int) offset * 2654435761u) & mask;
+}
+
+
+TokenCache::TokenCache()
+    : used(0)
+{
+    rehash(INITIAL_SLOTS);
+}
+
+
+void TokenCache::clear()
+{
+    slots.clear();
+    used = 0;
+    rehash(INITIAL_SLOTS);
+}
+
+
+const TokenCache::Token* TokenCache::find(int offset) const
+{
+    size_t mask = slots.size() - 1;
+    for (size_t i = slotOf(offset, mask); ; i = (i + 1) & mask) {
+        const Token& t = slots[i];
+        if (t.offset == offset) return &t;
+        if (t.offset < 0) return NULL;
+    }
+}
+
+
+const TokenCache::Token* TokenCache::add(int offset, const pstring& name,
+                                         int next, int end_status)
+{
+    // Keep the table at most half full.
+    if ((used + 1) * 2 > slots.size()) rehash(slots.size() * 2);
+
+    size_t mask = slots.size() - 1;
+    size_t i = slotOf(offset, mask);
+    while (slots[i].offset >= 0 && slots[i].offset != offset)
+        i = (i + 1) & mask;
+
+    Token& t = slots[i];
+    if (t.offset < 0) ++used;
+    t.offset = offset;
+    t.id = intern(name);
+    t.next = next;
+    t.end_status = end_status;
+    return &t;
+}
+
+
+int TokenCache::intern(const pstring& name)
+{
+    dictionary<pstring, int>::t::iterator it = ids.find(name);
+    if (it != ids.end()) return it->second;
+
+    int id = names.size();
+    names.push_back(name);
+    ids[name] = id;
+    return id;
+}
+
+
+void TokenCache::rehash(size_t num_slots)
+{
+    std::vector<Token> old;
+    old.swap(slots);
+
+    Token empty = { -1, -1, 0, 0 };
+    slots.assign(num_slots, empty);
+
+    size_t mask = num_slots - 1;
+    for (size_t j = 0; j < old.size(); j++) {
+        if (old[j].offset < 0) continue;
+        size_t i = slotOf(old[j].offset, mask);
+        while (slots[i].offset >= 0) i = (i + 1) & mask;
+        slots[i] = old[j];
+    }
+}
@@ -0,0 +1,65 @@
+/* -*- C++ -*-
+ *
+ *  TokenCache.h - Command tokens of the script, lexed once
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __TOKEN_CACHE_H__
+#define __TOKEN_CACHE_H__
+
+#include "defs.h"
+
+// Remembers, for each script offset at which a command has been read,
+// what ScriptHandler::readToken() made of it: the command name and
+// where the next token starts.  Text tokens depend on variables and
+// clickstr settings, so only commands are kept.
+//
+// Command names are interned into small ids, which stay valid for the
+// life of the cache (clear() only forgets offsets), so the parsers can
+// keep their own id-indexed tables of resolved handlers.
+class TokenCache {
+public:
+    struct Token {
+        int offset;     // where the command name starts
+        int id;         // interned command name
+        int next;       // offset of the following token
+        int end_status; // ScriptHandler::END_* after the command
+    };
+
+    TokenCache();
+
+    // Forget every offset, e.g. because the script has been reloaded.
+    void clear();
+
+    const Token* find(int offset) const;
+    const Token* add(int offset, const pstring& name, int next,
+                     int end_status);
+
+    int intern(const pstring& name);
+    const pstring& name(int id) const { return names[id]; }
+
+private:
+    std::vector<Token> slots; // open addressing, offset -1 when empty
+    size_t used;
+
+    std::vector<pstring> names;
+    dictionary<pstring, int>::t ids;
+
+    void rehash(size_t num_slots);
+};
+
+#endif // __TOKEN_CACHE_H__
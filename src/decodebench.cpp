@@ -0,0 +1,482 @@
+/* -*- C++ -*-
+ *
+ *  decodebench.cpp - Checks and times the SPB and LZSS decoders
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+// Usage: decodebench
+//
+// Makes up an SPB image and an LZSS-compressed text, stores them
+// with no key, an xor key and a permuted key, and decodes each with
+// DirectReader's decoders and with the bit-at-a-time ones they
+// replaced.  Exits non-zero if the two differ; otherwise reports
+// each one's output rate in MB/s.  The readers pull in the text
+// encoding code, so this is linked with the rest of the engine.
+
+#include "DirectReader.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#define SPB_WIDTH 1280
+#define SPB_HEIGHT 720
+#define LZSS_LENGTH (2 * 1024 * 1024)
+
+// As in DirectReader.cpp.
+#define EI 8
+#define EJ 4
+#define P 1
+#define N (1 << EI)
+#define F ((1 << EJ) + P)
+
+// Gets at DirectReader's decoders, and keeps the old ones next to
+// them for comparison.
+class BenchReader : public DirectReader {
+public:
+    BenchReader(const unsigned char* key_table)
+        : DirectReader(NULL, key_table) {}
+
+    size_t spb(FILE* fp, const MappedFile* map, unsigned char* buf) {
+        Stream s(fp, map, 0);
+        return decodeSPB(s, buf);
+    }
+    size_t lzss(FILE* fp, const MappedFile* map, size_t length,
+                unsigned char* buf) {
+        Stream s(fp, map, 0);
+        return decodeLZSS(s, length, buf);
+    }
+    size_t oldSPB(FILE* fp, const MappedFile* map, unsigned char* buf) {
+        OldStream s(fp, map);
+        return oldDecodeSPB(s, buf);
+    }
+    size_t oldLZSS(FILE* fp, const MappedFile* map, size_t length,
+                   unsigned char* buf) {
+        OldStream s(fp, map);
+        return oldDecodeLZSS(s, length, buf);
+    }
+
+private:
+    struct OldStream : public Stream {
+        OldStream(FILE* fp, const MappedFile* map)
+            : Stream(fp, map, 0), bit_buf(0), bit_mask(0) {}
+        int bit_buf, bit_mask;
+    };
+
+    int oldGetbit(OldStream& s, int n);
+    size_t oldDecodeSPB(OldStream& s, unsigned char* buf);
+    size_t oldDecodeLZSS(OldStream& s, size_t original_length,
+                         unsigned char* buf);
+};
+
+
+int BenchReader::oldGetbit(OldStream& s, int n)
+{
+    int i, x = 0;
+
+    for (i = 0; i < n; i++) {
+        if (s.bit_mask == 0) {
+            if ((s.bit_buf = readChar(s)) == EOF) return EOF;
+
+            s.bit_mask = 128;
+        }
+
+        x <<= 1;
+        if (s.bit_buf & s.bit_mask) x++;
+
+        s.bit_mask >>= 1;
+    }
+
+    return x;
+}
+
+
+size_t BenchReader::oldDecodeSPB(OldStream& s, unsigned char* buf)
+{
+    unsigned int   count;
+    unsigned char* pbuf, * psbuf;
+    size_t i, j, k;
+    int c, n, m;
+
+    size_t width  = readShort(s);
+    size_t height = readShort(s);
+
+    size_t width_pad = (4 - width * 3 % 4) % 4;
+
+    size_t total_size = (width * 3 + width_pad) * height + 54;
+
+    /* ---------------------------------------- */
+    /* Write header */
+    memset(buf, 0, 54);
+    buf[0]  = 'B'; buf[1] = 'M';
+    buf[2]  = total_size & 0xff;
+    buf[3]  = (total_size >> 8) & 0xff;
+    buf[4]  = (total_size >> 16) & 0xff;
+    buf[5]  = (total_size >> 24) & 0xff;
+    buf[10] = 54; // offset to the body
+    buf[14] = 40; // header size
+    buf[18] = width & 0xff;
+    buf[19] = (width >> 8) & 0xff;
+    buf[22] = height & 0xff;
+    buf[23] = (height >> 8) & 0xff;
+    buf[26] = 1; // the number of the plane
+    buf[28] = 24; // bpp
+    buf[34] = total_size - 54; // size of the body
+
+    buf += 54;
+
+    unsigned char* decomp_buffer = new unsigned char[width * height + 4];
+
+    for (i = 0; i < 3; i++) {
+        count = 0;
+        decomp_buffer[count++] = c = oldGetbit(s, 8);
+        while (count < (unsigned) (width * height)) {
+            n = oldGetbit(s, 3);
+            if (n == 0) {
+                decomp_buffer[count++] = c;
+                decomp_buffer[count++] = c;
+                decomp_buffer[count++] = c;
+                decomp_buffer[count++] = c;
+                continue;
+            }
+            else if (n == 7) {
+                m = oldGetbit(s, 1) + 1;
+            }
+            else {
+                m = n + 2;
+            }
+
+            for (j = 0; j < 4; j++) {
+                if (m == 8) {
+                    c = oldGetbit(s, 8);
+                }
+                else {
+                    k = oldGetbit(s, m);
+                    if (k & 1) c += (k >> 1) + 1;
+                    else c -= (k >> 1);
+                }
+
+                decomp_buffer[count++] = c;
+            }
+        }
+
+        pbuf  = buf + (width * 3 + width_pad) * (height - 1) + i;
+        psbuf = decomp_buffer;
+
+        for (j = 0; j < height; j++) {
+            if (j & 1) {
+                for (k = 0; k < width; k++, pbuf -= 3) *pbuf = *psbuf++;
+
+                pbuf -= width * 3 + width_pad - 3;
+            }
+            else {
+                for (k = 0; k < width; k++, pbuf += 3) *pbuf = *psbuf++;
+
+                pbuf -= width * 3 + width_pad + 3;
+            }
+        }
+    }
+
+    delete[] decomp_buffer;
+
+    return total_size;
+}
+
+
+// Can write up to 16 bytes past original_length.
+size_t BenchReader::oldDecodeLZSS(OldStream& s, size_t original_length,
+                                  unsigned char* buf)
+{
+    unsigned int count = 0;
+    int i, j, k, r, c;
+    unsigned char ring[N];
+
+    memset(ring, 0, N);
+    r = N - F;
+
+    while (count < original_length) {
+        if (oldGetbit(s, 1)) {
+            if ((c = oldGetbit(s, 8)) == EOF) break;
+
+            buf[count++] = c;
+            ring[r++] = c;  r &= (N - 1);
+        }
+        else {
+            if ((i = oldGetbit(s, EI)) == EOF) break;
+
+            if ((j = oldGetbit(s, EJ)) == EOF) break;
+
+            for (k = 0; k <= j + 1; k++) {
+                c = ring[(i + k) & (N - 1)];
+                buf[count++] = c;
+                ring[r++] = c;  r &= (N - 1);
+            }
+        }
+    }
+
+    return count;
+}
+
+
+static unsigned int seed = 12345;
+
+static unsigned int rnd()
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+
+class BitWriter {
+public:
+    BitWriter() : acc(0), count(0) {}
+    void put(unsigned int v, int n) {
+        while (n--) {
+            acc = acc << 1 | (v >> n & 1);
+            if (++count == 8) {
+                out.push_back(acc);
+                acc = 0;
+                count = 0;
+            }
+        }
+    }
+    std::vector<unsigned char>& finish() {
+        if (count) put(0, 8 - count);
+        return out;
+    }
+
+private:
+    std::vector<unsigned char> out;
+    unsigned int acc;
+    int count;
+};
+
+
+// A valid SPB stream with a mix of flat runs and deltas of every
+// width; the decoders only care that it parses.
+static std::vector<unsigned char> makeSPB(int width, int height)
+{
+    BitWriter w;
+    w.put(width, 16);
+    w.put(height, 16);
+    for (int i = 0; i < 3; i++) {
+        w.put(rnd() & 0xff, 8);
+        for (int count = 1; count < width * height; ) {
+            if (rnd() % 10 < 3) {
+                w.put(0, 3);
+                count += 4;
+                continue;
+            }
+            int n = 1 + rnd() % 7, m;
+            w.put(n, 3);
+            if (n == 7) {
+                m = 1 + rnd() % 2;
+                w.put(m - 1, 1);
+            }
+            else {
+                m = n + 2;
+            }
+            for (int j = 0; j < 4; j++, count++)
+                w.put(rnd() & ((1 << m) - 1), m);
+        }
+    }
+    return w.finish();
+}
+
+
+static std::vector<unsigned char> makeText(size_t length)
+{
+    static const char* words[] = {
+        "the", "quick", "brown", "fox", "jumps", "over", "the", "lazy",
+        "dog", "\n", "aaaaaaaaaaaaaaaaaaaa", "ab", "xyz", "@", "\\"
+    };
+    std::vector<unsigned char> out;
+    while (out.size() < length) {
+        const char* w = words[rnd() % (sizeof words / sizeof *words)];
+        out.insert(out.end(), w, w + strlen(w));
+        out.push_back(' ');
+    }
+    out.resize(length);
+    return out;
+}
+
+
+// Greedy, against the last N - F - 1 bytes so every match lies in
+// output already written.
+static std::vector<unsigned char> encodeLZSS(const std::vector<unsigned char>& data)
+{
+    BitWriter w;
+    for (size_t p = 0; p < data.size(); ) {
+        size_t best = 0, best_dist = 0;
+        size_t window = p < N - F - 1 ? p : N - F - 1;
+        for (size_t d = 1; d <= window && best < F; d++) {
+            size_t l = 0;
+            while (l < F && p + l < data.size() && data[p - d + l] == data[p + l])
+                l++;
+            if (l > best) {
+                best = l;
+                best_dist = d;
+            }
+        }
+        if (best >= 2) {
+            w.put(0, 1);
+            w.put((N - F + p - best_dist) & (N - 1), EI);
+            w.put(best - 2, EJ);
+            p += best;
+        }
+        else {
+            w.put(1, 1);
+            w.put(data[p++], 8);
+        }
+    }
+    return w.finish();
+}
+
+
+// Stores data so that it reads back as it is under key_table.
+static FILE* store(const std::vector<unsigned char>& data,
+                   const unsigned char* key_table)
+{
+    unsigned char inverse[256];
+    for (int i = 0; i < 256; i++) inverse[key_table[i]] = i;
+
+    std::vector<unsigned char> out(data.size());
+    for (size_t i = 0; i < data.size(); i++) out[i] = inverse[data[i]];
+
+    FILE* fp = tmpfile();
+    if (fp && (fwrite(&out[0], 1, out.size(), fp) != out.size() ||
+               fflush(fp))) {
+        fclose(fp);
+        fp = NULL;
+    }
+    return fp;
+}
+
+
+// Seconds for the fastest of a few runs.
+class Timer {
+public:
+    Timer() : best(1e9), start(0), runs(0) {}
+    bool running() {
+        if (start) {
+            double s = (double) (SDL_GetPerformanceCounter() - start) /
+                       SDL_GetPerformanceFrequency();
+            if (s < best) best = s;
+        }
+        if (runs++ == RUNS) return false;
+        start = SDL_GetPerformanceCounter();
+        return true;
+    }
+    double best;
+
+private:
+    enum { RUNS = 5 };
+    Uint64 start;
+    int runs;
+};
+
+
+static void report(const char* key, const char* format, size_t length,
+                   double old_s, double new_s)
+{
+    printf("  %-8s %-5s %8.1f MB/s %8.1f MB/s  %5.1fx\n", key, format,
+           length / old_s / 1e6, length / new_s / 1e6, old_s / new_s);
+}
+
+
+int main(int argc, char** argv)
+{
+    if (argc > 1) {
+        fprintf(stderr, "Usage: decodebench\n");
+        return 2;
+    }
+
+    std::vector<unsigned char> spb = makeSPB(SPB_WIDTH, SPB_HEIGHT);
+    std::vector<unsigned char> text = makeText(LZSS_LENGTH);
+    std::vector<unsigned char> lzss = encodeLZSS(text);
+
+    unsigned char plain[256], xored[256], permuted[256];
+    for (int i = 0; i < 256; i++) {
+        plain[i] = i;
+        xored[i] = i ^ 0x5a;
+        permuted[i] = i;
+    }
+    for (int i = 255; i > 0; i--) {
+        int j = rnd() % (i + 1);
+        unsigned char t = permuted[i];
+        permuted[i] = permuted[j];
+        permuted[j] = t;
+    }
+    struct { const char* name; const unsigned char* table; } keys[] = {
+        { "none", plain }, { "xor", xored }, { "permuted", permuted }
+    };
+
+    size_t spb_length = (SPB_WIDTH * 3 + (4 - SPB_WIDTH * 3 % 4) % 4) *
+                        SPB_HEIGHT + 54;
+    std::vector<unsigned char> old_buf(spb_length > text.size() ?
+                                       spb_length + 16 : text.size() + 16);
+    std::vector<unsigned char> new_buf(old_buf.size());
+
+    int failures = 0;
+    printf("  key      data       before        after\n");
+    for (size_t k = 0; k < sizeof keys / sizeof *keys; k++) {
+        BenchReader reader(keys[k].table);
+        FILE* spb_fp = store(spb, keys[k].table);
+        FILE* lzss_fp = store(lzss, keys[k].table);
+        if (!spb_fp || !lzss_fp) {
+            fprintf(stderr, "Couldn't write the test data\n");
+            return 1;
+        }
+        MappedFile spb_map, lzss_map;
+        spb_map.map(spb_fp);
+        lzss_map.map(lzss_fp);
+
+        Timer old_t, new_t;
+        size_t old_len = 0, new_len = 0;
+        while (old_t.running())
+            old_len = reader.oldSPB(spb_fp, &spb_map, &old_buf[0]);
+        while (new_t.running())
+            new_len = reader.spb(spb_fp, &spb_map, &new_buf[0]);
+        if (old_len != spb_length || new_len != spb_length ||
+            memcmp(&old_buf[0], &new_buf[0], spb_length)) {
+            fprintf(stderr, "%s: SPB output differs\n", keys[k].name);
+            failures++;
+        }
+        report(keys[k].name, "SPB", spb_length, old_t.best, new_t.best);
+
+        Timer old_lt, new_lt;
+        while (old_lt.running())
+            old_len = reader.oldLZSS(lzss_fp, &lzss_map, text.size(),
+                                     &old_buf[0]);
+        while (new_lt.running())
+            new_len = reader.lzss(lzss_fp, &lzss_map, text.size(),
+                                  &new_buf[0]);
+        if (old_len < text.size() || new_len != text.size() ||
+            memcmp(&old_buf[0], &text[0], text.size()) ||
+            memcmp(&new_buf[0], &text[0], text.size())) {
+            fprintf(stderr, "%s: LZSS output differs\n", keys[k].name);
+            failures++;
+        }
+        report(keys[k].name, "LZSS", text.size(), old_lt.best, new_lt.best);
+
+        spb_map.unmap();
+        lzss_map.unmap();
+        fclose(spb_fp);
+        fclose(lzss_fp);
+    }
+
+    return failures ? 1 : 0;
+}
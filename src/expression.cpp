@@ -103,7 +103,7 @@ pstring Expression::as_string() const
     if (is_textual() && is_constant())
 	return strval_;
     else if (is_textual())
-	return h.getVariableData(intval_).str;
+	return h.getVariableData(intval_).get_str();
     else if (is_numeric()) {
 	pstring rv;
 	rv.format("%d", as_int());
@@ -162,19 +162,19 @@ void Expression::mutate(int newval, int offset, bool as_array)
 void Expression::mutate(const pstring& newval)
 {
     require(String, true);
-    h.getVariableData(intval_).str = newval;
+    h.getVariableData(intval_).set_str(newval);
 }
 
 void Expression::append(const pstring& newval)
 {
     require(String, true);
-    h.getVariableData(intval_).str += newval;
+    h.getVariableData(intval_).append_str(newval);
 }
 
 void Expression::append(wchar newval)
 {
     require(String, true);
-    h.getVariableData(intval_).str += file_encoding->Encode(newval);
+    h.getVariableData(intval_).append_str(file_encoding->Encode(newval));
 }
 
 Expression::Expression(ScriptHandler& sh)
@@ -28,6 +28,7 @@
 #include FT_TRUETYPE_IDS_H
 
 #include "font.h"
+#include "Profiler.h"
 
 
 FT_Library freetype;
@@ -77,6 +78,10 @@ kerning_mode()
 #define FT_FLOOR(X) (((X) & - 64) / 64)
 #define FT_CEIL(X) ((((X) +63) & - 64) / 64)
 
+// Each cache is simply emptied when it reaches this many entries; a
+// page of text uses a few hundred distinct glyphs at most.
+#define MAX_CACHED_GLYPHS 4096
+
 struct FontInternals {
     FT_Open_Args args, met;
     FT_Face face;
@@ -85,6 +90,16 @@ struct FontInternals {
     int currsize;
     bool del_data;
 
+    // Rendered coverage bitmaps, glyph metrics and kerning pairs, so
+    // that line breaking and redrawing text (lookback, rclick menus)
+    // don't have to go back to FreeType for every character.
+    typedef dictionary<Uint64, Glyph>::t glyph_cache_t;
+    typedef dictionary<Uint64, FT_Glyph_Metrics>::t metrics_cache_t;
+    typedef dictionary<Uint64, FT_Pos>::t kerning_cache_t;
+    glyph_cache_t glyph_cache;
+    metrics_cache_t metrics_cache;
+    kerning_cache_t kerning_cache;
+
     FontInternals(const Uint8* data, size_t len, const Uint8* mdat,
 		  size_t mlen, bool own);
 
@@ -102,6 +117,25 @@ struct FontInternals {
 			    load_mode());
         return face->glyph;
     }
+
+    // Everything that affects the outline FreeType loads.
+    Uint64 glyph_key(Uint16 unicode)
+    {
+        return Uint64(unicode) | Uint64(currsize & 0xffff) << 16
+             | Uint64(hinting) << 32;
+    }
+
+    // The transform set by Font::render_glyph() doesn't affect
+    // glyph->metrics, so these are the same for every subpixel phase.
+    const FT_Glyph_Metrics& glyph_metrics(Uint16 unicode)
+    {
+        Uint64 key = glyph_key(unicode);
+        metrics_cache_t::iterator it = metrics_cache.find(key);
+        if (it != metrics_cache.end()) return it->second;
+
+        if (metrics_cache.size() >= MAX_CACHED_GLYPHS) metrics_cache.clear();
+        return metrics_cache[key] = load_glyph(unicode)->metrics;
+    }
 };
 
 FontInternals::FontInternals(const Uint8* data, size_t len, const Uint8* mdat,
@@ -187,7 +221,7 @@ Font::~Font()
 
 void Font::get_metrics(Uint16 ch, float* minx, float* maxx, float* miny, float* maxy)
 {
-    FT_Glyph_Metrics& metrics = priv->load_glyph(ch)->metrics;
+    const FT_Glyph_Metrics& metrics = priv->glyph_metrics(ch);
     float hbx = float (metrics.horiBearingX) / 64.0;
     float hby = float (metrics.horiBearingY) / 64.0;
     if (!subpixel) {
@@ -213,7 +247,7 @@ void Font::get_metrics(Uint16 ch, float* minx, float* maxx, float* miny, float*
 
 float Font::advance(Uint16 ch)
 {
-    FT_Glyph_Metrics& metrics = priv->load_glyph(ch)->metrics;
+    const FT_Glyph_Metrics& metrics = priv->glyph_metrics(ch);
     float rv = float (metrics.horiAdvance) / 64.0;
     return subpixel ? rv : floor(rv);
 }
@@ -221,14 +255,28 @@ float Font::advance(Uint16 ch)
 
 float Font::kerning(Uint16 left, Uint16 right)
 {
-    FT_Face&  face = priv->face;
-    FT_Vector kern;
-    FT_Error  err = FT_Get_Kerning(face, FT_Get_Char_Index(face, left),
-                        FT_Get_Char_Index(face, right),
-                        kerning_mode(), &kern);
-    if (err) return 0.0;
-
-    float rv = float (kern.x) / 64.0;
+    Uint64 key = Uint64(left) | Uint64(right) << 16
+               | Uint64(priv->currsize & 0xffff) << 32;
+    FontInternals::kerning_cache_t::iterator it = priv->kerning_cache.find(key);
+    FT_Pos x;
+    if (it != priv->kerning_cache.end()) {
+        x = it->second;
+    }
+    else {
+        FT_Face&  face = priv->face;
+        FT_Vector kern;
+        FT_Error  err = FT_Get_Kerning(face, FT_Get_Char_Index(face, left),
+                            FT_Get_Char_Index(face, right),
+                            kerning_mode(), &kern);
+        x = err ? 0 : kern.x;
+
+        if (priv->kerning_cache.size() >= MAX_CACHED_GLYPHS)
+            priv->kerning_cache.clear();
+        priv->kerning_cache[key] = x;
+    }
+    if (!x) return 0.0;
+
+    float rv = float (x) / 64.0;
     return subpixel ? rv : floor(rv);
 }
 
@@ -256,12 +304,23 @@ void Font::set_size(int val)
 }
 
 
-Glyph Font::render_glyph(Uint16 ch, SDL_Color fg, SDL_Color bg, float x_fractional_part)
+Glyph Font::render_glyph(Uint16 ch, float x_fractional_part)
 {
     Glyph rv;
     FT_Vector v;
     v.x = subpixel ? FT_Pos(x_fractional_part * 64.0) : 0;
     v.y = 0;
+
+    Uint64 key = priv->glyph_key(ch) | Uint64(lightrender) << 34
+               | Uint64(v.x & 63) << 35;
+    FontInternals::glyph_cache_t::iterator it = priv->glyph_cache.find(key);
+    if (it != priv->glyph_cache.end()) {
+        Profiler::count(Profiler::GLYPH_CACHE_HIT);
+        return it->second;
+    }
+    Profiler::count(Profiler::GLYPH_CACHE_MISS);
+    Profiler::Scope scope(Profiler::GLYPH);
+
     FT_Set_Transform(priv->face, 0, &v);
 
     FT_GlyphSlot glyph = priv->load_glyph(ch);
@@ -277,16 +336,11 @@ Glyph Font::render_glyph(Uint16 ch, SDL_Color fg, SDL_Color bg, float x_fraction
     rv.left = glyph->bitmap_left;
     rv.top = glyph->bitmap_top;
 
-    // Fill palette with 256 shades interpolating between foreground
-    // and background colours.
+    // Fill palette with 256 shades of grey, so that the pixel values
+    // are the coverage and the surface still makes sense to SDL.
     SDL_Palette* pal = rv.bitmap->format->palette;
-    int dr = fg.r - bg.r;
-    int dg = fg.g - bg.g;
-    int db = fg.b - bg.b;
     for (int i = 0; i < 256; ++i) {
-        pal->colors[i].r = bg.r + i * dr / 255;
-        pal->colors[i].g = bg.g + i * dg / 255;
-        pal->colors[i].b = bg.b + i * db / 255;
+        pal->colors[i].r = pal->colors[i].g = pal->colors[i].b = i;
     }
 
     // Copy the character from the pixmap
@@ -301,6 +355,10 @@ Glyph Font::render_glyph(Uint16 ch, SDL_Color fg, SDL_Color bg, float x_fraction
 
     SDL_UnlockSurface(rv.bitmap);
 
+    if (priv->glyph_cache.size() >= MAX_CACHED_GLYPHS)
+        priv->glyph_cache.clear();
+    priv->glyph_cache[key] = rv;
+
     return rv;
 }
 
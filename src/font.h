@@ -46,11 +46,11 @@ struct Glyph {
     Glyph(const Glyph& other) :
 	bitmap(other.bitmap), left(other.left), top(other.top)
     {
-	++bitmap->refcount;
+	if (bitmap) ++bitmap->refcount;
     }
 
     Glyph& operator= (const Glyph& other) {
-	++other.bitmap->refcount;
+	if (other.bitmap) ++other.bitmap->refcount;
 	if (bitmap) SDL_FreeSurface(bitmap);
 	bitmap = other.bitmap;
 	left = other.left;
@@ -74,7 +74,11 @@ public:
     void get_metrics(Uint16 ch, float* minx, float* maxx, float* miny, float* maxy);
 
     void set_size(int val);
-    Glyph render_glyph(Uint16 ch, SDL_Color fg, SDL_Color bg, float x_fractional_part);
+
+    // Returns an 8-bit coverage bitmap (0 = transparent, 255 = solid);
+    // colour is applied when it is blended.  The bitmap is shared with
+    // the font's glyph cache and must not be modified.
+    Glyph render_glyph(Uint16 ch, float x_fractional_part);
 
     int ascent();
     int lineskip();
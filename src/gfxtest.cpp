@@ -0,0 +1,533 @@
+/* -*- C++ -*-
+ *
+ *  gfxtest.cpp - Checks the accelerated graphics kernels against the
+ *                plain C ones and times them
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+// Usage: gfxtest [-b]
+//
+// Runs every kernel of every back end this CPU supports on random
+// rows and compares the result, byte for byte, with the _Basic
+// version the engine would otherwise use.  Buffers are checked past
+// the end of the row too, so a kernel that writes too far fails.
+// Exits non-zero on any difference.  With -b it then times each
+// kernel on 1920x1080 surfaces.
+
+#include "graphics_accelerated.h"
+#include "graphics_common.h"
+#include "graphics_avx2.h"
+#include "graphics_mmx.h"
+#include "graphics_neon.h"
+#include "graphics_sse2.h"
+#include "graphics_ssse3.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#ifdef BPP16
+#error "gfxtest checks the 32-bit kernels"
+#endif
+
+#define ITERATIONS 2000
+#define MAX_ROW 300
+#define SLACK 16      // pixels checked beyond the end of each row
+
+#define BENCH_WIDTH 1920
+#define BENCH_HEIGHT 1080
+
+typedef void (*MeanFn)(unsigned char*, unsigned char*, unsigned char*, int);
+typedef void (*AddToFn)(unsigned char*, unsigned char*, int);
+typedef void (*BlendFn)(Uint32*, Uint32*, Uint8*, int, int);
+typedef void (*TextFn)(Uint32*, Uint8*, Uint32, Uint32, int);
+typedef void (*LerpFn)(unsigned char*, Uint16*, Uint16*, int, int);
+typedef bool (*MaskFn)(SDL_Surface*, SDL_Surface*, SDL_Surface*,
+                       SDL_Surface*, const SDL_Rect&, Uint32);
+typedef void (*ConstFn)(SDL_Surface*, SDL_Surface*, SDL_Surface*,
+                        const SDL_Rect&, Uint32);
+
+// One set of kernels.  A back end without its own version of a
+// kernel leaves it NULL.
+struct Backend {
+    const char* name;
+    bool (*usable)();
+    MeanFn mean;
+    AddToFn addTo, subFrom;
+    BlendFn blend, addBlend, subBlend;
+    TextFn blendText;
+    LerpFn lerp;
+    MaskFn mask;
+    ConstFn maskConst;
+};
+
+static bool always() { return true; }
+
+#ifdef USE_X86_GFX
+static bool hasMMX()   { return __builtin_cpu_supports("mmx"); }
+static bool hasSSE2()  { return __builtin_cpu_supports("sse2"); }
+static bool hasSSSE3() { return __builtin_cpu_supports("ssse3"); }
+#endif
+
+static const Backend backends[] = {
+#ifdef USE_X86_GFX
+    { "MMX", hasMMX, imageFilterMean_MMX, imageFilterAddTo_MMX,
+      imageFilterSubFrom_MMX, NULL, NULL, NULL, NULL, NULL, NULL, NULL },
+    { "SSE2", hasSSE2, imageFilterMean_SSE2, imageFilterAddTo_SSE2,
+      imageFilterSubFrom_SSE2, imageFilterBlend_SSE2,
+      imageFilterAddBlend_SSE2, imageFilterSubBlend_SSE2,
+      imageFilterBlendText_SSE2, imageFilterLerp_SSE2, alphaMaskBlend_SSE2,
+      alphaMaskBlendConst_SSE2 },
+    { "SSSE3", hasSSSE3, NULL, NULL, NULL, imageFilterBlend_SSSE3, NULL,
+      NULL, NULL, NULL, alphaMaskBlend_SSSE3, alphaMaskBlendConst_SSSE3 },
+    { "AVX2", hasAVX2, imageFilterMean_AVX2, imageFilterAddTo_AVX2,
+      imageFilterSubFrom_AVX2, imageFilterBlend_AVX2,
+      imageFilterAddBlend_AVX2, imageFilterSubBlend_AVX2, NULL,
+      imageFilterLerp_AVX2, alphaMaskBlend_AVX2, alphaMaskBlendConst_AVX2 },
+#endif
+#ifdef USE_ARM_GFX
+    { "NEON", always, imageFilterMean_NEON, imageFilterAddTo_NEON,
+      imageFilterSubFrom_NEON, imageFilterBlend_NEON,
+      imageFilterAddBlend_NEON, imageFilterSubBlend_NEON,
+      imageFilterBlendText_NEON, imageFilterLerp_NEON, alphaMaskBlend_NEON,
+      alphaMaskBlendConst_NEON },
+#endif
+    { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL }
+};
+
+
+static unsigned int seed = 12345;
+
+static unsigned int rnd()
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+
+// Pixels with a good share of fully opaque and fully transparent
+// ones, which the kernels treat specially.
+static Uint32 randomPixel()
+{
+    Uint32 v = rnd() ^ (rnd() << 16);
+    switch (rnd() % 4) {
+    case 0: return v | AMASK;
+    case 1: return v & ~AMASK;
+    default: return v;
+    }
+}
+
+
+static int randomAlpha()
+{
+    switch (rnd() % 4) {
+    case 0: return 0;
+    case 1: return 255;
+    case 2: return 256;
+    default: return rnd() % 257;
+    }
+}
+
+
+static SDL_Surface* makeSurface(int w, int h)
+{
+    SDL_Surface* s = SDL_CreateRGBSurface(0, w, h, 32, RMASK, GMASK, BMASK,
+                                          AMASK);
+    for (int y = 0; y < h; y++) {
+        Uint32* p = getPointerToRow<Uint32>(s, y);
+        for (int x = 0; x < w; x++) p[x] = randomPixel();
+    }
+    return s;
+}
+
+
+static bool sameSurface(SDL_Surface* a, SDL_Surface* b)
+{
+    for (int y = 0; y < a->h; y++)
+        if (memcmp(getPointerToRow<Uint32>(a, y), getPointerToRow<Uint32>(b, y),
+                   a->w * 4))
+            return false;
+    return true;
+}
+
+
+static void copySurface(SDL_Surface* dst, SDL_Surface* src)
+{
+    for (int y = 0; y < src->h; y++)
+        memcpy(getPointerToRow<Uint32>(dst, y), getPointerToRow<Uint32>(src, y),
+               src->w * 4);
+}
+
+
+// What PonscripterLabel::alphaMaskBlendBand() does when
+// alphaMaskBlend() declines: the mask repeats across the screen.
+static void maskBlendReference(SDL_Surface* dst, SDL_Surface* s1,
+                               SDL_Surface* s2, SDL_Surface* mask,
+                               const SDL_Rect& r, Uint32 mask_value)
+{
+    for (int y = r.y; y < r.y + r.h; y++) {
+        Uint32* m = getPointerToRow<Uint32>(mask, y % mask->h);
+        Uint32* a = getPointerToRow<Uint32>(s1, y);
+        Uint32* b = getPointerToRow<Uint32>(s2, y);
+        Uint32* d = getPointerToRow<Uint32>(dst, y);
+        for (int x = r.x; x < r.x + r.w; x++)
+            d[x] = blendMaskOnePixel(a[x], b[x], m[x % mask->w], mask_value);
+    }
+}
+
+
+static int failures = 0;
+
+static void fail(const Backend& b, const char* kernel, const char* detail)
+{
+    if (failures++ < 20)
+        fprintf(stderr, "%s %s differs from _Basic (%s)\n", b.name, kernel,
+                detail);
+}
+
+
+static void checkBytes(const Backend& b)
+{
+    // Lengths from nothing to several vectors, so that the tail and
+    // the rows too short for one vector are both covered.
+    int len = rnd() % (MAX_ROW * 4);
+    std::vector<unsigned char> s1(len + SLACK), s2(len + SLACK),
+        ref(len + SLACK), out;
+    for (size_t i = 0; i < s1.size(); i++) {
+        s1[i] = rnd();
+        s2[i] = rnd();
+        ref[i] = rnd();
+    }
+
+    char detail[32];
+    sprintf(detail, "length %d", len);
+    if (b.mean) {
+        out = ref;
+        imageFilterMean_Basic(&s1[0], &s2[0], &ref[0], len);
+        b.mean(&s1[0], &s2[0], &out[0], len);
+        if (out != ref) fail(b, "imageFilterMean", detail);
+    }
+    if (b.addTo) {
+        out = ref;
+        imageFilterAddTo_Basic(&ref[0], &s1[0], len);
+        b.addTo(&out[0], &s1[0], len);
+        if (out != ref) fail(b, "imageFilterAddTo", detail);
+    }
+    if (b.subFrom) {
+        out = ref;
+        imageFilterSubFrom_Basic(&ref[0], &s2[0], len);
+        b.subFrom(&out[0], &s2[0], len);
+        if (out != ref) fail(b, "imageFilterSubFrom", detail);
+    }
+}
+
+
+static void checkBlend(const Backend& b, BlendFn basic, BlendFn fn,
+                       const char* kernel)
+{
+    if (!fn) return;
+
+    int len = rnd() % MAX_ROW;
+    int alpha = randomAlpha();
+    std::vector<Uint32> src(len + SLACK), ref(len + SLACK), out;
+    for (size_t i = 0; i < src.size(); i++) {
+        src[i] = randomPixel();
+        ref[i] = randomPixel();
+    }
+    out = ref;
+    basic(&ref[0], &src[0], (Uint8*) &src[0] + 3, alpha, len);
+    fn(&out[0], &src[0], (Uint8*) &src[0] + 3, alpha, len);
+
+    char detail[48];
+    sprintf(detail, "length %d, alpha %d", len, alpha);
+    if (out != ref) fail(b, kernel, detail);
+}
+
+
+// Glyph coverage: runs of blank and solid with antialiased edges.
+static void checkText(const Backend& b)
+{
+    if (!b.blendText) return;
+
+    int len = rnd() % MAX_ROW;
+    std::vector<Uint8> cov(len + SLACK);
+    int run = 0;
+    for (size_t i = 0; i < cov.size(); i++) {
+        if (rnd() % 20 == 0) run = rnd() % 3;
+        cov[i] = run == 0 ? 0 : run == 1 ? 255 : rnd();
+    }
+    std::vector<Uint32> ref(len + SLACK), out;
+    for (size_t i = 0; i < ref.size(); i++) ref[i] = randomPixel();
+    out = ref;
+
+    Uint32 color = rnd();
+    imageFilterBlendText_Basic(&ref[0], &cov[0], color & (RMASK | BMASK),
+                               color & GMASK, len);
+    b.blendText(&out[0], &cov[0], color & (RMASK | BMASK), color & GMASK,
+                len);
+
+    char detail[48];
+    sprintf(detail, "length %d, colour %06x", len, color & 0xffffff);
+    if (out != ref) fail(b, "imageFilterBlendText", detail);
+}
+
+
+// Rows of the resizer's 8x-scaled samples.
+static void checkLerp(const Backend& b)
+{
+    if (!b.lerp) return;
+
+    int len = rnd() % (MAX_ROW * 4);
+    int weight = rnd() % 8;
+    std::vector<Uint16> s1(len + SLACK), s2(len + SLACK);
+    std::vector<unsigned char> ref(len + SLACK), out;
+    for (size_t i = 0; i < s1.size(); i++) {
+        s1[i] = rnd() % (8 * 255 + 1);
+        s2[i] = rnd() % (8 * 255 + 1);
+        ref[i] = rnd();
+    }
+    out = ref;
+    imageFilterLerp_Basic(&ref[0], &s1[0], &s2[0], weight, len);
+    b.lerp(&out[0], &s1[0], &s2[0], weight, len);
+
+    char detail[48];
+    sprintf(detail, "length %d, weight %d", len, weight);
+    if (out != ref) fail(b, "imageFilterLerp", detail);
+}
+
+
+static void checkMask(const Backend& b)
+{
+    if (!b.mask && !b.maskConst) return;
+
+    // Masks narrower and shorter than the area, so that they wrap,
+    // and rectangles that don't start at the origin.
+    int w = 1 + rnd() % 100, h = 1 + rnd() % 6;
+    SDL_Surface* s1 = makeSurface(w, h);
+    SDL_Surface* s2 = makeSurface(w, h);
+    SDL_Surface* mask = makeSurface(1 + rnd() % 40, 1 + rnd() % 4);
+    SDL_Surface* ref = makeSurface(w, h);
+    SDL_Surface* out = makeSurface(w, h);
+
+    SDL_Rect r;
+    r.x = rnd() % w;
+    r.y = rnd() % h;
+    r.w = w - r.x - rnd() % (w - r.x);
+    r.h = h - r.y;
+    Uint32 mask_value = rnd() % 4 == 0 ? 1000 : rnd() % 512;
+
+    char detail[64];
+    sprintf(detail, "%dx%d at %d,%d, mask %dx%d, value %u", r.w, r.h, r.x,
+            r.y, mask->w, mask->h, mask_value);
+    if (b.mask) {
+        copySurface(out, ref);
+        maskBlendReference(ref, s1, s2, mask, r, mask_value);
+        if (b.mask(out, s1, s2, mask, r, mask_value) &&
+            !sameSurface(out, ref))
+            fail(b, "alphaMaskBlend", detail);
+    }
+    if (b.maskConst) {
+        mask_value %= 300;
+        sprintf(detail, "%dx%d at %d,%d, value %u", r.w, r.h, r.x, r.y,
+                mask_value);
+        copySurface(out, ref);
+        alphaMaskBlendConst_Basic(ref, s1, s2, r, mask_value);
+        b.maskConst(out, s1, s2, r, mask_value);
+        if (!sameSurface(out, ref)) fail(b, "alphaMaskBlendConst", detail);
+    }
+
+    SDL_FreeSurface(s1);
+    SDL_FreeSurface(s2);
+    SDL_FreeSurface(mask);
+    SDL_FreeSurface(ref);
+    SDL_FreeSurface(out);
+}
+
+
+static void check(const Backend& b)
+{
+    for (int i = 0; i < ITERATIONS; i++) {
+        checkBytes(b);
+        checkBlend(b, imageFilterBlend_Basic, b.blend, "imageFilterBlend");
+        checkBlend(b, imageFilterAddBlend_Basic, b.addBlend,
+                   "imageFilterAddBlend");
+        checkBlend(b, imageFilterSubBlend_Basic, b.subBlend,
+                   "imageFilterSubBlend");
+        checkText(b);
+        checkLerp(b);
+        checkMask(b);
+    }
+}
+
+
+// Milliseconds per call, best of a few runs.
+class Timer {
+public:
+    Timer() : best(1e9), start(0), runs(0) {}
+    bool running() {
+        if (start) {
+            double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 /
+                        SDL_GetPerformanceFrequency();
+            if (ms < best) best = ms;
+        }
+        if (runs++ == RUNS) return false;
+        start = SDL_GetPerformanceCounter();
+        return true;
+    }
+    double best;
+
+private:
+    enum { RUNS = 5 };
+    Uint64 start;
+    int runs;
+};
+
+
+struct Frame {
+    SDL_Surface *s1, *s2, *mask, *dst;
+    SDL_Rect all;
+    std::vector<Uint8> text;     // a screen of glyph coverage
+    std::vector<Uint16> samples; // two rows of resizer samples
+};
+
+
+static void report(const char* backend, const char* kernel, double ms,
+                   double basic_ms)
+{
+    printf("  %-8s %-20s %8.2f ms  %5.1fx\n", backend, kernel, ms,
+           basic_ms / ms);
+}
+
+
+static void bench(const Backend& b, Frame& f, double* basic)
+{
+    unsigned char* p1 = (unsigned char*) f.s1->pixels;
+    unsigned char* p2 = (unsigned char*) f.s2->pixels;
+    unsigned char* pd = (unsigned char*) f.dst->pixels;
+    int bytes = f.dst->pitch * f.dst->h;
+    int k = 0;
+
+#define BENCH(fn, kernel, call)                                 \
+    if (fn) {                                                   \
+        Timer t;                                                \
+        while (t.running()) { call; }                           \
+        if (!basic[k]) basic[k] = t.best;                       \
+        report(b.name, kernel, t.best, basic[k]);               \
+    }                                                           \
+    k++;
+
+    BENCH(b.mean, "imageFilterMean", b.mean(p1, p2, pd, bytes))
+    BENCH(b.addTo, "imageFilterAddTo", b.addTo(pd, p1, bytes))
+    BENCH(b.subFrom, "imageFilterSubFrom", b.subFrom(pd, p1, bytes))
+    BENCH(b.blend, "imageFilterBlend",
+          for (int y = 0; y < f.dst->h; y++) {
+              Uint32* s = getPointerToRow<Uint32>(f.s1, y);
+              b.blend(getPointerToRow<Uint32>(f.dst, y), s,
+                      (Uint8*) s + 3, 200, f.dst->w);
+          })
+    BENCH(b.addBlend, "imageFilterAddBlend",
+          for (int y = 0; y < f.dst->h; y++) {
+              Uint32* s = getPointerToRow<Uint32>(f.s1, y);
+              b.addBlend(getPointerToRow<Uint32>(f.dst, y), s,
+                         (Uint8*) s + 3, 200, f.dst->w);
+          })
+    BENCH(b.subBlend, "imageFilterSubBlend",
+          for (int y = 0; y < f.dst->h; y++) {
+              Uint32* s = getPointerToRow<Uint32>(f.s1, y);
+              b.subBlend(getPointerToRow<Uint32>(f.dst, y), s,
+                         (Uint8*) s + 3, 200, f.dst->w);
+          })
+    BENCH(b.blendText, "imageFilterBlendText",
+          for (int y = 0; y < f.dst->h; y++)
+              b.blendText(getPointerToRow<Uint32>(f.dst, y),
+                          &f.text[y * f.dst->w], 0xff00ff, 0xff00,
+                          f.dst->w))
+    BENCH(b.lerp, "imageFilterLerp",
+          for (int y = 0; y < f.dst->h; y++)
+              b.lerp(pd + y * f.dst->pitch, &f.samples[0],
+                     &f.samples[f.dst->w * 4], y & 7, f.dst->w * 4))
+    BENCH(b.mask, "alphaMaskBlend",
+          b.mask(f.dst, f.s1, f.s2, f.mask, f.all, 300))
+    BENCH(b.maskConst, "alphaMaskBlendConst",
+          b.maskConst(f.dst, f.s1, f.s2, f.all, 100))
+#undef BENCH
+}
+
+
+static bool maskBlendBasic(SDL_Surface* dst, SDL_Surface* s1,
+                           SDL_Surface* s2, SDL_Surface* mask,
+                           const SDL_Rect& r, Uint32 mask_value)
+{
+    maskBlendReference(dst, s1, s2, mask, r, mask_value);
+    return true;
+}
+
+
+int main(int argc, char** argv)
+{
+    bool benchmark = argc > 1 && !strcmp(argv[1], "-b");
+    if (argc > 2 || (argc == 2 && !benchmark)) {
+        fprintf(stderr, "Usage: gfxtest [-b]\n");
+        return 2;
+    }
+
+    for (const Backend* b = backends; b->name; b++) {
+        if (!b->usable()) {
+            printf("%s: not supported by this CPU\n", b->name);
+            continue;
+        }
+        int before = failures;
+        check(*b);
+        printf("%s: %s\n", b->name, failures == before ? "ok" : "FAILED");
+    }
+    if (failures) return 1;
+    if (!benchmark) return 0;
+
+    printf("%dx%d, per frame:\n", BENCH_WIDTH, BENCH_HEIGHT);
+    Frame f;
+    f.s1 = makeSurface(BENCH_WIDTH, BENCH_HEIGHT);
+    f.s2 = makeSurface(BENCH_WIDTH, BENCH_HEIGHT);
+    f.mask = makeSurface(BENCH_WIDTH, BENCH_HEIGHT);
+    f.dst = makeSurface(BENCH_WIDTH, BENCH_HEIGHT);
+    f.all.x = f.all.y = 0;
+    f.all.w = BENCH_WIDTH;
+    f.all.h = BENCH_HEIGHT;
+    // Mostly blank, with solid strokes a few pixels wide and an
+    // antialiased pixel or two at each edge, as text is.
+    f.text.resize(BENCH_WIDTH * BENCH_HEIGHT);
+    for (size_t i = 0; i < f.text.size(); ) {
+        size_t blank = rnd() % 24, solid = 1 + rnd() % 6;
+        for (; blank > 0 && i < f.text.size(); blank--) f.text[i++] = 0;
+        if (i < f.text.size()) f.text[i++] = rnd();
+        for (; solid > 0 && i < f.text.size(); solid--) f.text[i++] = 255;
+        if (i < f.text.size()) f.text[i++] = rnd();
+    }
+    f.samples.resize(BENCH_WIDTH * 4 * 2);
+    for (size_t i = 0; i < f.samples.size(); i++)
+        f.samples[i] = rnd() % (8 * 255 + 1);
+
+    const Backend basic = { "Basic", always, imageFilterMean_Basic,
+                            imageFilterAddTo_Basic, imageFilterSubFrom_Basic,
+                            imageFilterBlend_Basic, imageFilterAddBlend_Basic,
+                            imageFilterSubBlend_Basic,
+                            imageFilterBlendText_Basic, imageFilterLerp_Basic,
+                            maskBlendBasic, alphaMaskBlendConst_Basic };
+    double basic_ms[16] = { 0 };
+    bench(basic, f, basic_ms);
+    for (const Backend* b = backends; b->name; b++)
+        if (b->usable()) bench(*b, f, basic_ms);
+    return 0;
+}
@@ -26,7 +26,9 @@
 #include "graphics_common.h"
 
 #include "graphics_altivec.h"
+#include "graphics_avx2.h"
 #include "graphics_mmx.h"
+#include "graphics_neon.h"
 #include "graphics_sse2.h"
 #include "graphics_ssse3.h"
 
@@ -67,13 +69,13 @@ void imageFilterMean_Basic(unsigned char *src1, unsigned char *src2, unsigned ch
     }
 }
 
-void imageFilterAddTo_Basic(unsigned char *src, unsigned char *dst, int length) {
+void imageFilterAddTo_Basic(unsigned char *dst, unsigned char *src, int length) {
     for (int i = 0; i < length; i++) {
         addto_pixel(dst[i], src[i]);
     }
 }
 
-void imageFilterSubFrom_Basic(unsigned char *src, unsigned char *dst, int length) {
+void imageFilterSubFrom_Basic(unsigned char *dst, unsigned char *src, int length) {
     for (int i = 0; i < length; i++) {
         subfrom_pixel(dst[i], src[i]);
     }
@@ -86,6 +88,38 @@ void imageFilterBlend_Basic(Uint32 *dst_buffer, Uint32 *src_buffer,
     BASIC_BLEND();
 }
 
+void imageFilterAddBlend_Basic(Uint32 *dst_buffer, Uint32 *src_buffer,
+                               Uint8 *alphap, int alpha, int length)
+{
+    int n = length + 1;
+    BASIC_ADDBLEND();
+}
+
+void imageFilterSubBlend_Basic(Uint32 *dst_buffer, Uint32 *src_buffer,
+                               Uint8 *alphap, int alpha, int length)
+{
+    int n = length + 1;
+    BASIC_SUBBLEND();
+}
+
+void imageFilterBlendText_Basic(Uint32 *dst_buffer, Uint8 *src_buffer,
+                                Uint32 src_color1, Uint32 src_color2, int length)
+{
+#ifndef BPP16
+    for (int i = 0; i < length; i++) {
+        blendTextPixel(dst_buffer + i, src_buffer + i, src_color1, src_color2);
+    }
+#endif
+}
+
+void imageFilterLerp_Basic(unsigned char *dst, Uint16 *src1, Uint16 *src2,
+                           int weight, int length)
+{
+    for (int i = 0; i < length; i++) {
+        dst[i] = ((8 - weight) * src1[i] + weight * src2[i]) >> 6;
+    }
+}
+
 bool alphaMaskBlend_Basic(SDL_Surface* dst, SDL_Surface *s1, SDL_Surface *s2, SDL_Surface *mask_surface, const SDL_Rect& rect, Uint32 mask_value) {
     return false;
 }
@@ -132,6 +166,19 @@ static bool hasFastPSHUFB(Manufacturer mf, int eax, int ecx) {
     }
     return true;
 }
+
+// AVX2 needs the instructions and an OS that saves the YMM registers.
+bool hasAVX2() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) { return false; }
+    if (!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX)) { return false; }
+    unsigned int xcr0_lo, xcr0_hi;
+    __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 6) != 6) { return false; }
+    if (__get_cpuid_max(0, NULL) < 7) { return false; }
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return ebx & bit_AVX2;
+}
 #endif
 
 AcceleratedGraphicsFunctions AcceleratedGraphicsFunctions::accelerated() {
@@ -165,6 +212,10 @@ AcceleratedGraphicsFunctions AcceleratedGraphicsFunctions::accelerated() {
             out._imageFilterAddTo = imageFilterAddTo_SSE2;
             out._imageFilterSubFrom = imageFilterSubFrom_SSE2;
             out._imageFilterBlend = imageFilterBlend_SSE2;
+            out._imageFilterAddBlend = imageFilterAddBlend_SSE2;
+            out._imageFilterSubBlend = imageFilterSubBlend_SSE2;
+            out._imageFilterBlendText = imageFilterBlendText_SSE2;
+            out._imageFilterLerp = imageFilterLerp_SSE2;
             out._alphaMaskBlend = alphaMaskBlend_SSE2;
             out._alphaMaskBlendConst = alphaMaskBlendConst_SSE2;
         }
@@ -174,6 +225,18 @@ AcceleratedGraphicsFunctions AcceleratedGraphicsFunctions::accelerated() {
             out._alphaMaskBlend = alphaMaskBlend_SSSE3;
             out._alphaMaskBlendConst = alphaMaskBlendConst_SSSE3;
         }
+        if (hasAVX2()) {
+            printf("AVX2 ");
+            out._imageFilterMean = imageFilterMean_AVX2;
+            out._imageFilterAddTo = imageFilterAddTo_AVX2;
+            out._imageFilterSubFrom = imageFilterSubFrom_AVX2;
+            out._imageFilterBlend = imageFilterBlend_AVX2;
+            out._imageFilterAddBlend = imageFilterAddBlend_AVX2;
+            out._imageFilterSubBlend = imageFilterSubBlend_AVX2;
+            out._imageFilterLerp = imageFilterLerp_AVX2;
+            out._alphaMaskBlend = alphaMaskBlend_AVX2;
+            out._alphaMaskBlendConst = alphaMaskBlendConst_AVX2;
+        }
         printf("\n");
     }
 #elif defined(USE_PPC_GFX)
@@ -224,6 +287,19 @@ AcceleratedGraphicsFunctions AcceleratedGraphicsFunctions::accelerated() {
         out._imageFilterAddTo = imageFilterAddTo_Altivec;
         out._imageFilterSubFrom = imageFilterSubFrom_Altivec;
     }
+#elif defined(USE_ARM_GFX)
+    // NEON is part of every AArch64 CPU.
+    printf("System info: ARM CPU, with functions: NEON\n");
+    out._imageFilterMean = imageFilterMean_NEON;
+    out._imageFilterAddTo = imageFilterAddTo_NEON;
+    out._imageFilterSubFrom = imageFilterSubFrom_NEON;
+    out._imageFilterBlend = imageFilterBlend_NEON;
+    out._imageFilterAddBlend = imageFilterAddBlend_NEON;
+    out._imageFilterSubBlend = imageFilterSubBlend_NEON;
+    out._imageFilterBlendText = imageFilterBlendText_NEON;
+    out._imageFilterLerp = imageFilterLerp_NEON;
+    out._alphaMaskBlend = alphaMaskBlend_NEON;
+    out._alphaMaskBlendConst = alphaMaskBlendConst_NEON;
 #endif
     return out;
 }
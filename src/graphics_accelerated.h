@@ -30,14 +30,26 @@ void imageFilterMean_Basic(unsigned char *src1, unsigned char *src2, unsigned ch
 void imageFilterAddTo_Basic(unsigned char *dst, unsigned char *src, int length);
 void imageFilterSubFrom_Basic(unsigned char *dst, unsigned char *src, int length);
 void imageFilterBlend_Basic(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap, int alpha, int length);
+void imageFilterAddBlend_Basic(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap, int alpha, int length);
+void imageFilterSubBlend_Basic(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap, int alpha, int length);
+void imageFilterBlendText_Basic(Uint32 *dst_buffer, Uint8 *src_buffer, Uint32 src_color1, Uint32 src_color2, int length);
+void imageFilterLerp_Basic(unsigned char *dst, Uint16 *src1, Uint16 *src2, int weight, int length);
 bool alphaMaskBlend_Basic(SDL_Surface* dst, SDL_Surface *s1, SDL_Surface *s2, SDL_Surface *mask_surface, const SDL_Rect& rect, Uint32 mask_value);
 void alphaMaskBlendConst_Basic(SDL_Surface* dst, SDL_Surface *s1, SDL_Surface *s2, const SDL_Rect& rect, Uint32 mask_value);
 
+#ifdef USE_X86_GFX
+bool hasAVX2();
+#endif
+
 class AcceleratedGraphicsFunctions {
     void (*_imageFilterMean)(unsigned char *src1, unsigned char *src2, unsigned char *dst, int length);
     void (*_imageFilterAddTo)(unsigned char *dst, unsigned char *src, int length);
     void (*_imageFilterSubFrom)(unsigned char *dst, unsigned char *src, int length);
     void (*_imageFilterBlend)(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap, int alpha, int length);
+    void (*_imageFilterAddBlend)(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap, int alpha, int length);
+    void (*_imageFilterSubBlend)(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap, int alpha, int length);
+    void (*_imageFilterBlendText)(Uint32 *dst_buffer, Uint8 *src_buffer, Uint32 src_color1, Uint32 src_color2, int length);
+    void (*_imageFilterLerp)(unsigned char *dst, Uint16 *src1, Uint16 *src2, int weight, int length);
     bool (*_alphaMaskBlend)(SDL_Surface* dst, SDL_Surface *s1, SDL_Surface *s2, SDL_Surface *mask_surface, const SDL_Rect& rect, Uint32 mask_value);
     void (*_alphaMaskBlendConst)(SDL_Surface* dst, SDL_Surface *s1, SDL_Surface *s2, const SDL_Rect& rect, Uint32 mask_value);
 
@@ -47,6 +59,10 @@ public:
         _imageFilterAddTo = imageFilterAddTo_Basic;
         _imageFilterSubFrom = imageFilterSubFrom_Basic;
         _imageFilterBlend = imageFilterBlend_Basic;
+        _imageFilterAddBlend = imageFilterAddBlend_Basic;
+        _imageFilterSubBlend = imageFilterSubBlend_Basic;
+        _imageFilterBlendText = imageFilterBlendText_Basic;
+        _imageFilterLerp = imageFilterLerp_Basic;
         _alphaMaskBlend = alphaMaskBlend_Basic;
         _alphaMaskBlendConst = alphaMaskBlendConst_Basic;
     }
@@ -69,6 +85,26 @@ public:
         _imageFilterBlend(dst_buffer, src_buffer, alphap, alpha, length);
     }
 
+    // ADDBLEND_PIXEL and SUBBLEND_PIXEL over a row
+    void imageFilterAddBlend(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap, int alpha, int length) {
+        _imageFilterAddBlend(dst_buffer, src_buffer, alphap, alpha, length);
+    }
+
+    void imageFilterSubBlend(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap, int alpha, int length) {
+        _imageFilterSubBlend(dst_buffer, src_buffer, alphap, alpha, length);
+    }
+
+    // BLEND_PIXEL8_ALPHA over a row of glyph coverage
+    void imageFilterBlendText(Uint32 *dst_buffer, Uint8 *src_buffer, Uint32 src_color1, Uint32 src_color2, int length) {
+        _imageFilterBlendText(dst_buffer, src_buffer, src_color1, src_color2, length);
+    }
+
+    // dst = ((8 - weight) * src1 + weight * src2) >> 6, for the
+    // resizer; src values are at most 8 * 255.
+    void imageFilterLerp(unsigned char *dst, Uint16 *src1, Uint16 *src2, int weight, int length) {
+        _imageFilterLerp(dst, src1, src2, weight, length);
+    }
+
     bool alphaMaskBlend(SDL_Surface* dst, SDL_Surface *s1, SDL_Surface *s2, SDL_Surface *mask_surface, const SDL_Rect& rect, Uint32 mask_value) {
         return _alphaMaskBlend(dst, s1, s2, mask_surface, rect, mask_value);
     }
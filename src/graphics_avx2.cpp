@@ -0,0 +1,304 @@
+/* -*- C++ -*-
+ *
+ *  graphics_avx2.cpp - graphics routines using X86 AVX2 cpu functionality
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *  or write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// These give exactly the results of the _Basic routines: unlike the
+// SSE2 mean this one rounds down, and as in BLEND_PIXEL fully opaque
+// and fully transparent pixels are copied rather than blended.
+
+#ifdef USE_X86_GFX
+
+#include <SDL.h>
+#include <immintrin.h>
+
+#include "graphics_avx2.h"
+#include "graphics_common.h"
+
+/// 0x????gg?? -> 0x000000gg
+static HELPER_FN __m256i extractG(__m256i v) {
+    return _mm256_and_si256(_mm256_srli_epi32(v, 8), _mm256_set1_epi32(0xFF));
+}
+
+/// 0x000000vv -> 0x00vv00vv
+static HELPER_FN __m256i spreadTo16(__m256i v) {
+    return _mm256_or_si256(v, _mm256_slli_epi32(v, 16));
+}
+
+/// ((s1 * mask1 + s2 * mask2) >> 8) per colour channel, alpha cleared;
+/// mask1 and mask2 are spread (0x00vv00vv) and sum to 0x00ff00ff.
+static HELPER_FN __m256i mix(__m256i s1, __m256i s2, __m256i mask1, __m256i mask2) {
+    __m256i mask_00ff00ff = _mm256_set1_epi32(0x00FF00FF);
+    __m256i rb = _mm256_add_epi16(_mm256_mullo_epi16(mask1, _mm256_and_si256(s1, mask_00ff00ff)),
+                                  _mm256_mullo_epi16(mask2, _mm256_and_si256(s2, mask_00ff00ff)));
+    __m256i g = _mm256_add_epi16(_mm256_mullo_epi16(mask1, extractG(s1)),
+                                 _mm256_mullo_epi16(mask2, extractG(s2)));
+    return _mm256_or_si256(_mm256_srli_epi16(rb, 8), _mm256_andnot_si256(mask_00ff00ff, g));
+}
+
+
+void imageFilterMean_AVX2(unsigned char *src1, unsigned char *src2, unsigned char *dst, int length)
+{
+    int i = 0;
+
+    // (a & b) + ((a ^ b) >> 1) is (a + b) / 2 without the carry
+    __m256i mask = _mm256_set1_epi8(0x7F);
+    for (; i < length - 31; i += 32) {
+        __m256i s1 = _mm256_loadu_si256((__m256i*)(src1 + i));
+        __m256i s2 = _mm256_loadu_si256((__m256i*)(src2 + i));
+        __m256i half = _mm256_and_si256(_mm256_srli_epi16(_mm256_xor_si256(s1, s2), 1), mask);
+        __m256i r = _mm256_add_epi8(_mm256_and_si256(s1, s2), half);
+        _mm256_storeu_si256((__m256i*)(dst + i), r);
+    }
+
+    for (; i < length; i++) {
+        dst[i] = mean_pixel(src1[i], src2[i]);
+    }
+}
+
+
+void imageFilterAddTo_AVX2(unsigned char *dst, unsigned char *src, int length)
+{
+    int i = 0;
+    for (; i < length - 31; i += 32) {
+        __m256i s = _mm256_loadu_si256((__m256i*)(src + i));
+        __m256i d = _mm256_loadu_si256((__m256i*)(dst + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_adds_epu8(s, d));
+    }
+
+    for (; i < length; i++) {
+        addto_pixel(dst[i], src[i]);
+    }
+}
+
+
+void imageFilterSubFrom_AVX2(unsigned char *dst, unsigned char *src, int length)
+{
+    int i = 0;
+    for (; i < length - 31; i += 32) {
+        __m256i s = _mm256_loadu_si256((__m256i*)(src + i));
+        __m256i d = _mm256_loadu_si256((__m256i*)(dst + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_subs_epu8(d, s));
+    }
+
+    for (; i < length; i++) {
+        subfrom_pixel(dst[i], src[i]);
+    }
+}
+
+
+void imageFilterBlend_AVX2(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap, int alpha, int length)
+{
+    int n = length;
+
+    // Process 8 32bit (BGRA) pixels at a time; like the SSE2 version
+    // this takes the source alpha from src_buffer, which is where
+    // alphap points.
+    __m256i alpha_v = _mm256_set1_epi32(alpha);
+    __m256i mask_00ff00ff = _mm256_set1_epi32(0x00FF00FF);
+    __m256i zero = _mm256_setzero_si256();
+    __m256i opaque = _mm256_set1_epi32(alpha == 256 ? 255 : -1);
+    while (n >= 8) {
+        __m256i src = _mm256_loadu_si256((__m256i*)src_buffer);
+        __m256i a = _mm256_srli_epi32(src, 24);
+        __m256i keep_dst = _mm256_cmpeq_epi32(a, zero);
+        __m256i copy_src = _mm256_cmpeq_epi32(a, opaque);
+        if (_mm256_movemask_epi8(copy_src) == -1) {
+            _mm256_storeu_si256((__m256i*)dst_buffer, src);
+        } else if (_mm256_movemask_epi8(keep_dst) != -1) {
+            __m256i dst = _mm256_loadu_si256((__m256i*)dst_buffer);
+            // mask2 = (a * alpha) >> 8
+            __m256i mask2 = spreadTo16(_mm256_srli_epi32(_mm256_mullo_epi16(a, alpha_v), 8));
+            __m256i mask1 = _mm256_xor_si256(mask2, mask_00ff00ff);
+            __m256i out = mix(dst, src, mask1, mask2);
+            out = _mm256_blendv_epi8(out, src, copy_src);
+            out = _mm256_blendv_epi8(out, dst, keep_dst);
+            _mm256_storeu_si256((__m256i*)dst_buffer, out);
+        }
+
+        n -= 8; src_buffer += 8; dst_buffer += 8; alphap += 32;
+    }
+
+    // If any pixels are left over, deal with them individually
+    ++n;
+    BASIC_BLEND();
+}
+
+
+/// ADDBLEND_PIXEL (subtract false) or SUBBLEND_PIXEL (subtract true)
+/// over a row, eight pixels at a time.
+static HELPER_FN void addSubBlend(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap, int alpha, int length, bool subtract)
+{
+    int n = length;
+
+    __m256i alpha_v = _mm256_set1_epi32(alpha);
+    __m256i rgb = _mm256_set1_epi32(RGBMASK);
+    __m256i zero = _mm256_setzero_si256();
+    while (n >= 8) {
+        __m256i src = _mm256_loadu_si256((__m256i*)src_buffer);
+        __m256i dst = _mm256_loadu_si256((__m256i*)dst_buffer);
+        // mask2 = (a * alpha) >> 8
+        __m256i mask2 = _mm256_srli_epi32(_mm256_mullo_epi16(_mm256_srli_epi32(src, 24), alpha_v), 8);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(mask2, zero)) != -1) {
+            // (s * mask2) >> 8 per channel; the unpacks stay within
+            // each 128-bit half, so the masks are spread the same way.
+            __m256i m = spreadTo16(mask2);
+            __m256i lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(src, zero), _mm256_unpacklo_epi32(m, m));
+            __m256i hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(src, zero), _mm256_unpackhi_epi32(m, m));
+            __m256i s = _mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8));
+            dst = subtract ? _mm256_subs_epu8(dst, s) : _mm256_adds_epu8(dst, s);
+        }
+        _mm256_storeu_si256((__m256i*)dst_buffer, _mm256_and_si256(dst, rgb));
+
+        n -= 8; src_buffer += 8; dst_buffer += 8; alphap += 32;
+    }
+
+    // If any pixels are left over, deal with them individually
+    ++n;
+    if (subtract) {
+        BASIC_SUBBLEND();
+    } else {
+        BASIC_ADDBLEND();
+    }
+}
+
+
+void imageFilterAddBlend_AVX2(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap, int alpha, int length)
+{
+    addSubBlend(dst_buffer, src_buffer, alphap, alpha, length, false);
+}
+
+
+void imageFilterSubBlend_AVX2(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap, int alpha, int length)
+{
+    addSubBlend(dst_buffer, src_buffer, alphap, alpha, length, true);
+}
+
+
+void imageFilterLerp_AVX2(unsigned char *dst, Uint16 *src1, Uint16 *src2, int weight, int length)
+{
+    int i = 0;
+
+    __m256i w1 = _mm256_set1_epi16(8 - weight);
+    __m256i w2 = _mm256_set1_epi16(weight);
+    for (; i < length - 31; i += 32) {
+        __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_loadu_si256((__m256i*)(src1 + i)), w1),
+                                      _mm256_mullo_epi16(_mm256_loadu_si256((__m256i*)(src2 + i)), w2));
+        __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_loadu_si256((__m256i*)(src1 + i + 16)), w1),
+                                      _mm256_mullo_epi16(_mm256_loadu_si256((__m256i*)(src2 + i + 16)), w2));
+        // packus works within 128-bit halves; put the quarters back in order
+        __m256i r = _mm256_packus_epi16(_mm256_srli_epi16(lo, 6), _mm256_srli_epi16(hi, 6));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute4x64_epi64(r, 0xD8));
+    }
+
+    for (; i < length; i++) {
+        dst[i] = ((8 - weight) * src1[i] + weight * src2[i]) >> 6;
+    }
+}
+
+
+bool alphaMaskBlend_AVX2(SDL_Surface* dst, SDL_Surface *s1, SDL_Surface *s2, SDL_Surface *mask_surface, const SDL_Rect& rect, Uint32 mask_value)
+{
+    if (mask_surface->w < 8) {
+        return false;
+    }
+
+    int end_x = rect.x + rect.w;
+    int end_y = rect.y + rect.h;
+    int mask_height = mask_surface->h;
+    int mask_width = mask_surface->w;
+
+    // Anything over 0x1FF gives the same clamped mask2 as 0x1FF, and
+    // keeps the subtraction within 16 bits.
+    __m256i mask_value_v = _mm256_set1_epi32(mask_value < 0x1FF ? mask_value : 0x1FF);
+    __m256i mask_000000ff = _mm256_set1_epi32(0x000000FF);
+    __m256i mask_00ff00ff = _mm256_set1_epi32(0x00FF00FF);
+
+    int mask_off_base_y = rect.y % mask_surface->h;
+    int mask_off_base_x = rect.x % mask_surface->w;
+    for (int y = rect.y, my = mask_off_base_y; y < end_y; y++, my++) {
+        if (my >= mask_height) { my = 0; }
+        Uint32* s1p = getPointerToRow<Uint32>(s1, y);
+        Uint32* s2p = getPointerToRow<Uint32>(s2, y);
+        Uint32* dstp = getPointerToRow<Uint32>(dst, y);
+        Uint32* mask_buf = getPointerToRow<Uint32>(mask_surface, my);
+
+        int x = rect.x, mx = mask_off_base_x;
+        while (x < (end_x - 7)) {
+            __m256i s1v = _mm256_loadu_si256((__m256i*)(s1p + x));
+            __m256i s2v = _mm256_loadu_si256((__m256i*)(s2p + x));
+            __m256i mskv;
+            if (__builtin_expect(mx + 7 < mask_width, true)) {
+                mskv = _mm256_loadu_si256((__m256i*)(mask_buf + mx));
+            } else {
+                __attribute__((aligned(32))) Uint32 tmp[8];
+                for (int i = 0; i < 8; i++) {
+                    if (mx + i < mask_width) {
+                        tmp[i] = mask_buf[mx + i];
+                    } else {
+                        tmp[i] = mask_buf[mx + i - mask_width];
+                    }
+                }
+                mskv = _mm256_load_si256((__m256i*)tmp);
+            }
+            mskv = _mm256_and_si256(mskv, mask_000000ff);
+            __m256i mask2 = _mm256_subs_epu16(mask_value_v, mskv);
+            mask2 = _mm256_min_epi16(mask2, mask_000000ff); // min(mask2, 0xFF)
+            mask2 = spreadTo16(mask2);
+            __m256i mask1 = _mm256_xor_si256(mask2, mask_00ff00ff);
+            _mm256_storeu_si256((__m256i*)(dstp + x), mix(s1v, s2v, mask1, mask2));
+
+            x += 8;
+            mx += 8;
+            if (mx >= mask_width) { mx -= mask_width; }
+        }
+        while (x < end_x) {
+            dstp[x] = blendMaskOnePixel(s1p[x], s2p[x], mask_buf[mx], mask_value);
+            x++, mx++;
+            if (mx >= mask_width) { mx = 0; }
+        }
+    }
+    return true;
+}
+
+
+void alphaMaskBlendConst_AVX2(SDL_Surface* dst, SDL_Surface *s1, SDL_Surface *s2, const SDL_Rect& rect, Uint32 mask_value)
+{
+    int end_x = rect.x + rect.w;
+    int end_y = rect.y + rect.h;
+    Uint32 m = mask_value < 0xFF ? mask_value : 0xFF;
+    __m256i mask2 = _mm256_set1_epi32(m | m << 16);
+    __m256i mask1 = _mm256_xor_si256(mask2, _mm256_set1_epi32(0x00FF00FF));
+    for (int y = rect.y; y < end_y; y++) {
+        Uint32* s1p = getPointerToRow<Uint32>(s1, y);
+        Uint32* s2p = getPointerToRow<Uint32>(s2, y);
+        Uint32* dstp = getPointerToRow<Uint32>(dst, y);
+
+        int x = rect.x;
+        for (; x < (end_x - 7); x += 8) {
+            __m256i s1v = _mm256_loadu_si256((__m256i*)(s1p + x));
+            __m256i s2v = _mm256_loadu_si256((__m256i*)(s2p + x));
+            _mm256_storeu_si256((__m256i*)(dstp + x), mix(s1v, s2v, mask1, mask2));
+        }
+        for (; x < end_x; x++) {
+            dstp[x] = blendMaskOnePixel(s1p[x], s2p[x], 0, mask_value);
+        }
+    }
+}
+
+#endif
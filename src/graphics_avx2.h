@@ -0,0 +1,35 @@
+/* -*- C++ -*-
+ *
+ *  graphics_avx2.h - graphics routines using X86 AVX2 cpu functionality
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *  or write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef USE_X86_GFX
+
+#include <SDL.h>
+
+void imageFilterMean_AVX2(unsigned char *src1, unsigned char *src2, unsigned char *dst, int length);
+void imageFilterAddTo_AVX2(unsigned char *dst, unsigned char *src, int length);
+void imageFilterSubFrom_AVX2(unsigned char *dst, unsigned char *src, int length);
+void imageFilterBlend_AVX2(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap, int alpha, int length);
+void imageFilterAddBlend_AVX2(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap, int alpha, int length);
+void imageFilterSubBlend_AVX2(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap, int alpha, int length);
+void imageFilterLerp_AVX2(unsigned char *dst, Uint16 *src1, Uint16 *src2, int weight, int length);
+bool alphaMaskBlend_AVX2(SDL_Surface* dst, SDL_Surface *s1, SDL_Surface *s2, SDL_Surface *mask_surface, const SDL_Rect& rect, Uint32 mask_value);
+void alphaMaskBlendConst_AVX2(SDL_Surface* dst, SDL_Surface *s1, SDL_Surface *s2, const SDL_Rect& rect, Uint32 mask_value);
+
+#endif
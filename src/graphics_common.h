@@ -280,6 +280,15 @@ static Uint32 blendMaskOnePixel(Uint32 s1, Uint32 s2, Uint32 msk, Uint32 mask_va
               monocro_color_lut[c].b; \
 }
 
+// One pixel of BLEND_PIXEL8_ALPHA.  Full coverage always gives the
+// opaque text colour, so that case skips the divisions.
+static HELPER_FN void blendTextPixel(Uint32 *dst_buffer, Uint8 *src_buffer,
+                                     Uint32 src_color1, Uint32 src_color2) {
+    if (*src_buffer == 0xff) {
+        *dst_buffer = src_color1 | src_color2 | AMASK;
+    } else BLEND_PIXEL8_ALPHA();
+}
+
 #endif //ndef BPP16
 
 
@@ -46,15 +46,18 @@ void imageFilterMean_MMX(unsigned char *src1, unsigned char *src2, unsigned char
 
     // Do bulk of processing using MMX (find the mean of 8 8-bit unsigned integers, with saturation)
     __m64 mask = _mm_set1_pi8(0x7F);
+    __m64 one = _mm_set1_pi8(0x01);
     for (; i < length - 7; i += 8) {
         __m64 s1 = *((__m64*)(src1 + i));
+        __m64 s2 = *((__m64*)(src2 + i));
+        // (s1 + s2) / 2 == s1/2 + s2/2, plus one if both were odd
+        __m64 odd = _mm_and_si64(_mm_and_si64(s1, s2), one);
         s1 = _mm_srli_pi16(s1, 1);
         s1 = _mm_and_si64(s1, mask);
-        __m64 s2 = *((__m64*)(src2 + i));
         s2 = _mm_srli_pi16(s2, 1);
         s2 = _mm_and_si64(s2, mask);
         __m64* d = (__m64*)(dst + i);
-        *d = _mm_adds_pu8(s1, s2);
+        *d = _mm_adds_pu8(_mm_adds_pu8(s1, s2), odd);
     }
     _mm_empty();
 
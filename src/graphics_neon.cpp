@@ -0,0 +1,329 @@
+/* -*- C++ -*-
+ *
+ *  graphics_neon.cpp - graphics routines using ARM NEON cpu functionality
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *  or write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Pixels are loaded with vld4q_u8, which splits 16 of them into one
+// register per channel, so every step works on whole bytes.  The
+// results match the _Basic routines exactly.
+
+#ifdef USE_ARM_GFX
+
+#include <SDL.h>
+#include <arm_neon.h>
+
+#include "graphics_neon.h"
+#include "graphics_common.h"
+
+/// (s1 * mask1 + s2 * mask2) >> 8 for 16 channel values.
+static HELPER_FN uint8x16_t mix(uint8x16_t s1, uint8x16_t s2, uint8x16_t mask1, uint8x16_t mask2) {
+    uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(s1), vget_low_u8(mask1)),
+                             vget_low_u8(s2), vget_low_u8(mask2));
+    uint16x8_t hi = vmlal_u8(vmull_u8(vget_high_u8(s1), vget_high_u8(mask1)),
+                             vget_high_u8(s2), vget_high_u8(mask2));
+    return vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8));
+}
+
+/// Colour channels of 16 pixels mixed by per-pixel masks; alpha is
+/// cleared, as in BLEND_PIXEL and blendMaskOnePixel.
+static HELPER_FN uint8x16x4_t mixPixels(uint8x16x4_t s1, uint8x16x4_t s2, uint8x16_t mask1, uint8x16_t mask2) {
+    uint8x16x4_t out;
+    out.val[0] = mix(s1.val[0], s2.val[0], mask1, mask2);
+    out.val[1] = mix(s1.val[1], s2.val[1], mask1, mask2);
+    out.val[2] = mix(s1.val[2], s2.val[2], mask1, mask2);
+    out.val[3] = vdupq_n_u8(0);
+    return out;
+}
+
+
+void imageFilterMean_NEON(unsigned char *src1, unsigned char *src2, unsigned char *dst, int length)
+{
+    int i = 0;
+    for (; i < length - 15; i += 16) {
+        // Halving add rounds down, like mean_pixel
+        vst1q_u8(dst + i, vhaddq_u8(vld1q_u8(src1 + i), vld1q_u8(src2 + i)));
+    }
+
+    for (; i < length; i++) {
+        dst[i] = mean_pixel(src1[i], src2[i]);
+    }
+}
+
+
+void imageFilterAddTo_NEON(unsigned char *dst, unsigned char *src, int length)
+{
+    int i = 0;
+    for (; i < length - 15; i += 16) {
+        vst1q_u8(dst + i, vqaddq_u8(vld1q_u8(dst + i), vld1q_u8(src + i)));
+    }
+
+    for (; i < length; i++) {
+        addto_pixel(dst[i], src[i]);
+    }
+}
+
+
+void imageFilterSubFrom_NEON(unsigned char *dst, unsigned char *src, int length)
+{
+    int i = 0;
+    for (; i < length - 15; i += 16) {
+        vst1q_u8(dst + i, vqsubq_u8(vld1q_u8(dst + i), vld1q_u8(src + i)));
+    }
+
+    for (; i < length; i++) {
+        subfrom_pixel(dst[i], src[i]);
+    }
+}
+
+
+void imageFilterBlend_NEON(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap, int alpha, int length)
+{
+    int n = length;
+
+    // The source alpha is taken from src_buffer, which is where alphap
+    // points.
+    uint16x8_t alpha_v = vdupq_n_u16(alpha);
+    uint8x16_t zero = vdupq_n_u8(0);
+    bool full = alpha == 256;
+    while (n >= 16) {
+        uint8x16x4_t src = vld4q_u8((Uint8*)src_buffer);
+        uint8x16_t a = src.val[3];
+        // Fully transparent or fully opaque runs need no arithmetic.
+        if (vmaxvq_u8(a) == 0) {
+            n -= 16; src_buffer += 16; dst_buffer += 16; alphap += 64;
+            continue;
+        }
+        if (full && vminvq_u8(a) == 255) {
+            vst4q_u8((Uint8*)dst_buffer, src);
+            n -= 16; src_buffer += 16; dst_buffer += 16; alphap += 64;
+            continue;
+        }
+        uint8x16x4_t dst = vld4q_u8((Uint8*)dst_buffer);
+        // mask2 = (a * alpha) >> 8
+        uint8x16_t mask2 = vcombine_u8(
+            vshrn_n_u16(vmulq_u16(vmovl_u8(vget_low_u8(a)), alpha_v), 8),
+            vshrn_n_u16(vmulq_u16(vmovl_u8(vget_high_u8(a)), alpha_v), 8));
+        uint8x16_t mask1 = vmvnq_u8(mask2);
+        uint8x16x4_t out = mixPixels(dst, src, mask1, mask2);
+
+        uint8x16_t copy_src = full ? vceqq_u8(a, vdupq_n_u8(255)) : zero;
+        uint8x16_t keep_dst = vceqq_u8(a, zero);
+        for (int c = 0; c < 4; c++) {
+            out.val[c] = vbslq_u8(copy_src, src.val[c], out.val[c]);
+            out.val[c] = vbslq_u8(keep_dst, dst.val[c], out.val[c]);
+        }
+        vst4q_u8((Uint8*)dst_buffer, out);
+
+        n -= 16; src_buffer += 16; dst_buffer += 16; alphap += 64;
+    }
+
+    // If any pixels are left over, deal with them individually
+    ++n;
+    BASIC_BLEND();
+}
+
+
+/// (s * mask2) >> 8 for 16 channel values.
+static HELPER_FN uint8x16_t scale(uint8x16_t s, uint8x16_t mask2) {
+    return vcombine_u8(vshrn_n_u16(vmull_u8(vget_low_u8(s), vget_low_u8(mask2)), 8),
+                       vshrn_n_u16(vmull_u8(vget_high_u8(s), vget_high_u8(mask2)), 8));
+}
+
+/// ADDBLEND_PIXEL (subtract false) or SUBBLEND_PIXEL (subtract true)
+/// over a row, 16 pixels at a time.
+static HELPER_FN void addSubBlend(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap, int alpha, int length, bool subtract)
+{
+    int n = length;
+
+    uint16x8_t alpha_v = vdupq_n_u16(alpha);
+    while (n >= 16) {
+        uint8x16x4_t src = vld4q_u8((Uint8*)src_buffer);
+        uint8x16x4_t dst = vld4q_u8((Uint8*)dst_buffer);
+        uint8x16_t a = src.val[3];
+        // mask2 = (a * alpha) >> 8
+        uint8x16_t mask2 = vcombine_u8(
+            vshrn_n_u16(vmulq_u16(vmovl_u8(vget_low_u8(a)), alpha_v), 8),
+            vshrn_n_u16(vmulq_u16(vmovl_u8(vget_high_u8(a)), alpha_v), 8));
+        if (vmaxvq_u8(mask2) != 0) {
+            for (int c = 0; c < 3; c++) {
+                uint8x16_t s = scale(src.val[c], mask2);
+                dst.val[c] = subtract ? vqsubq_u8(dst.val[c], s) : vqaddq_u8(dst.val[c], s);
+            }
+        }
+        dst.val[3] = vdupq_n_u8(0);
+        vst4q_u8((Uint8*)dst_buffer, dst);
+
+        n -= 16; src_buffer += 16; dst_buffer += 16; alphap += 64;
+    }
+
+    // If any pixels are left over, deal with them individually
+    ++n;
+    if (subtract) {
+        BASIC_SUBBLEND();
+    } else {
+        BASIC_ADDBLEND();
+    }
+}
+
+
+void imageFilterAddBlend_NEON(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap, int alpha, int length)
+{
+    addSubBlend(dst_buffer, src_buffer, alphap, alpha, length, false);
+}
+
+
+void imageFilterSubBlend_NEON(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap, int alpha, int length)
+{
+    addSubBlend(dst_buffer, src_buffer, alphap, alpha, length, true);
+}
+
+
+void imageFilterBlendText_NEON(Uint32 *dst_buffer, Uint8 *src_buffer, Uint32 src_color1, Uint32 src_color2, int length)
+{
+#ifndef BPP16
+    int n = length;
+
+    // Runs of 0 and 0xff coverage skip the divisions of
+    // BLEND_PIXEL8_ALPHA; mixed runs go pixel by pixel.
+    uint32x4_t colour = vdupq_n_u32(src_color1 | src_color2 | AMASK);
+    while (n >= 16) {
+        uint8x16_t coverage = vld1q_u8(src_buffer);
+        if (vminvq_u8(coverage) == 0xff) {
+            for (int i = 0; i < 16; i += 4) {
+                vst1q_u32(dst_buffer + i, colour);
+            }
+        } else if (vmaxvq_u8(coverage) != 0) {
+            for (int i = 0; i < 16; i++) {
+                blendTextPixel(dst_buffer + i, src_buffer + i, src_color1, src_color2);
+            }
+        }
+        n -= 16; src_buffer += 16; dst_buffer += 16;
+    }
+
+    for (; n > 0; n--) {
+        blendTextPixel(dst_buffer++, src_buffer++, src_color1, src_color2);
+    }
+#endif
+}
+
+
+void imageFilterLerp_NEON(unsigned char *dst, Uint16 *src1, Uint16 *src2, int weight, int length)
+{
+    int i = 0;
+
+    uint16x8_t w1 = vdupq_n_u16(8 - weight);
+    uint16x8_t w2 = vdupq_n_u16(weight);
+    for (; i < length - 15; i += 16) {
+        uint16x8_t lo = vmlaq_u16(vmulq_u16(vld1q_u16(src1 + i), w1), vld1q_u16(src2 + i), w2);
+        uint16x8_t hi = vmlaq_u16(vmulq_u16(vld1q_u16(src1 + i + 8), w1), vld1q_u16(src2 + i + 8), w2);
+        vst1q_u8(dst + i, vcombine_u8(vshrn_n_u16(lo, 6), vshrn_n_u16(hi, 6)));
+    }
+
+    for (; i < length; i++) {
+        dst[i] = ((8 - weight) * src1[i] + weight * src2[i]) >> 6;
+    }
+}
+
+
+bool alphaMaskBlend_NEON(SDL_Surface* dst, SDL_Surface *s1, SDL_Surface *s2, SDL_Surface *mask_surface, const SDL_Rect& rect, Uint32 mask_value)
+{
+    if (mask_surface->w < 16) {
+        return false;
+    }
+
+    int end_x = rect.x + rect.w;
+    int end_y = rect.y + rect.h;
+    int mask_height = mask_surface->h;
+    int mask_width = mask_surface->w;
+
+    // Anything over 0x1FF gives the same clamped mask2 as 0x1FF.
+    uint16x8_t mask_value_v = vdupq_n_u16(mask_value < 0x1FF ? mask_value : 0x1FF);
+    uint16x8_t mask_ff = vdupq_n_u16(0xFF);
+
+    int mask_off_base_y = rect.y % mask_surface->h;
+    int mask_off_base_x = rect.x % mask_surface->w;
+    for (int y = rect.y, my = mask_off_base_y; y < end_y; y++, my++) {
+        if (my >= mask_height) { my = 0; }
+        Uint32* s1p = getPointerToRow<Uint32>(s1, y);
+        Uint32* s2p = getPointerToRow<Uint32>(s2, y);
+        Uint32* dstp = getPointerToRow<Uint32>(dst, y);
+        Uint32* mask_buf = getPointerToRow<Uint32>(mask_surface, my);
+
+        int x = rect.x, mx = mask_off_base_x;
+        while (x < (end_x - 15)) {
+            uint8x16x4_t s1v = vld4q_u8((Uint8*)(s1p + x));
+            uint8x16x4_t s2v = vld4q_u8((Uint8*)(s2p + x));
+            uint8x16_t mskv;
+            if (__builtin_expect(mx + 15 < mask_width, true)) {
+                mskv = vld4q_u8((Uint8*)(mask_buf + mx)).val[0];
+            } else {
+                Uint8 tmp[16];
+                for (int i = 0; i < 16; i++) {
+                    if (mx + i < mask_width) {
+                        tmp[i] = mask_buf[mx + i];
+                    } else {
+                        tmp[i] = mask_buf[mx + i - mask_width];
+                    }
+                }
+                mskv = vld1q_u8(tmp);
+            }
+            // mask2 = min(max(mask_value - msk, 0), 0xFF)
+            uint8x16_t mask2 = vcombine_u8(
+                vmovn_u16(vminq_u16(vqsubq_u16(mask_value_v, vmovl_u8(vget_low_u8(mskv))), mask_ff)),
+                vmovn_u16(vminq_u16(vqsubq_u16(mask_value_v, vmovl_u8(vget_high_u8(mskv))), mask_ff)));
+            uint8x16_t mask1 = vmvnq_u8(mask2);
+            vst4q_u8((Uint8*)(dstp + x), mixPixels(s1v, s2v, mask1, mask2));
+
+            x += 16;
+            mx += 16;
+            if (mx >= mask_width) { mx -= mask_width; }
+        }
+        while (x < end_x) {
+            dstp[x] = blendMaskOnePixel(s1p[x], s2p[x], mask_buf[mx], mask_value);
+            x++, mx++;
+            if (mx >= mask_width) { mx = 0; }
+        }
+    }
+    return true;
+}
+
+
+void alphaMaskBlendConst_NEON(SDL_Surface* dst, SDL_Surface *s1, SDL_Surface *s2, const SDL_Rect& rect, Uint32 mask_value)
+{
+    int end_x = rect.x + rect.w;
+    int end_y = rect.y + rect.h;
+    uint8x16_t mask2 = vdupq_n_u8(mask_value < 0xFF ? mask_value : 0xFF);
+    uint8x16_t mask1 = vmvnq_u8(mask2);
+    for (int y = rect.y; y < end_y; y++) {
+        Uint32* s1p = getPointerToRow<Uint32>(s1, y);
+        Uint32* s2p = getPointerToRow<Uint32>(s2, y);
+        Uint32* dstp = getPointerToRow<Uint32>(dst, y);
+
+        int x = rect.x;
+        for (; x < (end_x - 15); x += 16) {
+            uint8x16x4_t s1v = vld4q_u8((Uint8*)(s1p + x));
+            uint8x16x4_t s2v = vld4q_u8((Uint8*)(s2p + x));
+            vst4q_u8((Uint8*)(dstp + x), mixPixels(s1v, s2v, mask1, mask2));
+        }
+        for (; x < end_x; x++) {
+            dstp[x] = blendMaskOnePixel(s1p[x], s2p[x], 0, mask_value);
+        }
+    }
+}
+
+#endif
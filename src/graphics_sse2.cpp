@@ -47,14 +47,17 @@ void imageFilterMean_SSE2(unsigned char *src1, unsigned char *src2, unsigned cha
 
     // Do bulk of processing using SSE2 (find the mean of 16 8-bit unsigned integers, with saturation)
     __m128i mask = _mm_set1_epi8(0x7F);
+    __m128i one = _mm_set1_epi8(0x01);
     for (; i < length - 15; i += 16) {
         __m128i s1 = _mm_loadu_si128((__m128i*)(src1 + i));
+        __m128i s2 = _mm_loadu_si128((__m128i*)(src2 + i));
+        // (s1 + s2) / 2 == s1/2 + s2/2, plus one if both were odd
+        __m128i odd = _mm_and_si128(_mm_and_si128(s1, s2), one);
         s1 = _mm_srli_epi16(s1, 1); // shift right 1
         s1 = _mm_and_si128(s1, mask); // apply byte-mask
-        __m128i s2 = _mm_loadu_si128((__m128i*)(src2 + i));
         s2 = _mm_srli_epi16(s2, 1); // shift right 1
         s2 = _mm_and_si128(s2, mask); // apply byte-mask
-        __m128i r = _mm_adds_epu8(s1, s2);
+        __m128i r = _mm_adds_epu8(_mm_adds_epu8(s1, s2), odd);
         _mm_store_si128((__m128i*)(dst + i), r);
     }
 
@@ -117,6 +120,42 @@ void imageFilterBlend_SSE2(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap
     imageFilterBlend_SSE_Common(dst_buffer, src_buffer, alphap, alpha, length);
 }
 
+void imageFilterAddBlend_SSE2(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap, int alpha, int length)
+{
+    imageFilterAddSubBlend_SSE_Common(dst_buffer, src_buffer, alphap, alpha, length, false);
+}
+
+void imageFilterSubBlend_SSE2(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap, int alpha, int length)
+{
+    imageFilterAddSubBlend_SSE_Common(dst_buffer, src_buffer, alphap, alpha, length, true);
+}
+
+void imageFilterBlendText_SSE2(Uint32 *dst_buffer, Uint8 *src_buffer, Uint32 src_color1, Uint32 src_color2, int length)
+{
+    imageFilterBlendText_SSE_Common(dst_buffer, src_buffer, src_color1, src_color2, length);
+}
+
+void imageFilterLerp_SSE2(unsigned char *dst, Uint16 *src1, Uint16 *src2, int weight, int length)
+{
+    int i = 0;
+
+    // At most 8 * 2040, so the sums fit in 16 bits
+    __m128i w1 = _mm_set1_epi16(8 - weight);
+    __m128i w2 = _mm_set1_epi16(weight);
+    for (; i < length - 15; i += 16) {
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_loadu_si128((__m128i*)(src1 + i)), w1),
+                                   _mm_mullo_epi16(_mm_loadu_si128((__m128i*)(src2 + i)), w2));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_loadu_si128((__m128i*)(src1 + i + 8)), w1),
+                                   _mm_mullo_epi16(_mm_loadu_si128((__m128i*)(src2 + i + 8)), w2));
+        __m128i r = _mm_packus_epi16(_mm_srli_epi16(lo, 6), _mm_srli_epi16(hi, 6));
+        _mm_storeu_si128((__m128i*)(dst + i), r);
+    }
+
+    for (; i < length; i++) {
+        dst[i] = ((8 - weight) * src1[i] + weight * src2[i]) >> 6;
+    }
+}
+
 bool alphaMaskBlend_SSE2(SDL_Surface* dst, SDL_Surface *s1, SDL_Surface *s2, SDL_Surface *mask_surface, const SDL_Rect& rect, Uint32 mask_value)
 {
     return alphaMaskBlend_SSE_Common(dst, s1, s2, mask_surface, rect, mask_value);
@@ -28,6 +28,10 @@ void imageFilterMean_SSE2(unsigned char *src1, unsigned char *src2, unsigned cha
 void imageFilterAddTo_SSE2(unsigned char *dst, unsigned char *src, int length);
 void imageFilterSubFrom_SSE2(unsigned char *dst, unsigned char *src, int length);
 void imageFilterBlend_SSE2(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap, int alpha, int length);
+void imageFilterAddBlend_SSE2(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap, int alpha, int length);
+void imageFilterSubBlend_SSE2(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap, int alpha, int length);
+void imageFilterBlendText_SSE2(Uint32 *dst_buffer, Uint8 *src_buffer, Uint32 src_color1, Uint32 src_color2, int length);
+void imageFilterLerp_SSE2(unsigned char *dst, Uint16 *src1, Uint16 *src2, int weight, int length);
 bool alphaMaskBlend_SSE2(SDL_Surface* dst, SDL_Surface *s1, SDL_Surface *s2, SDL_Surface *mask_surface, const SDL_Rect& rect, Uint32 mask_value);
 void alphaMaskBlendConst_SSE2(SDL_Surface* dst, SDL_Surface *s1, SDL_Surface *s2, const SDL_Rect& rect, Uint32 mask_value);
 
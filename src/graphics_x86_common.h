@@ -73,11 +73,27 @@ static HELPER_FN void imageFilterBlend_SSE_Common(Uint32 *dst_buffer, Uint32 *sr
     // Do bulk of processing using SSE2 (process 4 32bit (BGRA) pixels)
     // create basic bitmasks 0x00FF00FF, 0x000000FF
     __m128i bmask2 = _mm_set1_epi32(0x00FF00FF);
+    __m128i zero = _mm_setzero_si128();
+    __m128i opaque = _mm_set1_epi32(alpha == 256 ? 255 : -1);
     while (n >= 4) {
+        __m128i src = _mm_loadu_si128((__m128i*)src_buffer);
+        __m128i tmp = _mm_srli_epi32(src, 24);
+        // Like BLEND_PIXEL, leave transparent pixels alone and copy
+        // opaque ones, a whole vector at a time where possible.
+        __m128i keep_dst = _mm_cmpeq_epi32(tmp, zero);
+        __m128i copy_src = _mm_cmpeq_epi32(tmp, opaque);
+        if (_mm_movemask_epi8(keep_dst) == 0xFFFF) {
+            n -= 4; src_buffer += 4; dst_buffer += 4; alphap += 16;
+            continue;
+        }
+        if (_mm_movemask_epi8(copy_src) == 0xFFFF) {
+            _mm_store_si128((__m128i*)dst_buffer, src);
+            n -= 4; src_buffer += 4; dst_buffer += 4; alphap += 16;
+            continue;
+        }
         // alpha1 = ((src_argb >> 24) * alpha) >> 8
         __m128i a = _mm_set1_epi32(alpha);
-        __m128i buf = _mm_loadu_si128((__m128i*)src_buffer);
-        __m128i tmp = _mm_srli_epi32(buf, 24);
+        __m128i buf = src;
         a = _mm_mullo_epi16(a, tmp);
         // double-up alpha1 (0x0000vvxx -> 0x00vv00vv)
         a = extractFromGTo16L(a);
@@ -104,6 +120,8 @@ static HELPER_FN void imageFilterBlend_SSE_Common(Uint32 *dst_buffer, Uint32 *sr
         g = _mm_andnot_si128(bmask2, g);
         // dst_argb = rb | g
         tmp = _mm_or_si128(rb, g);
+        tmp = _mm_or_si128(_mm_and_si128(copy_src, src), _mm_andnot_si128(copy_src, tmp));
+        tmp = _mm_or_si128(_mm_and_si128(keep_dst, buf), _mm_andnot_si128(keep_dst, tmp));
         _mm_store_si128((__m128i*)dst_buffer, tmp);
 
         n -= 4; src_buffer += 4; dst_buffer += 4; alphap += 16;
@@ -114,6 +132,81 @@ static HELPER_FN void imageFilterBlend_SSE_Common(Uint32 *dst_buffer, Uint32 *sr
     BASIC_BLEND();
 }
 
+/// (s * mask2) >> 8 for each channel of four pixels; mask2 holds one
+/// value per 32-bit lane.
+static HELPER_FN __m128i scaleChannels(__m128i s, __m128i mask2) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i m = _mm_or_si128(mask2, _mm_slli_epi32(mask2, 16));
+    __m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi32(m, m));
+    __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi32(m, m));
+    return _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+}
+
+/// ADDBLEND_PIXEL (subtract false) or SUBBLEND_PIXEL (subtract true)
+/// over a row.  Both saturate each channel and clear alpha, which is
+/// what the byte-wise saturating add and subtract give.
+static HELPER_FN void imageFilterAddSubBlend_SSE_Common(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap, int alpha, int length, bool subtract) {
+    int n = length;
+
+    __m128i alpha_v = _mm_set1_epi32(alpha);
+    __m128i rgb = _mm_set1_epi32(RGBMASK);
+    __m128i zero = _mm_setzero_si128();
+    while (n >= 4) {
+        __m128i src = _mm_loadu_si128((__m128i*)src_buffer);
+        __m128i dst = _mm_loadu_si128((__m128i*)dst_buffer);
+        // mask2 = (a * alpha) >> 8
+        __m128i mask2 = _mm_srli_epi32(_mm_mullo_epi16(_mm_srli_epi32(src, 24), alpha_v), 8);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(mask2, zero)) != 0xFFFF) {
+            __m128i s = scaleChannels(src, mask2);
+            dst = subtract ? _mm_subs_epu8(dst, s) : _mm_adds_epu8(dst, s);
+        }
+        _mm_storeu_si128((__m128i*)dst_buffer, _mm_and_si128(dst, rgb));
+
+        n -= 4; src_buffer += 4; dst_buffer += 4; alphap += 16;
+    }
+
+    // If any pixels are left over, deal with them individually
+    ++n;
+    if (subtract) {
+        BASIC_SUBBLEND();
+    } else {
+        BASIC_ADDBLEND();
+    }
+}
+
+static HELPER_FN void imageFilterBlendText_SSE_Common(Uint32 *dst_buffer, Uint8 *src_buffer, Uint32 src_color1, Uint32 src_color2, int length) {
+#ifndef BPP16
+    int n = length;
+
+    // Glyph coverage is mostly 0 or 0xff; check 16 pixels at a time
+    // and only blend the edges one by one.
+    __m128i zero = _mm_setzero_si128();
+    __m128i full = _mm_set1_epi8((char)0xFF);
+    __m128i colour = _mm_set1_epi32(src_color1 | src_color2 | AMASK);
+    while (n >= 16) {
+        __m128i coverage = _mm_loadu_si128((__m128i*)src_buffer);
+        int clear = _mm_movemask_epi8(_mm_cmpeq_epi8(coverage, zero));
+        int solid = _mm_movemask_epi8(_mm_cmpeq_epi8(coverage, full));
+        if (solid == 0xFFFF) {
+            for (int i = 0; i < 16; i += 4) {
+                _mm_storeu_si128((__m128i*)(dst_buffer + i), colour);
+            }
+        } else if (clear != 0xFFFF) {
+            for (int i = 0; i < 16; i++) {
+                if (!(clear & (1 << i))) {
+                    blendTextPixel(dst_buffer + i, src_buffer + i, src_color1, src_color2);
+                }
+            }
+        }
+        n -= 16; src_buffer += 16; dst_buffer += 16;
+    }
+
+    for (; n > 0; n--) {
+        blendTextPixel(dst_buffer++, src_buffer++, src_color1, src_color2);
+    }
+#endif
+}
+
 static HELPER_FN bool alphaMaskBlend_SSE_Common(SDL_Surface* dst, SDL_Surface *s1, SDL_Surface *s2, SDL_Surface *mask_surface, const SDL_Rect& rect, Uint32 mask_value)
 {
     if (mask_surface->w < 4) {
@@ -206,7 +299,8 @@ static HELPER_FN void alphaMaskBlendConst_SSE_Common(SDL_Surface* dst, SDL_Surfa
         }
         __m128i mask_000000ff = _mm_set1_epi32(0x000000FF);
         __m128i mask_00ff00ff = _mm_set1_epi32(0x00FF00FF);
-        __m128i mask2 = _mm_set1_epi16(mask_value);
+        // Clamped as blendMaskOnePixel() does
+        __m128i mask2 = _mm_set1_epi16(mask_value < 0xFF ? mask_value : 0xFF);
         __m128i mask1 = _mm_xor_si128(mask2, mask_00ff00ff);
         for (; x < (end_x - 15); x += 16) {
             __m128i s1v = _mm_loadu_si128((__m128i*)(s1p + x));
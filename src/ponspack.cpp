@@ -0,0 +1,464 @@
+/* -*- C++ -*-
+ *
+ *  ponspack.cpp - Converts NSA/SAR archives to the PackedArchive format
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+// Usage: ponspack [options] output.psa archive...
+//        ponspack -t archive.psa
+//
+// Archives are read in the order given and, as in the engine, the
+// first one to contain a name provides it.  The output, named arc.psa
+// (or arc1.psa and on) next to a game's other archives, is found
+// before any of them.  SPB images are kept as they are; everything
+// else is split into bzip2 chunks, unless that saves too little.
+// The readers pull in the text encoding code, so this is linked with
+// the rest of the engine.
+
+#include "SarReader.h"
+#include "PackedArchive.h"
+#include "encoding.h"
+#include <bzlib.h>
+#include <string.h>
+
+#define DEFAULT_CHUNK_SIZE (64 * 1024)
+#define COPY_SIZE (64 * 1024)
+
+// The NSA and SAR archives being converted.  Entries are read
+// straight from the archives, so loose files can't shadow them.
+class SourceArchives : public SarReader {
+public:
+    struct Item {
+        ArchiveInfo* ai;
+        unsigned int index;
+    };
+
+    bool add(const pstring& path, int archive_type);
+
+    // Every entry the engine would find, in archive order.
+    void items(std::vector<Item>& out);
+
+    const pstring& name(const Item& it) const {
+        return it.ai->fi_list[it.index].name;
+    }
+    bool isSPB(const Item& it);
+    size_t length(const Item& it);
+    size_t read(const Item& it, unsigned char* buf);
+    size_t readStored(const Item& it, unsigned char* buf);
+};
+
+
+bool SourceArchives::add(const pstring& path, int archive_type)
+{
+    ArchiveInfo* info = new ArchiveInfo();
+    if ((info->file_handle = fopen(path, "rb")) == NULL) {
+        delete info;
+        return false;
+    }
+
+    info->file_name = path;
+    readArchive(info, archive_type);
+    info->map.map(info->file_handle);
+    file_index.add(info);
+
+    last_archive_info->next = info;
+    last_archive_info = info;
+    num_of_sar_archives++;
+    return true;
+}
+
+
+void SourceArchives::items(std::vector<Item>& out)
+{
+    ArchiveInfo* ai = archive_info.next;
+    for (int n = 0; n < num_of_sar_archives; n++, ai = ai->next) {
+        for (unsigned int i = 0; i < ai->num_of_files; i++) {
+            ArchiveIndex::Location loc;
+            if (!file_index.find(ArchiveIndex::normalize(ai->fi_list[i].name),
+                                 loc) ||
+                loc.ai != ai || loc.index != i)
+                continue;
+
+            Item it = { ai, i };
+            out.push_back(it);
+        }
+    }
+}
+
+
+bool SourceArchives::isSPB(const Item& it)
+{
+    int type = it.ai->fi_list[it.index].compression_type;
+    if (type == NO_COMPRESSION) type = getRegisteredCompressionType(name(it));
+    return type == SPB_COMPRESSION;
+}
+
+
+size_t SourceArchives::length(const Item& it)
+{
+    return getFileLengthSub(it.ai, it.index, name(it));
+}
+
+
+size_t SourceArchives::read(const Item& it, unsigned char* buf)
+{
+    return getFileSub(it.ai, it.index, name(it), buf);
+}
+
+
+size_t SourceArchives::readStored(const Item& it, unsigned char* buf)
+{
+    FileInfo& fi = it.ai->fi_list[it.index];
+    size_t len = MappedFile::readAt(it.ai->file_handle, fi.offset, buf,
+                                    fi.length);
+    decodeKeyTable(buf, buf, len);
+    return len;
+}
+
+
+struct PackedEntry {
+    pstring key;
+    Uint32 hash;
+    int type;
+    Uint64 offset, length, original_length;
+    Uint32 checksum;
+    std::vector<Uint64> boundaries; // CHUNKED only, from 0
+};
+
+
+// Directory order: bucket, then hash, then name.
+struct EntryOrder {
+    Uint32 mask;
+    EntryOrder(Uint32 mask) : mask(mask) {}
+    bool operator()(const PackedEntry* a, const PackedEntry* b) const {
+        if ((a->hash & mask) != (b->hash & mask))
+            return (a->hash & mask) < (b->hash & mask);
+        if (a->hash != b->hash) return a->hash < b->hash;
+        return strcmp(a->key, b->key) < 0;
+    }
+};
+
+
+static void put32(std::vector<unsigned char>& out, Uint32 v)
+{
+    for (int i = 0; i < 4; i++) out.push_back((v >> (8 * i)) & 0xff);
+}
+
+
+static void put64(std::vector<unsigned char>& out, Uint64 v)
+{
+    put32(out, (Uint32) v);
+    put32(out, (Uint32) (v >> 32));
+}
+
+
+static bool writeAll(FILE* fp, const void* data, size_t len)
+{
+    return fwrite(data, 1, len, fp) == len;
+}
+
+
+static bool pad(FILE* fp, Uint64& pos)
+{
+    static const unsigned char zeros[PackedArchive::PAGE_SIZE] = { 0 };
+    size_t n = (size_t) ((PackedArchive::PAGE_SIZE -
+                          pos % PackedArchive::PAGE_SIZE) %
+                         PackedArchive::PAGE_SIZE);
+    pos += n;
+    return writeAll(fp, zeros, n);
+}
+
+
+// Compresses data in chunks into out, filling in the entry; false if
+// that wouldn't save at least an eighth.
+static bool compressChunks(const unsigned char* data, size_t len,
+                           unsigned int chunk_size, PackedEntry& e,
+                           std::vector<unsigned char>& out)
+{
+    std::vector<char> buf(chunk_size + chunk_size / 100 + 601);
+    out.clear();
+    e.boundaries.clear();
+    e.boundaries.push_back(0);
+    for (size_t start = 0; start < len; start += chunk_size) {
+        unsigned int n = len - start < chunk_size ? len - start : chunk_size;
+        unsigned int out_len = buf.size();
+        if (BZ2_bzBuffToBuffCompress(&buf[0], &out_len,
+                                     (char*) data + start, n,
+                                     9, 0, 0) != BZ_OK)
+            return false;
+        out.insert(out.end(), buf.begin(), buf.begin() + out_len);
+        e.boundaries.push_back(out.size());
+        if (out.size() >= len - len / 8) return false;
+    }
+    return len > 0;
+}
+
+
+static int usage()
+{
+    fprintf(stderr,
+            "Usage: ponspack [options] output.psa archive...\n"
+            "       ponspack -t archive.psa\n"
+            "Converts .nsa, .ns2, .ns3 and .sar archives; the first to\n"
+            "contain a name provides it, as in the engine.\n"
+            "  -c KiB   size of compressed chunks (default %d)\n"
+            "  -s       store everything uncompressed\n"
+            "  --cp932  keep names in Shift-JIS, for scripts in that\n"
+            "           encoding (default: convert them to UTF-8)\n"
+            "  -t       check every entry of a packed archive\n",
+            DEFAULT_CHUNK_SIZE / 1024);
+    return 1;
+}
+
+
+static int test(const pstring& path)
+{
+    PackedArchive pa;
+    if (!pa.open(path)) {
+        fprintf(stderr, "can't open %s\n", (const char*) path);
+        return 1;
+    }
+
+    unsigned int bad = 0;
+    for (unsigned int i = 0; i < pa.numEntries(); i++) {
+        if (pa.type(i) == PackedArchive::CHUNKED) {
+            std::vector<unsigned char> buf(pa.length(i) + 1);
+            if (pa.read(i, &buf[0]) != pa.length(i)) bad++;
+        }
+        else if (!pa.verify(i))
+            bad++;
+    }
+    printf("%s: %u entries, %u bad\n", (const char*) path,
+           pa.numEntries(), bad);
+    return bad ? 1 : 0;
+}
+
+
+static int archiveType(const pstring& path)
+{
+    int dot = path.reversefind('.', path.length() - 1);
+    pstring ext = dot >= 0 ? path.midstr(dot + 1, path.length()) : "";
+    ext.tolower();
+    if (ext == "sar") return BaseReader::ARCHIVE_TYPE_SAR;
+    if (ext == "nsa") return BaseReader::ARCHIVE_TYPE_NSA;
+    if (ext == "ns2") return BaseReader::ARCHIVE_TYPE_NS2;
+    if (ext == "ns3") return BaseReader::ARCHIVE_TYPE_NS3;
+    return BaseReader::ARCHIVE_TYPE_NONE;
+}
+
+
+int main(int argc, char** argv)
+{
+    unsigned int chunk_size = DEFAULT_CHUNK_SIZE;
+    bool store_only = false, cp932 = false, testing = false;
+
+    int a = 1;
+    for (; a < argc && argv[a][0] == '-'; a++) {
+        if (!strcmp(argv[a], "-c") && a + 1 < argc) {
+            chunk_size = atoi(argv[++a]) * 1024;
+            if (chunk_size == 0) return usage();
+        }
+        else if (!strcmp(argv[a], "-s"))
+            store_only = true;
+        else if (!strcmp(argv[a], "--cp932"))
+            cp932 = true;
+        else if (!strcmp(argv[a], "-t"))
+            testing = true;
+        else
+            return usage();
+    }
+    if (testing) return a + 1 == argc ? test(argv[a]) : usage();
+    if (argc - a < 2) return usage();
+
+    // Archive names are kept in this encoding, as the engine would
+    // keep them for a script in it.
+    if (cp932) file_encoding = new CP932Encoding;
+    else file_encoding = new UTF8Encoding;
+
+    pstring output = argv[a++];
+    SourceArchives src;
+    for (; a < argc; a++) {
+        int type = archiveType(argv[a]);
+        if (type == BaseReader::ARCHIVE_TYPE_NONE) {
+            fprintf(stderr, "%s: not an .nsa, .ns2, .ns3 or .sar archive "
+                    "(keyed archives aren't supported)\n", argv[a]);
+            return 1;
+        }
+        if (!src.add(argv[a], type)) {
+            fprintf(stderr, "can't open %s\n", argv[a]);
+            return 1;
+        }
+    }
+
+    std::vector<SourceArchives::Item> items;
+    src.items(items);
+
+    // Entry data goes to a scratch file first, as where it starts
+    // depends on the size of the directory.
+    pstring data_name = output + ".tmp";
+    FILE* data = fopen(data_name, "w+b");
+    if (!data) {
+        fprintf(stderr, "can't create %s\n", (const char*) data_name);
+        return 1;
+    }
+
+    std::vector<PackedEntry> entries(items.size());
+    std::vector<unsigned char> buf, packed;
+    Uint64 pos = 0, total_in = 0;
+    for (size_t n = 0; n < items.size(); n++) {
+        const SourceArchives::Item& it = items[n];
+        PackedEntry& e = entries[n];
+        e.key = ArchiveIndex::normalize(src.name(it));
+        e.hash = ArchiveIndex::hash(e.key);
+        e.original_length = src.length(it);
+
+        const unsigned char* out;
+        if (src.isSPB(it)) {
+            e.type = PackedArchive::SPB;
+            buf.resize(it.ai->fi_list[it.index].length + 1);
+            e.length = src.readStored(it, &buf[0]);
+            out = &buf[0];
+        }
+        else {
+            buf.resize(e.original_length + 1);
+            size_t len = src.read(it, &buf[0]);
+            if (len != e.original_length) {
+                fprintf(stderr, "can't read %s from %s\n",
+                        (const char*) src.name(it),
+                        (const char*) it.ai->file_name);
+                fclose(data);
+                remove(data_name);
+                return 1;
+            }
+            if (!store_only &&
+                compressChunks(&buf[0], len, chunk_size, e, packed)) {
+                e.type = PackedArchive::CHUNKED;
+                e.length = packed.size();
+                out = &packed[0];
+            }
+            else {
+                e.type = PackedArchive::STORED;
+                e.length = len;
+                out = &buf[0];
+                e.boundaries.clear();
+            }
+        }
+        total_in += it.ai->fi_list[it.index].length;
+
+        e.checksum = PackedArchive::checksum(out, e.length);
+        if ((e.length >= PackedArchive::PAGE_SIZE && !pad(data, pos)) ||
+            !writeAll(data, out, e.length)) {
+            fprintf(stderr, "can't write %s\n", (const char*) data_name);
+            fclose(data);
+            remove(data_name);
+            return 1;
+        }
+        e.offset = pos;
+        pos += e.length;
+    }
+
+    Uint32 num_buckets = 1;
+    while (num_buckets < entries.size()) num_buckets <<= 1;
+
+    std::vector<PackedEntry*> order(entries.size());
+    for (size_t n = 0; n < entries.size(); n++) order[n] = &entries[n];
+    std::sort(order.begin(), order.end(), EntryOrder(num_buckets - 1));
+
+    std::vector<unsigned char> directory, entry_table, boundaries, names;
+    std::vector<Uint32> bucket_start(num_buckets + 1, 0);
+    for (size_t n = 0; n < order.size(); n++)
+        bucket_start[(order[n]->hash & (num_buckets - 1)) + 1]++;
+    for (Uint32 b = 0; b < num_buckets; b++)
+        bucket_start[b + 1] += bucket_start[b];
+    for (Uint32 b = 0; b <= num_buckets; b++)
+        put32(directory, bucket_start[b]);
+
+    // Offsets are put in once the size of the directory is known.
+    Uint32 num_boundaries = 0;
+    for (size_t n = 0; n < order.size(); n++) {
+        PackedEntry& e = *order[n];
+        put32(entry_table, e.hash);
+        put32(entry_table, names.size());
+        put32(entry_table, e.key.length());
+        put32(entry_table, e.type);
+        put64(entry_table, 0);
+        put64(entry_table, e.length);
+        put64(entry_table, e.original_length);
+        put32(entry_table, e.checksum);
+        put32(entry_table, num_boundaries);
+        names.insert(names.end(), (const char*) e.key,
+                     (const char*) e.key + e.key.length());
+        for (size_t k = 0; k < e.boundaries.size(); k++)
+            put64(boundaries, e.boundaries[k]);
+        num_boundaries += e.boundaries.size();
+    }
+    size_t directory_length = directory.size() + entry_table.size() +
+                              boundaries.size() + names.size();
+    Uint64 data_start = PackedArchive::HEADER_SIZE + directory_length;
+    data_start += (PackedArchive::PAGE_SIZE -
+                   data_start % PackedArchive::PAGE_SIZE) %
+                  PackedArchive::PAGE_SIZE;
+    for (size_t n = 0; n < order.size(); n++) {
+        std::vector<unsigned char> offset;
+        put64(offset, data_start + order[n]->offset);
+        memcpy(&entry_table[n * PackedArchive::ENTRY_SIZE + 16], &offset[0], 8);
+    }
+    directory.insert(directory.end(), entry_table.begin(), entry_table.end());
+    directory.insert(directory.end(), boundaries.begin(), boundaries.end());
+    directory.insert(directory.end(), names.begin(), names.end());
+
+    std::vector<unsigned char> header(PackedArchive::MAGIC,
+                                      PackedArchive::MAGIC + 4);
+    put32(header, PackedArchive::VERSION);
+    put32(header, entries.size());
+    put32(header, num_buckets);
+    put32(header, chunk_size);
+    put32(header, num_boundaries);
+    put32(header, directory_length);
+    put32(header, PackedArchive::checksum(&directory[0], directory.size()));
+
+    // readAt() goes around stdio's buffer.
+    FILE* fp = fopen(output, "wb");
+    bool ok = fp != NULL && fflush(data) == 0;
+    Uint64 out_pos = 0;
+    if (ok) {
+        ok = writeAll(fp, &header[0], header.size()) &&
+             writeAll(fp, &directory[0], directory.size());
+        out_pos = header.size() + directory.size();
+        ok = ok && pad(fp, out_pos);
+    }
+    buf.resize(COPY_SIZE);
+    for (Uint64 done = 0; ok && done < pos; ) {
+        size_t n = MappedFile::readAt(data, done, &buf[0], COPY_SIZE);
+        ok = n > 0 && writeAll(fp, &buf[0], n);
+        done += n;
+    }
+    fclose(data);
+    remove(data_name);
+    if (fp && fclose(fp) != 0) ok = false;
+    if (!ok) {
+        fprintf(stderr, "can't write %s\n", (const char*) output);
+        remove(output);
+        return 1;
+    }
+
+    printf("%s: %u entries, %lu KiB from %lu KiB\n", (const char*) output,
+           (unsigned int) entries.size(),
+           (unsigned long) ((data_start + pos) / 1024),
+           (unsigned long) (total_in / 1024));
+    return 0;
+}
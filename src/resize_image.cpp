@@ -1,5 +1,5 @@
 /* -*- C++ -*-
- * 
+ *
  *  resize_image.cpp - resize image using smoothing and resampling
  *
  *  Copyright (c) 2001-2005 Ogapee. All rights reserved.
@@ -24,212 +24,280 @@
 // Modified by Uncle Mion (UncleMion@gmail.com) Nov-Dec 2009,
 //   to account for multicell images during resizing and optimize code
 
-#include <stdio.h>
+// Both passes work on whole rows with tables worked out once per
+// image, so bands of rows can be handed to the compositor's threads.
+// The results are the same as those of the original per-pixel code:
+// the box filter divides the exact window sum, and the bilinear step
+// is done as a horizontal then a vertical lerp in 1/8 steps, which is
+// the same sum of products grouped differently.
+
+#include "resize_image.h"
+#include "graphics_accelerated.h"
+#include "Compositor.h"
 #include <string.h>
+#include <vector>
+
+// Above this many pixels in a smoothing window the reciprocal can be
+// off by one; divide instead.
+#define MAX_RECIP_DIVISOR 4104
+
+struct ResizeJob {
+    AcceleratedGraphicsFunctions* gfx;
 
-static unsigned long *pixel_accum=NULL;
-static unsigned long *pixel_accum_num=NULL;
-static int pixel_accum_size=0;
-static unsigned long tmp_acc[4];
-static unsigned long tmp_acc_num[4];
+    const unsigned char* src;
+    int src_width, src_height, src_pitch;
+    unsigned char* dst;
+    int dst_width, dst_height, dst_pitch;
+    int cell_width;
 
-static void calcWeightedSumColumnInit(unsigned char **src,
-                                      int interpolation_height,
-                                      int image_width, int image_height,
-                                      int image_pixel_width, int byte_per_pixel)
+    // Smoothing: window size, and the number of columns of each
+    // pixel's window that lie inside its cell.
+    int interpolation_width, interpolation_height;
+    std::vector<int> window_cols;
+    unsigned char* smoothed;
+
+    // Resampling source (smoothed, or src if no smoothing was needed)
+    // and, for each destination column, the byte offsets of the two
+    // source pixels and the weight of the second in eighths.
+    const unsigned char* sample;
+    int sample_pitch;
+    std::vector<int> xa, xb, dx;
+};
+
+
+static inline int cellStart(const ResizeJob& job, int x)
 {
-    int y_end   = -interpolation_height/2+interpolation_height;
-
-    memset(pixel_accum, 0, image_width*byte_per_pixel*sizeof(unsigned long));
-    memset(pixel_accum_num, 0, image_width*byte_per_pixel*sizeof(unsigned long));
-    for (int s=0 ; s<byte_per_pixel ; s++){
-        for (int i=0 ; i<y_end-1 ; i++){
-            if (i >= image_height) break;
-            unsigned long *pa = pixel_accum + image_width*s;
-            unsigned long *pan = pixel_accum_num + image_width*s;
-            unsigned char *p = *src+image_pixel_width*i+s;
-            for (int j=image_width ; j>0 ; j--, p+=byte_per_pixel){
-                *pa++ += *p;
-                (*pan++)++;
-            }
-        }
-    }
+    return x / job.cell_width * job.cell_width;
+}
+
+
+static void addRow(std::vector<Uint32>& sum, const unsigned char* row)
+{
+    for (size_t i = 0; i < sum.size(); i++) sum[i] += row[i];
+}
+
+
+static void subtractRow(std::vector<Uint32>& sum, const unsigned char* row)
+{
+    for (size_t i = 0; i < sum.size(); i++) sum[i] -= row[i];
 }
 
-static void calcWeightedSumColumn(unsigned char **src, int y,
-                                  int interpolation_height,
-                                  int image_width, int image_height,
-                                  int image_pixel_width, int byte_per_pixel)
+
+// Box filter for one band of rows, into job.smoothed.  A running sum
+// down each column gives the vertical part; a running sum of those
+// along each cell gives the window.
+static void smoothBand(void* data, SDL_Rect& band)
 {
-    int y_start = y-interpolation_height/2;
-    int y_end   = y-interpolation_height/2+interpolation_height;
-
-    for (int s=0 ; s<byte_per_pixel ; s++){
-        if ((y_start-1)>=0 && (y_start-1)<image_height){
-            unsigned long *pa = pixel_accum + image_width*s;
-            unsigned long *pan = pixel_accum_num + image_width*s;
-            unsigned char *p = *src+image_pixel_width*(y_start-1)+s;
-            for (int j=image_width ; j>0 ; j--, p+=byte_per_pixel){
-                *pa++ -= *p;
-                (*pan++)--;
+    ResizeJob& job = *(ResizeJob*) data;
+    const int w = job.src_width, h = job.src_height;
+    const int iw = job.interpolation_width, ih = job.interpolation_height;
+
+    std::vector<Uint32> sum(w * 4, 0);
+    int first = band.y - ih / 2;
+    for (int r = first < 0 ? 0 : first; r < first + ih && r < h; r++)
+        addRow(sum, job.src + job.src_pitch * r);
+
+    // floor(s / n) is (s * recip[x]) >> 32 for the s that can occur
+    std::vector<Uint64> recip(w);
+    int recip_rows = -1;
+
+    // One cell's column sums with iw zero pixels either side, so the
+    // window can slide along it without checking the ends.
+    std::vector<Uint32> padded((job.cell_width + 2 * iw) * 4, 0);
+
+    for (int y = band.y; y < band.y + band.h; y++) {
+        int top = y - ih / 2, bottom = top + ih - 1;
+        if (y > band.y) {
+            if (top - 1 >= 0 && top - 1 < h)
+                subtractRow(sum, job.src + job.src_pitch * (top - 1));
+            if (bottom >= 0 && bottom < h)
+                addRow(sum, job.src + job.src_pitch * bottom);
+        }
+        int rows = (bottom < h ? bottom : h - 1) - (top > 0 ? top : 0) + 1;
+        if (rows != recip_rows) {
+            for (int x = 0; x < w; x++) {
+                Uint32 n = rows * job.window_cols[x];
+                recip[x] = n <= MAX_RECIP_DIVISOR ? (Uint64(1) << 32) / n + 1 : 0;
             }
+            recip_rows = rows;
         }
-        
-        if ((y_end-1)>=0 && (y_end-1)<image_height){
-            unsigned long *pa = pixel_accum + image_width*s;
-            unsigned long *pan = pixel_accum_num + image_width*s;
-            unsigned char *p = *src+image_pixel_width*(y_end-1)+s;
-            for (int j=image_width ; j>0 ; j--, p+=byte_per_pixel){
-                *pa++ += *p;
-                (*pan++)++;
+
+        unsigned char* out = job.smoothed + w * 4 * y;
+        for (int c = 0; c < w; c += job.cell_width) {
+            int end = c + job.cell_width < w ? c + job.cell_width : w;
+            int n = end - c;
+            memcpy(&padded[iw * 4], &sum[c * 4], n * 4 * sizeof(Uint32));
+            if (n < job.cell_width)
+                memset(&padded[(iw + n) * 4], 0,
+                       (job.cell_width - n) * 4 * sizeof(Uint32));
+
+            // p[i * 4] is the sum for column c + i
+            const Uint32* p = &padded[iw * 4];
+            Uint32 acc[4] = { 0, 0, 0, 0 };
+            for (int i = -iw / 2; i < -iw / 2 + iw - 1; i++)
+                for (int k = 0; k < 4; k++) acc[k] += p[i * 4 + k];
+            for (int x = c; x < end; x++) {
+                int leaving = x - c - iw / 2 - 1, entering = leaving + iw;
+                for (int k = 0; k < 4; k++)
+                    acc[k] += p[entering * 4 + k] - p[leaving * 4 + k];
+                if (recip[x]) {
+                    for (int k = 0; k < 4; k++)
+                        out[x * 4 + k] = (unsigned char) ((acc[k] * recip[x]) >> 32);
+                }
+                else {
+                    Uint32 n = rows * job.window_cols[x];
+                    for (int k = 0; k < 4; k++)
+                        out[x * 4 + k] = (unsigned char) (acc[k] / n);
+                }
             }
         }
     }
 }
 
-static void calcWeightedSum(unsigned char **dst, int x_start, int x_end,
-                            int image_width, int cell_start, int next_cell_start,
-                            int byte_per_pixel)
+
+// One source row lerped horizontally to the destination width, in
+// eighths of a unit.
+static void lerpColumns(const ResizeJob& job, const unsigned char* row,
+                        Uint16* out)
 {
-    for (int s=0 ; s<byte_per_pixel ; s++){
-        // avoid interpolating data from other cells or outside the image
-        if (x_start>=cell_start && x_start<next_cell_start){
-            tmp_acc[s] -= pixel_accum[image_width*s+x_start];
-            tmp_acc_num[s] -= pixel_accum_num[image_width*s+x_start];
-        }
-        if (x_end>=cell_start && x_end<next_cell_start){
-            tmp_acc[s] += pixel_accum[image_width*s+x_end];
-            tmp_acc_num[s] += pixel_accum_num[image_width*s+x_end];
+    for (int j = 0; j < job.dst_width; j++, out += 4) {
+        const unsigned char* a = row + job.xa[j];
+        const unsigned char* b = row + job.xb[j];
+        int d = job.dx[j], e = 8 - d;
+        out[0] = e * a[0] + d * b[0];
+        out[1] = e * a[1] + d * b[1];
+        out[2] = e * a[2] + d * b[2];
+        out[3] = e * a[3] + d * b[3];
+    }
+}
+
+
+static void resampleBand(void* data, SDL_Rect& band)
+{
+    ResizeJob& job = *(ResizeJob*) data;
+    const int length = job.dst_width * 4;
+
+    // The last two lerped rows, as successive destination rows mostly
+    // reuse them when enlarging.
+    std::vector<Uint16> buf0(length), buf1(length);
+    Uint16* upper = &buf0[0];
+    Uint16* lower = &buf1[0];
+    int upper_row = -1, lower_row = -1;
+
+    for (int i = band.y; i < band.y + band.h; i++) {
+        int y = (int) ((Sint64) (i << 3) * job.src_height / job.dst_height);
+        int dy = y & 0x7;
+        y >>= 3;
+        //avoid resampling outside the image
+        int y2 = y < job.src_height - 1 ? y + 1 : y;
+
+        if (upper_row != y) {
+            if (lower_row == y) {
+                Uint16* t = upper; upper = lower; lower = t;
+                lower_row = upper_row;
+            }
+            else
+                lerpColumns(job, job.sample + job.sample_pitch * y, upper);
+            upper_row = y;
         }
-        switch (tmp_acc_num[s]){
-            //avoid a division op if possible
-            case 1: *(*dst)++ = (unsigned char)tmp_acc[s];
-                    break;
-            case 2: *(*dst)++ = (unsigned char)(tmp_acc[s]>>1);
-                    break;
-            default:
-            case 3: *(*dst)++ = (unsigned char)(tmp_acc[s]/tmp_acc_num[s]);
-                    break;
-            case 4: *(*dst)++ = (unsigned char)(tmp_acc[s]>>2);
-                    break;
+        Uint16* second = upper;
+        if (dy && y2 != y) {
+            if (lower_row != y2) {
+                lerpColumns(job, job.sample + job.sample_pitch * y2, lower);
+                lower_row = y2;
+            }
+            second = lower;
         }
+
+        unsigned char* out = job.dst + job.dst_pitch * i;
+        job.gfx->imageFilterLerp(out, upper, second, dy, length);
+        memset(out + length, 0, job.dst_pitch - length);
     }
 }
 
+
 void resizeImage( unsigned char *dst_buffer, int dst_width, int dst_height, int dst_total_width,
-                  unsigned char *src_buffer, int src_width, int src_height, int src_total_width,
-                  int byte_per_pixel, unsigned char *tmp_buffer, int tmp_total_width, int num_cells )
+                  const unsigned char *src_buffer, int src_width, int src_height, int src_total_width,
+                  int num_cells, AcceleratedGraphicsFunctions *gfx, Compositor *compositor )
 {
     if (dst_width == 0 || dst_height == 0) return;
-    
-    unsigned char *tmp_buf = tmp_buffer;
-    unsigned char *src_buf = src_buffer;
 
-    int i, j, s, c;
-    int tmp_offset = tmp_total_width - src_width * byte_per_pixel;
-
-    int mx=0, my=0;
-
-    if ( src_width  > 1 ) mx = byte_per_pixel;
-    if ( src_height > 1 ) my = tmp_total_width;
+    AcceleratedGraphicsFunctions basic;
+    ResizeJob job;
+    job.gfx = gfx ? gfx : &basic;
+    job.src = src_buffer;
+    job.src_width = src_width;
+    job.src_height = src_height;
+    job.src_pitch = src_total_width;
+    job.dst = dst_buffer;
+    job.dst_width = dst_width;
+    job.dst_height = dst_height;
+    job.dst_pitch = dst_total_width;
+    job.cell_width = src_width / num_cells;
 
     int interpolation_width = src_width / dst_width;
     if ( interpolation_width == 0 ) interpolation_width = 1;
     int interpolation_height = src_height / dst_height;
     if ( interpolation_height == 0 ) interpolation_height = 1;
+    job.interpolation_width = interpolation_width;
+    job.interpolation_height = interpolation_height;
 
-    int cell_width = src_width / num_cells;
+    /* smoothing; a 1x1 window leaves the image as it is */
+    unsigned char* smoothed = NULL;
+    job.sample = src_buffer;
+    job.sample_pitch = src_total_width;
+    if (interpolation_width > 1 || interpolation_height > 1) {
+        job.window_cols.resize(src_width);
+        for (int x = 0; x < src_width; x++) {
+            int c = cellStart(job, x);
+            int end = c + job.cell_width < src_width ? c + job.cell_width : src_width;
+            int left = x - interpolation_width / 2;
+            int right = left + interpolation_width - 1;
+            job.window_cols[x] = (right < end ? right : end - 1) -
+                                 (left > c ? left : c) + 1;
+        }
+        smoothed = new unsigned char[src_width * src_height * 4];
+        job.smoothed = smoothed;
 
-    if (pixel_accum_size < src_width*byte_per_pixel){
-        pixel_accum_size = src_width*byte_per_pixel;
-        if (pixel_accum) delete[] pixel_accum;
-        pixel_accum = new unsigned long[pixel_accum_size];
-        if (pixel_accum_num) delete[] pixel_accum_num;
-        pixel_accum_num = new unsigned long[pixel_accum_size];
-    }
-    /* smoothing */
-    if (byte_per_pixel >= 3){
-        calcWeightedSumColumnInit(&src_buf, interpolation_height, src_width,
-                                  src_height, src_total_width, byte_per_pixel );
-        for ( i=0 ; i<src_height ; i++ ){
-            calcWeightedSumColumn(&src_buf, i, interpolation_height, src_width,
-                                  src_height, src_total_width, byte_per_pixel );
-            for ( c=0 ; c<src_width ; c+=cell_width ) {
-                // do a separate set of smoothings for each cell,
-                // to avoid interpolating data from other cells
-                for ( s=0 ; s<byte_per_pixel ; s++ ){
-                    tmp_acc[s]=0;
-                    tmp_acc_num[s]=0;
-                    for (j=0 ; j<-interpolation_width/2+interpolation_width-1 ; j++){
-                        if (j >= cell_width) break;
-                        tmp_acc[s] += pixel_accum[src_width*s+c+j];
-                        tmp_acc_num[s] += pixel_accum_num[src_width*s+c+j];
-                    }
-                }
+        SDL_Rect rect = { 0, 0, src_width, src_height };
+        if (compositor) compositor->run(smoothBand, &job, rect);
+        else smoothBand(&job, rect);
 
-                int x_start = c - interpolation_width/2 - 1;
-                int x_end   = x_start + interpolation_width;
-                for ( j=cell_width ; j>0 ; j--, x_start++, x_end++ )
-                    calcWeightedSum(&tmp_buf, x_start, x_end,
-                                    src_width, c, c+cell_width,
-                                    byte_per_pixel );
-            }
-            tmp_buf += tmp_offset;
-        }
-    }
-    else{
-        tmp_buffer = src_buffer;
+        job.sample = job.smoothed;
+        job.sample_pitch = src_width * 4;
     }
-    
+
     /* resampling */
-    int* dst_to_src = new int[dst_width]; //lookup table for horiz resampling loop
-    for ( j=0 ; j<dst_width ; j++ )
-        dst_to_src[j] = (j<<3) * src_width / dst_width;
-    unsigned char *dst_buf = dst_buffer;
-    for ( i=0 ; i<dst_height ; i++ ){
-        int y = (i<<3) * src_height / dst_height;
-        int dy = y & 0x7;
-        y >>= 3;
-        //avoid resampling outside the image
-        int iy = 0;
-        if (y<src_height-1) iy = my;
-
-        for ( j=0 ; j<dst_width ; j++ ){
-            int x = dst_to_src[j];
-            int dx = x & 0x7;
-            x >>= 3;
-            //avoid resampling from outside the current cell
-            int ix = mx;
-            if (((x+1)%cell_width)==0) ix = 0;
-
-            int k = tmp_total_width * y + x * byte_per_pixel;
-
-            for ( s=byte_per_pixel ; s>0 ; s--, k++ ){
-                unsigned int p;
-                p =  (8-dx)*(8-dy)*tmp_buffer[ k ];
-                p +=    dx *(8-dy)*tmp_buffer[ k+ix ];
-                p += (8-dx)*   dy *tmp_buffer[ k+iy ];
-                p +=    dx *   dy *tmp_buffer[ k+ix+iy ];
-                *dst_buf++ = (unsigned char)(p>>6);
-            }
-        }
-        for ( j=dst_total_width - dst_width*byte_per_pixel ; j>0 ; j-- )
-            *dst_buf++ = 0;
+    job.xa.resize(dst_width);
+    job.xb.resize(dst_width);
+    job.dx.resize(dst_width);
+    for (int j = 0; j < dst_width; j++) {
+        int x = (int) ((Sint64) (j << 3) * src_width / dst_width);
+        job.dx[j] = x & 0x7;
+        x >>= 3;
+        job.xa[j] = x * 4;
+        //avoid resampling from outside the current cell
+        job.xb[j] = src_width > 1 && (x + 1) % job.cell_width != 0
+                  ? (x + 1) * 4 : x * 4;
     }
-    delete[] dst_to_src;
+
+    SDL_Rect rect = { 0, 0, dst_width, dst_height };
+    if (compositor) compositor->run(resampleBand, &job, rect);
+    else resampleBand(&job, rect);
+    delete[] smoothed;
 
     /* pixels at the corners (of each cell) are preserved */
-    int dst_cell_width = byte_per_pixel * dst_width / num_cells;
-    cell_width *= byte_per_pixel;
-    for ( c=0 ; c<num_cells ; c++ ){
-        for ( i=0 ; i<byte_per_pixel ; i++ ){
+    int dst_cell_width = 4 * dst_width / num_cells;
+    int cell_width = job.cell_width * 4;
+    for (int c = 0 ; c < num_cells ; c++) {
+        for (int i = 0 ; i < 4 ; i++) {
             dst_buffer[c*dst_cell_width+i] = src_buffer[c*cell_width+i];
-            dst_buffer[(c+1)*dst_cell_width-byte_per_pixel+i] =
-                src_buffer[(c+1)*cell_width-byte_per_pixel+i];
+            dst_buffer[(c+1)*dst_cell_width-4+i] =
+                src_buffer[(c+1)*cell_width-4+i];
             dst_buffer[(dst_height-1)*dst_total_width+c*dst_cell_width+i] =
                 src_buffer[(src_height-1)*src_total_width+c*cell_width+i];
-            dst_buffer[(dst_height-1)*dst_total_width+(c+1)*dst_cell_width-byte_per_pixel+i] =
-                src_buffer[(src_height-1)*src_total_width+(c+1)*cell_width-byte_per_pixel+i];
+            dst_buffer[(dst_height-1)*dst_total_width+(c+1)*dst_cell_width-4+i] =
+                src_buffer[(src_height-1)*src_total_width+(c+1)*cell_width-4+i];
         }
     }
 }
@@ -1,5 +1,5 @@
 /* -*- C++ -*-
- * 
+ *
  *  resize_image.h - resize image using smoothing and resampling
  *
  *  Copyright (c) 2001-2004 Ogapee. All rights reserved.
@@ -24,6 +24,17 @@
 // Modified by Uncle Mion (UncleMion@gmail.com) Nov-Dec 2009,
 //   to account for multicell images during resizing
 
+#include <stddef.h>
+
+class AcceleratedGraphicsFunctions;
+class Compositor;
+
+// Resizes a 32-bit image: a box filter the size of the reduction
+// smooths the source, which is then bilinearly resampled.  Cells of a
+// multicell image are kept apart.  Keeps no state between calls, so
+// may run on several threads; if compositor is given, rows are spread
+// over its threads.  gfx supplies the vector kernels (basic if NULL).
 void resizeImage( unsigned char *dst_buffer, int dst_width, int dst_height, int dst_total_width,
-                  unsigned char *src_buffer, int src_width, int src_height, int src_total_width,
-                  int byte_per_pixel, unsigned char *tmp_buffer, int tmp_total_width, int num_cells=1 );
+                  const unsigned char *src_buffer, int src_width, int src_height, int src_total_width,
+                  int num_cells=1, AcceleratedGraphicsFunctions *gfx=NULL,
+                  Compositor *compositor=NULL );
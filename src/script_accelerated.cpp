@@ -0,0 +1,71 @@
+/* -*- C++ -*-
+ *
+ *  script_accelerated.cpp - Accelerated script scanning function chooser
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *  or write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "script_accelerated.h"
+#include "graphics_accelerated.h"
+
+#include "script_sse2.h"
+#include "script_avx2.h"
+
+#include <string.h>
+
+#ifdef USE_X86_GFX
+# include <cpuid.h>
+#endif
+
+void scriptXorKey_Basic(unsigned char *buf, size_t length, const unsigned char *key)
+{
+    for (size_t i = 0; i < length; i++) {
+        buf[i] ^= key[i % SCRIPT_KEY_LENGTH];
+    }
+}
+
+size_t scriptFindByte_Basic(const char *buf, size_t length, char c)
+{
+    const char *p = (const char *) memchr(buf, c, length);
+    return p ? p - buf : length;
+}
+
+size_t scriptFindEither_Basic(const char *buf, size_t length, char a, char b)
+{
+    for (size_t i = 0; i < length; i++) {
+        if (buf[i] == a || buf[i] == b) return i;
+    }
+    return length;
+}
+
+AcceleratedScriptFunctions AcceleratedScriptFunctions::accelerated() {
+    AcceleratedScriptFunctions out;
+
+#ifdef USE_X86_GFX
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) != 0 && (edx & bit_SSE2)) {
+        out._xorKey = scriptXorKey_SSE2;
+        out._findByte = scriptFindByte_SSE2;
+        out._findEither = scriptFindEither_SSE2;
+    }
+    if (hasAVX2()) {
+        out._xorKey = scriptXorKey_AVX2;
+        out._findByte = scriptFindByte_AVX2;
+        out._findEither = scriptFindEither_AVX2;
+    }
+#endif
+    return out;
+}
@@ -0,0 +1,61 @@
+/* -*- C++ -*-
+ *
+ *  script_accelerated.h - Accelerated script scanning function chooser
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *  or write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+// Length of the key stream passed to xorKey; a multiple of every
+// vector width and of the five-byte nscr_sec.dat magic.
+#define SCRIPT_KEY_LENGTH 160
+
+void scriptXorKey_Basic(unsigned char *buf, size_t length, const unsigned char *key);
+size_t scriptFindByte_Basic(const char *buf, size_t length, char c);
+size_t scriptFindEither_Basic(const char *buf, size_t length, char a, char b);
+
+class AcceleratedScriptFunctions {
+    void (*_xorKey)(unsigned char *buf, size_t length, const unsigned char *key);
+    size_t (*_findByte)(const char *buf, size_t length, char c);
+    size_t (*_findEither)(const char *buf, size_t length, char a, char b);
+
+public:
+    AcceleratedScriptFunctions() {
+        _xorKey = scriptXorKey_Basic;
+        _findByte = scriptFindByte_Basic;
+        _findEither = scriptFindEither_Basic;
+    }
+    static AcceleratedScriptFunctions basic() { return AcceleratedScriptFunctions(); }
+    static AcceleratedScriptFunctions accelerated();
+
+    // buf[i] ^= key[i % SCRIPT_KEY_LENGTH]
+    void xorKey(unsigned char *buf, size_t length, const unsigned char *key) {
+        _xorKey(buf, length, key);
+    }
+
+    // Index of the first c in buf, or length if there is none.
+    size_t findByte(const char *buf, size_t length, char c) {
+        return _findByte(buf, length, c);
+    }
+
+    // Index of the first a or b in buf, or length if there is neither.
+    size_t findEither(const char *buf, size_t length, char a, char b) {
+        return _findEither(buf, length, a, b);
+    }
+};
@@ -0,0 +1,78 @@
+/* -*- C++ -*-
+ *
+ *  script_avx2.cpp - AVX2 script scanning functions
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *  or write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef USE_X86_GFX
+
+#include <immintrin.h>
+
+#include "script_accelerated.h"
+#include "script_avx2.h"
+
+
+void scriptXorKey_AVX2(unsigned char *buf, size_t length, const unsigned char *key)
+{
+    size_t i = 0;
+    for (; i + SCRIPT_KEY_LENGTH <= length; i += SCRIPT_KEY_LENGTH) {
+        for (int k = 0; k < SCRIPT_KEY_LENGTH; k += 32) {
+            __m256i* p = (__m256i*)(buf + i + k);
+            __m256i x = _mm256_loadu_si256((const __m256i*)(key + k));
+            _mm256_storeu_si256(p, _mm256_xor_si256(_mm256_loadu_si256(p), x));
+        }
+    }
+    for (int k = 0; i < length; i++, k++) {
+        buf[i] ^= key[k];
+    }
+}
+
+
+size_t scriptFindByte_AVX2(const char *buf, size_t length, char c)
+{
+    __m256i vc = _mm256_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(buf + i));
+        unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, vc));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    for (; i < length; i++) {
+        if (buf[i] == c) return i;
+    }
+    return length;
+}
+
+
+size_t scriptFindEither_AVX2(const char *buf, size_t length, char a, char b)
+{
+    __m256i va = _mm256_set1_epi8(a);
+    __m256i vb = _mm256_set1_epi8(b);
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(buf + i));
+        unsigned int mask = _mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    for (; i < length; i++) {
+        if (buf[i] == a || buf[i] == b) return i;
+    }
+    return length;
+}
+
+#endif
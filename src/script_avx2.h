@@ -0,0 +1,29 @@
+/* -*- C++ -*-
+ *
+ *  script_avx2.h - AVX2 script scanning functions
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *  or write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef USE_X86_GFX
+
+#include <stddef.h>
+
+void scriptXorKey_AVX2(unsigned char *buf, size_t length, const unsigned char *key);
+size_t scriptFindByte_AVX2(const char *buf, size_t length, char c);
+size_t scriptFindEither_AVX2(const char *buf, size_t length, char a, char b);
+
+#endif
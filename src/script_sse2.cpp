@@ -0,0 +1,78 @@
+/* -*- C++ -*-
+ *
+ *  script_sse2.cpp - SSE2 script scanning functions
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *  or write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef USE_X86_GFX
+
+#include <emmintrin.h>
+
+#include "script_accelerated.h"
+#include "script_sse2.h"
+
+
+void scriptXorKey_SSE2(unsigned char *buf, size_t length, const unsigned char *key)
+{
+    size_t i = 0;
+    for (; i + SCRIPT_KEY_LENGTH <= length; i += SCRIPT_KEY_LENGTH) {
+        for (int k = 0; k < SCRIPT_KEY_LENGTH; k += 16) {
+            __m128i* p = (__m128i*)(buf + i + k);
+            __m128i x = _mm_loadu_si128((const __m128i*)(key + k));
+            _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), x));
+        }
+    }
+    for (int k = 0; i < length; i++, k++) {
+        buf[i] ^= key[k];
+    }
+}
+
+
+size_t scriptFindByte_SSE2(const char *buf, size_t length, char c)
+{
+    __m128i vc = _mm_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(buf + i));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, vc));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    for (; i < length; i++) {
+        if (buf[i] == c) return i;
+    }
+    return length;
+}
+
+
+size_t scriptFindEither_SSE2(const char *buf, size_t length, char a, char b)
+{
+    __m128i va = _mm_set1_epi8(a);
+    __m128i vb = _mm_set1_epi8(b);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(buf + i));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, va),
+                                                  _mm_cmpeq_epi8(v, vb)));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    for (; i < length; i++) {
+        if (buf[i] == a || buf[i] == b) return i;
+    }
+    return length;
+}
+
+#endif
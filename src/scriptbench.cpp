@@ -0,0 +1,334 @@
+/* -*- C++ -*-
+ *
+ *  scriptbench.cpp - Checks and times script decoding and scanning
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+// Usage: scriptbench
+//
+// Makes up a script with CRLF and LF lines, lone CRs, UTF-8 BOMs and
+// other 0xEF bytes, and stores it in each of the four encryption
+// modes.  ScriptHandler::readScriptSub decodes each one, as does the
+// byte-at-a-time loop it replaced.  Then every script_accelerated
+// back end this CPU supports counts the lines with findByte, as
+// labelScript does, as does the old byte loop.  Exits non-zero if
+// any results differ; otherwise reports each one's rate in GB/s.
+// ScriptHandler pulls in most of the engine, so this is linked with
+// the rest of it.
+
+#include "ScriptHandler.h"
+#include "script_accelerated.h"
+#include "script_avx2.h"
+#include "script_sse2.h"
+#include "graphics_accelerated.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#define SCRIPT_LENGTH (32 * 1024 * 1024)
+#define OLD_BUF_LEN 4096
+
+typedef size_t (*FindByteFn)(const char*, size_t, char);
+
+struct Backend {
+    const char* name;
+    bool (*usable)();
+    FindByteFn findByte;
+};
+
+static bool always() { return true; }
+
+#ifdef USE_X86_GFX
+static bool hasSSE2() { return __builtin_cpu_supports("sse2"); }
+#endif
+
+static const Backend backends[] = {
+    { "Basic", always, scriptFindByte_Basic },
+#ifdef USE_X86_GFX
+    { "SSE2", hasSSE2, scriptFindByte_SSE2 },
+    { "AVX2", hasAVX2, scriptFindByte_AVX2 },
+#endif
+    { NULL, NULL, NULL }
+};
+
+
+// readScriptSub as it was, a byte at a time.
+static void oldReadScriptSub(FILE* fp, char** buf, int encrypt_mode,
+                             bool is_utf, const unsigned char* key_table)
+{
+    unsigned char magic[5] = { 0x79, 0x57, 0x0d, 0x80, 0x04 };
+    int  magic_counter = 0;
+    bool cr_flag = false;
+    int bom_check = 0;
+    char tmp_script_buf[OLD_BUF_LEN];
+
+    size_t len = 0, count = 0;
+    while (1) {
+        if (len == count) {
+            len = fread(tmp_script_buf, 1, OLD_BUF_LEN, fp);
+            if (len == 0) {
+                if (cr_flag) *(*buf)++ = 0x0a;
+
+                break;
+            }
+
+            count = 0;
+        }
+
+        char ch = tmp_script_buf[count++];
+        if (encrypt_mode == 1) ch ^= 0x84;
+        else if (encrypt_mode == 2) {
+            ch = (ch ^ magic[magic_counter++]) & 0xff;
+            if (magic_counter == 5) magic_counter = 0;
+        }
+        else if (encrypt_mode == 3) {
+            ch = key_table[(unsigned char) ch] ^ 0x84;
+        }
+
+        if (cr_flag && ch != 0x0a) {
+            *(*buf)++    = 0x0a;
+            cr_flag = false;
+        }
+
+        if (ch == 0x0d) {
+            cr_flag = true;
+            continue;
+        }
+
+        if (ch == 0x0a) {
+            *(*buf)++    = 0x0a;
+            cr_flag = false;
+        }
+        else {
+            *(*buf)++ = ch;
+        }
+
+        if (is_utf) {
+            //check for UTF-8 BOM and skip it
+            if ((ch == char(0xef)) && (bom_check == 0))
+                bom_check = 1;
+            else if ((ch == char(0xbb)) && (bom_check == 1))
+                bom_check = 2;
+            else if ((ch == char(0xbf)) && (bom_check == 2)) {
+                *buf -= 3;
+                bom_check = 0;
+            } else
+                bom_check = 0;
+        }
+    }
+
+    *(*buf)++ = 0x0a;
+}
+
+
+static unsigned int seed = 12345;
+
+static unsigned int rnd()
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+
+// Lines of words, mostly CRLF-terminated, with the odd bare LF, lone
+// CR, BOM, and full-width katakana (which starts with 0xEF).
+static std::vector<unsigned char> makeScript(size_t length)
+{
+    static const char* words[] = {
+        "mov", "%0,", "1", "if", "goto", "*label", "gosub", "ld",
+        "c,\":a;image.png\",1", "\xe3\x80\x81", "\xef\xbd\xb1",
+        "\xe2\x80\x94", "`Text", "@", "\\"
+    };
+    std::vector<unsigned char> out;
+    while (out.size() < length) {
+        int words_in_line = rnd() % 12;
+        for (int i = 0; i < words_in_line; i++) {
+            const char* w = words[rnd() % (sizeof words / sizeof *words)];
+            out.insert(out.end(), w, w + strlen(w));
+            out.push_back(' ');
+        }
+        switch (rnd() % 64) {
+        case 0:  out.push_back(0x0a); break;
+        case 1:  out.push_back(0x0d); break;
+        case 2:
+            out.push_back(0xef);
+            out.push_back(0xbb);
+            out.push_back(0xbf);
+            // fall through
+        default:
+            out.push_back(0x0d);
+            out.push_back(0x0a);
+        }
+    }
+    out.resize(length);
+    return out;
+}
+
+
+// Stores script so that readScriptSub decodes it as it is.
+static FILE* store(const std::vector<unsigned char>& script,
+                   int encrypt_mode, const unsigned char* key_table)
+{
+    static const unsigned char magic[5] = { 0x79, 0x57, 0x0d, 0x80, 0x04 };
+    unsigned char inverse[256];
+    for (int i = 0; i < 256; i++) inverse[key_table[i]] = i;
+
+    std::vector<unsigned char> out(script);
+    for (size_t i = 0; i < out.size(); i++) {
+        if (encrypt_mode == 1) out[i] ^= 0x84;
+        else if (encrypt_mode == 2) out[i] ^= magic[i % 5];
+        else if (encrypt_mode == 3) out[i] = inverse[out[i] ^ 0x84];
+    }
+
+    FILE* fp = tmpfile();
+    if (fp && (fwrite(&out[0], 1, out.size(), fp) != out.size() ||
+               fflush(fp))) {
+        fclose(fp);
+        fp = NULL;
+    }
+    return fp;
+}
+
+
+// Seconds for the fastest of a few runs.
+class Timer {
+public:
+    Timer() : best(1e9), start(0), runs(0) {}
+    bool running() {
+        if (start) {
+            double s = (double) (SDL_GetPerformanceCounter() - start) /
+                       SDL_GetPerformanceFrequency();
+            if (s < best) best = s;
+        }
+        if (runs++ == RUNS) return false;
+        start = SDL_GetPerformanceCounter();
+        return true;
+    }
+    double best;
+
+private:
+    enum { RUNS = 5 };
+    Uint64 start;
+    int runs;
+};
+
+
+static void report(const char* name, size_t length, double old_s,
+                   double new_s)
+{
+    printf("  %-16s %6.2f GB/s %6.2f GB/s  %5.1fx\n", name,
+           length / old_s / 1e9, length / new_s / 1e9, old_s / new_s);
+}
+
+
+int main(int argc, char** argv)
+{
+    if (argc > 1) {
+        fprintf(stderr, "Usage: scriptbench\n");
+        return 2;
+    }
+
+    std::vector<unsigned char> script = makeScript(SCRIPT_LENGTH);
+    unsigned char key_table[256];
+    for (int i = 0; i < 256; i++) key_table[i] = i;
+    for (int i = 255; i > 0; i--) {
+        int j = rnd() % (i + 1);
+        unsigned char t = key_table[i];
+        key_table[i] = key_table[j];
+        key_table[j] = t;
+    }
+
+    // Decoding only ever shrinks the script, bar the final newline.
+    std::vector<char> old_buf(SCRIPT_LENGTH + 2), new_buf(old_buf.size());
+    size_t old_len = 0, new_len = 0;
+
+    ScriptHandler handler;
+    handler.setKeyTable(key_table);
+
+    int failures = 0;
+    printf("readScriptSub, %d MB:  before       after\n",
+           SCRIPT_LENGTH / (1024 * 1024));
+    static const char* mode_names[] = {
+        "mode 0 (UTF-8)", "mode 1", "mode 2", "mode 3"
+    };
+    for (int mode = 0; mode < 4; mode++) {
+        bool is_utf = mode == 0;
+        FILE* fp = store(script, mode, key_table);
+        if (!fp) {
+            fprintf(stderr, "Couldn't write the test script\n");
+            return 1;
+        }
+
+        Timer old_t, new_t;
+        while (old_t.running()) {
+            char* p = &old_buf[0];
+            fseek(fp, 0, SEEK_SET);
+            oldReadScriptSub(fp, &p, mode, is_utf, key_table);
+            old_len = p - &old_buf[0];
+        }
+        while (new_t.running()) {
+            char* p = &new_buf[0];
+            fseek(fp, 0, SEEK_SET);
+            handler.readScriptSub(fp, &p, mode, is_utf);
+            new_len = p - &new_buf[0];
+        }
+        fclose(fp);
+
+        if (old_len != new_len || memcmp(&old_buf[0], &new_buf[0], old_len)) {
+            fprintf(stderr, "%s: readScriptSub output differs\n",
+                    mode_names[mode]);
+            failures++;
+        }
+        report(mode_names[mode], script.size(), old_t.best, new_t.best);
+    }
+
+    // What labelScript and skipLine step through.
+    const char* text = &new_buf[0];
+    const char* end = text + new_len;
+    size_t old_lines = 0;
+    Timer old_t;
+    while (old_t.running()) {
+        old_lines = 0;
+        for (const char* p = text; p < end; old_lines++) {
+            while (*p != 0x0a) p++;
+            p++;
+        }
+    }
+
+    printf("newline scan:          before       after\n");
+    for (const Backend* b = backends; b->name; b++) {
+        if (!b->usable()) {
+            printf("  %-16s not supported by this CPU\n", b->name);
+            continue;
+        }
+        size_t lines = 0;
+        Timer t;
+        while (t.running()) {
+            lines = 0;
+            for (const char* p = text; p < end; lines++)
+                p += b->findByte(p, end - p, 0x0a) + 1;
+        }
+        if (lines != old_lines) {
+            fprintf(stderr, "%s: found %lu lines, not %lu\n", b->name,
+                    (unsigned long) lines, (unsigned long) old_lines);
+            failures++;
+        }
+        report(b->name, new_len, old_t.best, t.best);
+    }
+
+    return failures ? 1 : 0;
+}